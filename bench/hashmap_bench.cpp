@@ -0,0 +1,649 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// hashmap_bench.cpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+
+// Microbenchmarks of HashTemplate, driven directly rather than through
+// the Rcpp module. R is embedded only because the templates use
+// Rcpp vectors (and R's memory manager) for keys(), erase() and the
+// joins; inserts, lookups and iteration use the raw-pointer entry
+// points backing the C API, so no R objects are created on those
+// paths. With --workload (or --trace) a mixed stream of finds,
+// inserts and erases from workload.hpp is timed instead. See
+// README.md in this directory for usage.
+
+#include "HashTemplate.hpp"
+#include "workload.hpp"
+#include <Rembedded.h>
+#include <Rversion.h>
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+using namespace hashmap;
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct options {
+    std::vector<double> sizes;
+    std::set<std::string> keys, values, ops;
+    int reps;
+    bool ordered;
+    bool quiet;
+    std::string out;
+
+    // workload mode; sizes give workload_spec::n
+    bool workload;
+    workload_spec spec;
+    std::string trace, record;
+
+    options()
+        : reps(0), ordered(false), quiet(false), workload(false)
+    {}
+
+    bool wants(const std::set<std::string>& x, const std::string& s) const
+    { return x.empty() || x.count(s) > 0; }
+};
+
+struct result {
+    std::string key, value, op;
+    double n;
+    int reps;
+    double ns_median, ns_min;
+    double bytes_per_entry;
+
+    // workload mode only: number of operations, and the fraction of
+    // finds which found their key
+    double ops;
+    double hit_rate;
+
+    result()
+        : n(0), reps(0), ns_median(0), ns_min(0), bytes_per_entry(0),
+          ops(-1), hit_rate(-1)
+    {}
+};
+
+template <typename T>
+std::vector<typename traits::api_traits<T>::type>
+api_array(const std::vector<T>& x)
+{
+    std::vector<typename traits::api_traits<T>::type> res(x.size());
+    for (std::size_t i = 0; i < x.size(); i++) {
+        res[i] = traits::api_traits<T>::to(x[i]);
+    }
+    return res;
+}
+
+int count_entry(const void*, const void*, void* data)
+{
+    ++*static_cast<std::size_t*>(data);
+    return 1;
+}
+
+// Runs setup() and then body() reps times, timing only body(); the
+// timings are reported per element, i.e. divided by n.
+template <typename Setup, typename Body>
+void measure(const options& opt, const std::string& op,
+             const std::string& key, const std::string& value,
+             std::size_t n, int reps, double bytes_per_entry,
+             Setup setup, Body body, std::vector<result>& out)
+{
+    if (!opt.wants(opt.ops, op)) return;
+
+    std::vector<double> ns(reps);
+    for (int r = 0; r < reps; r++) {
+        setup();
+        bench_clock::time_point t0 = bench_clock::now();
+        body();
+        bench_clock::time_point t1 = bench_clock::now();
+        ns[r] = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    }
+
+    std::sort(ns.begin(), ns.end());
+
+    result res;
+    res.key = key;
+    res.value = value;
+    res.op = op;
+    res.n = (double)n;
+    res.reps = reps;
+    res.ns_median = ns[reps / 2] / n;
+    res.ns_min = ns[0] / n;
+    res.bytes_per_entry = bytes_per_entry;
+    out.push_back(res);
+
+    if (!opt.quiet) {
+        std::fprintf(stderr, "%-9s -> %-9s  n = %-8.0e  %-11s %10.2f ns/op\n",
+                     key.c_str(), value.c_str(), (double)n, op.c_str(),
+                     res.ns_median);
+    }
+}
+
+int default_reps(std::size_t n)
+{
+    if (n >= 10000000) return 1;
+    return std::max(3, std::min(50, (int)(1000000 / n)));
+}
+
+template <typename K, typename V>
+void run_size(const options& opt, std::size_t n, std::vector<result>& out)
+{
+    typedef HashTemplate<K, V> hash_t;
+    typedef typename hash_t::key_vec key_vec;
+    typedef traits::api_traits<V> value_api;
+
+    const std::string kn = gen<K>::name(), vn = gen<V>::name();
+    const int reps = opt.reps > 0 ? opt.reps : default_reps(n);
+
+    std::vector<K> hit(n), miss(n);
+    std::vector<V> vals(n);
+    for (std::size_t i = 0; i < n; i++) {
+        hit[i] = gen<K>::key(2 * i);
+        miss[i] = gen<K>::key(2 * i + 1);
+        vals[i] = gen<V>::value(i);
+    }
+
+    // lookups visit the keys in random order
+    std::vector<typename traits::api_traits<K>::type>
+        hit_api = api_array(hit), miss_api = api_array(miss);
+    std::mt19937_64 rng(42);
+    std::shuffle(hit_api.begin(), hit_api.end(), rng);
+
+    std::vector<typename value_api::type> found(n);
+
+    boost::scoped_ptr<hash_t> h;
+    boost::scoped_ptr<hash_t> tmp;
+
+    measure(opt, "insert", kn, vn, n, reps, 0,
+        [&] {
+            h.reset(new hash_t());
+            if (opt.ordered) h->set_incremental(true);
+        },
+        [&] { h->insert_range(hit.begin(), hit.end(), vals.begin()); },
+        out);
+
+    if (!h || h->size() != n) {
+        h.reset(new hash_t());
+        if (opt.ordered) h->set_incremental(true);
+        h->insert_range(hit.begin(), hit.end(), vals.begin());
+    }
+
+    // table bytes (excluding string payloads) per entry
+    Rcpp::NumericVector ms = h->memory_stats();
+    double table_bytes = ms["table_bytes"];
+    double bpe = table_bytes / n;
+    if (!out.empty() && out.back().op == "insert" &&
+        out.back().key == kn && out.back().value == vn) {
+        out.back().bytes_per_entry = bpe;
+    }
+
+    measure(opt, "find_hit", kn, vn, n, reps, bpe,
+        [] {},
+        [&] { h->find_raw(&hit_api[0], n, &found[0], 0); },
+        out);
+
+    measure(opt, "find_miss", kn, vn, n, reps, bpe,
+        [] {},
+        [&] { h->find_raw(&miss_api[0], n, &found[0], 0); },
+        out);
+
+    std::size_t count = 0;
+    measure(opt, "iterate", kn, vn, n, reps, bpe,
+        [&] { count = 0; },
+        [&] { h->iterate_raw(count_entry, &count); },
+        out);
+
+    // re-inserting an existing entry invalidates the cached keys
+    measure(opt, "keys", kn, vn, n, reps, bpe,
+        [&] { h->insert_range(hit.begin(), hit.begin() + 1, vals.begin()); },
+        [&] { h->keys(); },
+        out);
+
+    measure(opt, "keys_cached", kn, vn, n, reps, bpe,
+        [&] { h->keys(); },
+        [&] { h->keys(); },
+        out);
+
+    measure(opt, "clone", kn, vn, n, reps, bpe,
+        [&] { tmp.reset(); },
+        [&] { tmp.reset(new hash_t(h->clone())); },
+        out);
+    tmp.reset();
+
+    // join against a table holding every other key
+    if (opt.wants(opt.ops, "join")) {
+        hash_t other;
+        for (std::size_t i = 0; i < n; i += 2) {
+            other.insert_range(hit.begin() + i, hit.begin() + i + 1,
+                               vals.begin() + i);
+        }
+
+        measure(opt, "join", kn, vn, n, reps, bpe,
+            [] {},
+            [&] { h->inner_join(other); },
+            out);
+    }
+
+    if (opt.wants(opt.ops, "erase")) {
+        key_vec ek = Rcpp::wrap(hit);
+
+        measure(opt, "erase", kn, vn, n, reps, bpe,
+            [&] { tmp.reset(new hash_t(h->clone())); },
+            [&] { tmp->erase(ek); },
+            out);
+        tmp.reset();
+    }
+}
+
+// Times the operations of w, one entry point call per operation,
+// after loading w.preload (untimed) into a new table.
+template <typename K, typename V>
+void run_workload(const options& opt, const workload<K, V>& w,
+                  const std::string& op, std::vector<result>& out)
+{
+    typedef HashTemplate<K, V> hash_t;
+    typedef traits::api_traits<V> value_api;
+
+    const std::string kn = gen<K>::name(), vn = gen<V>::name();
+    const std::size_t nops = w.kinds.size();
+    const int reps = opt.reps > 0 ? opt.reps :
+        default_reps(nops ? nops : 1);
+
+    std::vector<typename traits::api_traits<K>::type>
+        kapi = api_array(w.keys);
+    std::vector<typename value_api::type> vapi = api_array(w.values);
+
+    std::vector<double> ns(reps);
+    std::size_t finds = 0, hits = 0;
+    double bpe = 0;
+
+    for (int r = 0; r < reps; r++) {
+        hash_t h;
+        if (opt.ordered) h.set_incremental(true);
+        h.insert_range(w.preload.begin(), w.preload.end(),
+                       w.preload_values.begin());
+
+        typename value_api::type found_value;
+        int found;
+        finds = hits = 0;
+
+        bench_clock::time_point t0 = bench_clock::now();
+        for (std::size_t o = 0; o < nops; o++) {
+            switch (w.kinds[o]) {
+                case op_find:
+                    h.find_raw(&kapi[o], 1, &found_value, &found);
+                    ++finds;
+                    hits += found;
+                    break;
+                case op_insert:
+                    h.insert_raw(&kapi[o], &vapi[o], 1);
+                    break;
+                default:
+                    h.erase_raw(&kapi[o], 1);
+                    break;
+            }
+        }
+        bench_clock::time_point t1 = bench_clock::now();
+        ns[r] = std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+        if (r == 0 && h.size()) {
+            Rcpp::NumericVector ms = h.memory_stats();
+            double table_bytes = ms["table_bytes"];
+            bpe = table_bytes / h.size();
+        }
+    }
+
+    std::sort(ns.begin(), ns.end());
+
+    result res;
+    res.key = kn;
+    res.value = vn;
+    res.op = op;
+    res.n = (double)w.preload.size();
+    res.reps = reps;
+    res.ns_median = nops ? ns[reps / 2] / nops : 0;
+    res.ns_min = nops ? ns[0] / nops : 0;
+    res.bytes_per_entry = bpe;
+    res.ops = (double)nops;
+    res.hit_rate = finds ? (double)hits / finds : -1;
+    out.push_back(res);
+
+    if (!opt.quiet) {
+        std::fprintf(stderr,
+                     "%-9s -> %-9s  n = %-8.0e  %-11s %10.2f ns/op"
+                     "  (%.0f ops, %.1f%% hits)\n",
+                     kn.c_str(), vn.c_str(), res.n, op.c_str(),
+                     res.ns_median, res.ops, 100 * (finds ? res.hit_rate : 0));
+    }
+}
+
+template <typename K, typename V>
+void run_combo(const options& opt, std::vector<result>& out)
+{
+    if (!opt.wants(opt.keys, gen<K>::name()) ||
+        !opt.wants(opt.values, gen<V>::name())) {
+        return;
+    }
+
+    if (!opt.trace.empty()) {
+        run_workload(opt, read_trace<K, V>(opt.trace), "trace", out);
+        return;
+    }
+
+    for (std::size_t i = 0; i < opt.sizes.size(); i++) {
+        if (!opt.workload) {
+            run_size<K, V>(opt, (std::size_t)opt.sizes[i], out);
+            continue;
+        }
+
+        workload_spec spec = opt.spec;
+        spec.n = (std::size_t)opt.sizes[i];
+        workload<K, V> w = generate<K, V>(spec);
+
+        if (!opt.record.empty()) write_trace(opt.record, w);
+        run_workload(opt, w, "workload", out);
+    }
+}
+
+void run_all(const options& opt, std::vector<result>& out)
+{
+    run_combo<std::string, std::string>(opt, out);
+    run_combo<std::string, double>(opt, out);
+    run_combo<std::string, int>(opt, out);
+    run_combo<std::string, bool>(opt, out);
+    run_combo<std::string, Rcomplex>(opt, out);
+
+    run_combo<double, double>(opt, out);
+    run_combo<double, std::string>(opt, out);
+    run_combo<double, int>(opt, out);
+    run_combo<double, bool>(opt, out);
+    run_combo<double, Rcomplex>(opt, out);
+
+    run_combo<int, int>(opt, out);
+    run_combo<int, std::string>(opt, out);
+    run_combo<int, double>(opt, out);
+    run_combo<int, bool>(opt, out);
+    run_combo<int, Rcomplex>(opt, out);
+}
+
+void write_json(std::FILE* f, const options& opt,
+                const std::vector<result>& res)
+{
+    char date[32];
+    std::time_t now = std::time(0);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ",
+                  std::gmtime(&now));
+
+#if defined(HASHMAP_NO_SPP) || (defined(__sun) && defined(__SVR4))
+    const char* table = "boost::unordered_map";
+#else
+    const char* table = "spp::sparse_hash_map";
+#endif
+
+    std::fprintf(f, "{\n");
+    std::fprintf(f, "  \"suite\": \"hashmap\",\n");
+    std::fprintf(f, "  \"layer\": \"cpp\",\n");
+    std::fprintf(f, "  \"meta\": {\n");
+    std::fprintf(f, "    \"date\": \"%s\",\n", date);
+    std::fprintf(f, "    \"table\": \"%s\",\n", table);
+    std::fprintf(f, "    \"layout\": \"%s\",\n",
+                 opt.ordered ? "ordered" : "hash");
+#ifdef __VERSION__
+    std::fprintf(f, "    \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+    if (!opt.trace.empty()) {
+        std::fprintf(f, "    \"trace\": \"%s\",\n", opt.trace.c_str());
+    } else if (opt.workload) {
+        const workload_spec& w = opt.spec;
+        std::fprintf(
+            f,
+            "    \"workload\": {\"ops\": %lu, \"zipf\": %g, "
+            "\"miss\": %g, \"mix\": [%g, %g, %g], \"dup\": %g, "
+            "\"key_len\": [%lu, %lu], \"seed\": %llu},\n",
+            (unsigned long)w.nops, w.zipf, w.miss,
+            w.find, w.insert, w.erase, w.dup,
+            (unsigned long)w.key_len_min, (unsigned long)w.key_len_max,
+            w.seed
+        );
+    }
+    std::fprintf(f, "    \"r_version\": \"%s.%s\"\n", R_MAJOR, R_MINOR);
+    std::fprintf(f, "  },\n");
+    std::fprintf(f, "  \"results\": [");
+
+    for (std::size_t i = 0; i < res.size(); i++) {
+        const result& r = res[i];
+        std::fprintf(
+            f,
+            "%s\n    {\"key\": \"%s\", \"value\": \"%s\", \"op\": \"%s\", "
+            "\"n\": %.0f, \"reps\": %d, \"ns_per_op\": %.4f, "
+            "\"ns_per_op_min\": %.4f, \"bytes_per_entry\": %.3f",
+            i ? "," : "", r.key.c_str(), r.value.c_str(), r.op.c_str(),
+            r.n, r.reps, r.ns_median, r.ns_min, r.bytes_per_entry
+        );
+        if (r.ops >= 0) std::fprintf(f, ", \"ops\": %.0f", r.ops);
+        if (r.hit_rate >= 0) {
+            std::fprintf(f, ", \"hit_rate\": %.4f", r.hit_rate);
+        }
+        std::fputc('}', f);
+    }
+
+    std::fprintf(f, "\n  ]\n}\n");
+}
+
+void usage()
+{
+    std::fprintf(
+        stderr,
+        "usage: hashmap_bench [options]\n"
+        "  --sizes LIST    table sizes (default 1e3,1e4,1e5,1e6)\n"
+        "  --keys LIST     key types: character,numeric,integer\n"
+        "  --values LIST   value types: character,numeric,integer,"
+        "logical,complex\n"
+        "  --ops LIST      insert,find_hit,find_miss,iterate,keys,"
+        "keys_cached,clone,join,erase\n"
+        "  --reps N        repetitions (default depends on size)\n"
+        "  --ordered       use the ordered (incremental) layout\n"
+        "  --out FILE      write JSON to FILE rather than stdout\n"
+        "  --quiet         no progress output\n"
+        "\n"
+        "workload mode (any of the following; sizes give the keys loaded):\n"
+        "  --workload      time a mixed operation stream\n"
+        "  --nops N        operations (default 1e6)\n"
+        "  --zipf S        skew of finds and erases (default 0.99; 0 is "
+        "uniform)\n"
+        "  --miss F        fraction of finds for absent keys (default 0.1)\n"
+        "  --mix F:I:E     find:insert:erase ratio (default 90:5:5)\n"
+        "  --dup F         fraction of inserts overwriting keys (default 0)\n"
+        "  --key-len A:B   length range of character keys (default 16:16)\n"
+        "  --seed N        random seed (default 42)\n"
+        "  --record FILE   also write the generated operations as a trace\n"
+        "  --trace FILE    replay a trace instead of generating operations\n"
+    );
+}
+
+std::vector<std::string> split(const std::string& x)
+{
+    std::vector<std::string> res;
+    std::stringstream ss(x);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) res.push_back(item);
+    }
+    return res;
+}
+
+bool parse_args(int argc, char** argv, options& opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        bool has_arg = i + 1 < argc;
+
+        if (a == "--ordered") {
+            opt.ordered = true;
+        } else if (a == "--workload") {
+            opt.workload = true;
+        } else if (a == "--quiet") {
+            opt.quiet = true;
+        } else if (a == "--help" || a == "-h") {
+            usage();
+            return false;
+        } else if (!has_arg) {
+            usage();
+            return false;
+        } else if (a == "--sizes") {
+            std::vector<std::string> s = split(argv[++i]);
+            for (std::size_t j = 0; j < s.size(); j++) {
+                double n = std::strtod(s[j].c_str(), 0);
+                if (!(n >= 1 && n <= 1e8)) {
+                    std::fprintf(stderr, "invalid size '%s'\n", s[j].c_str());
+                    return false;
+                }
+                opt.sizes.push_back(n);
+            }
+        } else if (a == "--keys") {
+            std::vector<std::string> s = split(argv[++i]);
+            opt.keys.insert(s.begin(), s.end());
+        } else if (a == "--values") {
+            std::vector<std::string> s = split(argv[++i]);
+            opt.values.insert(s.begin(), s.end());
+        } else if (a == "--ops") {
+            std::vector<std::string> s = split(argv[++i]);
+            opt.ops.insert(s.begin(), s.end());
+        } else if (a == "--reps") {
+            opt.reps = std::atoi(argv[++i]);
+        } else if (a == "--out") {
+            opt.out = argv[++i];
+        } else if (a == "--nops") {
+            opt.workload = true;
+            opt.spec.nops = (std::size_t)std::strtod(argv[++i], 0);
+        } else if (a == "--zipf") {
+            opt.workload = true;
+            opt.spec.zipf = std::strtod(argv[++i], 0);
+        } else if (a == "--miss") {
+            opt.workload = true;
+            opt.spec.miss = std::strtod(argv[++i], 0);
+        } else if (a == "--dup") {
+            opt.workload = true;
+            opt.spec.dup = std::strtod(argv[++i], 0);
+        } else if (a == "--seed") {
+            opt.workload = true;
+            opt.spec.seed = std::strtoull(argv[++i], 0, 10);
+        } else if (a == "--mix") {
+            opt.workload = true;
+            if (std::sscanf(argv[++i], "%lf:%lf:%lf", &opt.spec.find,
+                            &opt.spec.insert, &opt.spec.erase) != 3) {
+                std::fprintf(stderr, "invalid mix '%s'\n", argv[i]);
+                return false;
+            }
+        } else if (a == "--key-len") {
+            opt.workload = true;
+            unsigned long lo, hi;
+            if (std::sscanf(argv[++i], "%lu:%lu", &lo, &hi) != 2 ||
+                lo > hi) {
+                std::fprintf(stderr, "invalid key length '%s'\n", argv[i]);
+                return false;
+            }
+            opt.spec.key_len_min = lo;
+            opt.spec.key_len_max = hi;
+        } else if (a == "--record") {
+            opt.workload = true;
+            opt.record = argv[++i];
+        } else if (a == "--trace") {
+            opt.trace = argv[++i];
+        } else {
+            usage();
+            return false;
+        }
+    }
+
+    if (opt.sizes.empty()) {
+        opt.sizes.push_back(1e3);
+        opt.sizes.push_back(1e4);
+        opt.sizes.push_back(1e5);
+        opt.sizes.push_back(1e6);
+    }
+
+    if (!opt.record.empty() &&
+        (opt.sizes.size() != 1 || opt.keys.size() != 1)) {
+        std::fprintf(stderr, "--record requires a single size and key type\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Rcpp resolves some of its routines through R_GetCCallable, so its
+// namespace must be loaded before any Rcpp object is created
+void load_rcpp()
+{
+    SEXP call = PROTECT(
+        Rf_lang2(Rf_install("loadNamespace"), Rf_mkString("Rcpp"))
+    );
+    int err = 0;
+    R_tryEval(call, R_GlobalEnv, &err);
+    UNPROTECT(1);
+
+    if (err) throw std::runtime_error("cannot load the Rcpp namespace");
+}
+
+} // bench
+
+int main(int argc, char** argv)
+{
+    bench::options opt;
+    if (!bench::parse_args(argc, argv, opt)) return 2;
+
+    char* rargv[] = {
+        (char*)"hashmap_bench", (char*)"--vanilla",
+        (char*)"--silent", (char*)"--no-save"
+    };
+    Rf_initEmbeddedR(4, rargv);
+
+    int status = 0;
+    try {
+        bench::load_rcpp();
+
+        std::vector<bench::result> res;
+        bench::run_all(opt, res);
+
+        std::FILE* f = opt.out.empty() ? stdout :
+            std::fopen(opt.out.c_str(), "w");
+        if (!f) throw std::runtime_error("cannot open '" + opt.out + "'");
+
+        bench::write_json(f, opt, res);
+        if (f != stdout) std::fclose(f);
+    } catch (std::exception& e) {
+        std::fprintf(stderr, "hashmap_bench: %s\n", e.what());
+        status = 1;
+    }
+
+    Rf_endEmbeddedR(0);
+    return status;
+}
@@ -0,0 +1,435 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// workload.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+
+#ifndef hashmap__bench__workload__hpp
+#define hashmap__bench__workload__hpp
+
+#include "HashTemplate.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// splitmix64 finalizer; a bijection, so distinct inputs give distinct
+// keys
+inline unsigned long long mix(unsigned long long x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Key and value generators. Keys are generated from j = 2 * i for
+// the n keys inserted and from j = 2 * i + 1 for the n keys which are
+// looked up but never inserted, so hits and misses never collide.
+template <typename T>
+struct gen;
+
+template <>
+struct gen<int> {
+    static const char* name() { return "integer"; }
+    static int key(std::size_t j) { return (int)(j + 1); }
+    static int value(std::size_t i) { return (int)(mix(i) % 1000000); }
+};
+
+// non-integral, so that the bit-mixing path of double_hash is used
+template <>
+struct gen<double> {
+    static const char* name() { return "numeric"; }
+    static double key(std::size_t j) { return j * 0.5 + 0.25; }
+    static double value(std::size_t i)
+    { return (double)(mix(i) >> 11) / 9007199254740992.0; }
+};
+
+// 16 hex digits, i.e. just past the small string buffer of libstdc++
+template <>
+struct gen<std::string> {
+    static const char* name() { return "character"; }
+
+    static std::string key(std::size_t j)
+    {
+        char buf[24];
+        std::snprintf(buf, sizeof(buf), "%016llx", mix(j));
+        return buf;
+    }
+
+    static std::string value(std::size_t i)
+    {
+        char buf[24];
+        std::snprintf(buf, sizeof(buf), "v%llu", mix(i) % 1000000);
+        return buf;
+    }
+};
+
+template <>
+struct gen<bool> {
+    static const char* name() { return "logical"; }
+    static bool value(std::size_t i) { return (mix(i) & 1) != 0; }
+};
+
+template <>
+struct gen<Rcomplex> {
+    static const char* name() { return "complex"; }
+
+    static Rcomplex value(std::size_t i)
+    {
+        Rcomplex res;
+        res.r = (double)(mix(i) % 1000);
+        res.i = (double)i;
+        return res;
+    }
+};
+
+// Zipf distributed ranks in [1, n], P(k) ~ k^-s, by rejection-inversion
+// (Hormann and Derflinger, 1996), so that no table of size n is needed;
+// s = 0 gives the uniform distribution.
+class zipf_sampler {
+private:
+    double n, s;
+    double h_x1, h_n, threshold;
+
+    // log1p(x) / x and expm1(x) / x, accurate near 0
+    static double helper1(double x)
+    {
+        if (std::fabs(x) > 1e-8) return std::log1p(x) / x;
+        return 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+    }
+
+    static double helper2(double x)
+    {
+        if (std::fabs(x) > 1e-8) return std::expm1(x) / x;
+        return 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+    }
+
+    double h(double x) const
+    { return std::exp(-s * std::log(x)); }
+
+    // integral of h from 1 to x
+    double h_integral(double x) const
+    {
+        double lx = std::log(x);
+        return helper2((1 - s) * lx) * lx;
+    }
+
+    double h_integral_inverse(double x) const
+    {
+        double t = x * (1 - s);
+        if (t < -1) t = -1;
+        return std::exp(helper1(t) * x);
+    }
+
+public:
+    zipf_sampler(std::size_t n_, double s_)
+        : n((double)n_), s(s_)
+    {
+        h_x1 = h_integral(1.5) - 1;
+        h_n = h_integral(n + 0.5);
+        threshold = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+    }
+
+    template <typename Rng>
+    std::size_t operator()(Rng& rng) const
+    {
+        std::uniform_real_distribution<double> unif(0, 1);
+
+        if (s <= 0) return 1 + (std::size_t)(unif(rng) * n);
+
+        for (;;) {
+            double u = h_n + unif(rng) * (h_x1 - h_n);
+            double x = h_integral_inverse(u);
+            double k = std::floor(x + 0.5);
+
+            if (k < 1) k = 1;
+            if (k > n) k = n;
+
+            if (k - x <= threshold || u >= h_integral(k + 0.5) - h(k)) {
+                return (std::size_t)k;
+            }
+        }
+    }
+};
+
+struct workload_spec {
+    std::size_t n;              // keys loaded before the timed operations
+    std::size_t nops;           // timed operations
+    double zipf;                // skew of finds and erases; 0 is uniform
+    double miss;                // fraction of finds for absent keys
+    double find, insert, erase; // relative frequencies of the operations
+    double dup;                 // fraction of inserts overwriting a loaded key
+    std::size_t key_len_min;    // length range of character keys
+    std::size_t key_len_max;
+    unsigned long long seed;
+
+    workload_spec()
+        : n(0), nops(1000000), zipf(0.99), miss(0.1),
+          find(90), insert(5), erase(5), dup(0),
+          key_len_min(16), key_len_max(16), seed(42)
+    {}
+};
+
+enum op_kind { op_find = 'f', op_insert = 'i', op_erase = 'e' };
+
+// An operation stream over the keys of a HashTemplate<K, V>: the
+// table is first loaded with preload / preload_values, and then
+// operation o is kinds[o] applied to keys[o] (and values[o] for
+// inserts). Keys are materialized up front so that generating them
+// is not timed.
+template <typename K, typename V>
+struct workload {
+    std::vector<K> preload;
+    std::vector<V> preload_values;
+
+    std::vector<char> kinds;
+    std::vector<K> keys;
+    std::vector<V> values;
+
+    void push(char kind, const K& k)
+    {
+        kinds.push_back(kind);
+        keys.push_back(k);
+        values.push_back(gen<V>::value(values.size()));
+    }
+};
+
+// Key j of a workload. As in gen<K>, loaded and inserted keys use even
+// j and absent ones odd j; character keys start with j in hex, which
+// makes them unique, and are padded to a length drawn from
+// [key_len_min, key_len_max] (a function of j, so the same j always
+// gives the same key).
+template <typename K>
+inline K workload_key(unsigned long long j, const workload_spec&)
+{ return gen<K>::key((std::size_t)j); }
+
+template <>
+inline std::string workload_key<std::string>(unsigned long long j,
+                                             const workload_spec& spec)
+{
+    char buf[24];
+    int m = std::snprintf(buf, sizeof(buf), "%llx-", j);
+
+    std::size_t len = spec.key_len_min;
+    if (spec.key_len_max > spec.key_len_min) {
+        len += mix(j ^ 0x5bd1e995ULL) % (spec.key_len_max - len + 1);
+    }
+
+    std::string res(buf, m);
+    res.reserve(len);
+
+    unsigned long long h = mix(j);
+    while (res.size() < len) {
+        res.push_back((char)('a' + h % 26));
+        h /= 26;
+        if (h < 26) h = mix(j + res.size());
+    }
+
+    return res;
+}
+
+// Finds and erases pick loaded keys with Zipf(zipf) popularity (rank
+// 1 being the first loaded key), or with probability miss (finds
+// only) an absent key; inserts add a new key or, with probability
+// dup, overwrite a loaded key picked like the finds.
+template <typename K, typename V>
+workload<K, V> generate(const workload_spec& spec)
+{
+    if ((int)hashmap::traits::sexp_traits<K>::rtype == INTSXP &&
+        2.0 * (spec.n + spec.nops) + 2 > 2147483647.0) {
+        throw std::runtime_error("too many integer keys for the workload");
+    }
+
+    workload<K, V> res;
+    std::mt19937_64 rng(spec.seed);
+    std::uniform_real_distribution<double> unif(0, 1);
+    zipf_sampler zipf(spec.n, spec.zipf);
+
+    res.preload.reserve(spec.n);
+    res.preload_values.reserve(spec.n);
+    for (std::size_t i = 0; i < spec.n; i++) {
+        res.preload.push_back(workload_key<K>(2 * i, spec));
+        res.preload_values.push_back(gen<V>::value(i));
+    }
+
+    double total = spec.find + spec.insert + spec.erase;
+    if (!(total > 0)) throw std::runtime_error("invalid operation mix");
+
+    unsigned long long fresh = spec.n;
+    res.kinds.reserve(spec.nops);
+    res.keys.reserve(spec.nops);
+    res.values.reserve(spec.nops);
+
+    for (std::size_t o = 0; o < spec.nops; o++) {
+        double u = unif(rng) * total;
+        unsigned long long j;
+        char kind;
+
+        if (u < spec.find) {
+            kind = op_find;
+            if (unif(rng) < spec.miss) {
+                j = 2 * (unsigned long long)(unif(rng) * spec.n) + 1;
+            } else {
+                j = 2 * (zipf(rng) - 1);
+            }
+        } else if (u < spec.find + spec.insert) {
+            kind = op_insert;
+            j = unif(rng) < spec.dup ? 2 * (zipf(rng) - 1) : 2 * fresh++;
+        } else {
+            kind = op_erase;
+            j = 2 * (zipf(rng) - 1);
+        }
+
+        res.push(kind, workload_key<K>(j, spec));
+    }
+
+    return res;
+}
+
+// Traces are text files with one operation per line: a kind and a
+// key separated by a tab, where the kind is p (loaded before timing
+// starts), f, i or e. Empty lines and lines starting with # are
+// ignored. Values are not recorded; they are generated on replay.
+template <typename K>
+struct trace_key;
+
+template <>
+struct trace_key<std::string> {
+    static std::string format(const std::string& x) { return x; }
+    static bool parse(const std::string& x, std::string& res)
+    {
+        res = x;
+        return true;
+    }
+};
+
+template <>
+struct trace_key<double> {
+    static std::string format(double x)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.17g", x);
+        return buf;
+    }
+
+    static bool parse(const std::string& x, double& res)
+    {
+        char* end;
+        res = std::strtod(x.c_str(), &end);
+        return !x.empty() && !*end;
+    }
+};
+
+template <>
+struct trace_key<int> {
+    static std::string format(int x)
+    {
+        char buf[16];
+        std::snprintf(buf, sizeof(buf), "%d", x);
+        return buf;
+    }
+
+    static bool parse(const std::string& x, int& res)
+    {
+        char* end;
+        long tmp = std::strtol(x.c_str(), &end, 10);
+        res = (int)tmp;
+        return !x.empty() && !*end && tmp > -2147483647L - 1 &&
+            tmp <= 2147483647L;
+    }
+};
+
+template <typename K, typename V>
+void write_trace(const std::string& path, const workload<K, V>& w)
+{
+    std::ofstream out(path.c_str());
+    if (!out) throw std::runtime_error("cannot open '" + path + "'");
+
+    out << "# hashmap trace\n";
+    for (std::size_t i = 0; i < w.preload.size(); i++) {
+        out << "p\t" << trace_key<K>::format(w.preload[i]) << '\n';
+    }
+    for (std::size_t o = 0; o < w.kinds.size(); o++) {
+        out << w.kinds[o] << '\t' << trace_key<K>::format(w.keys[o]) << '\n';
+    }
+
+    if (!out) throw std::runtime_error("error writing '" + path + "'");
+}
+
+template <typename K, typename V>
+workload<K, V> read_trace(const std::string& path)
+{
+    std::ifstream in(path.c_str());
+    if (!in) throw std::runtime_error("cannot open '" + path + "'");
+
+    workload<K, V> res;
+    std::string line;
+    std::size_t lineno = 0;
+
+    while (std::getline(in, line)) {
+        ++lineno;
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        if (line.empty() || line[0] == '#') continue;
+
+        char kind = line[0];
+        K k;
+
+        if (line.size() < 2 || line[1] != '\t' ||
+            !trace_key<K>::parse(line.substr(2), k)) {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%lu", (unsigned long)lineno);
+            throw std::runtime_error(
+                "invalid line " + std::string(buf) + " in '" + path + "'"
+            );
+        }
+
+        switch (kind) {
+            case 'p':
+                res.preload.push_back(k);
+                res.preload_values.push_back(
+                    gen<V>::value(res.preload_values.size())
+                );
+                break;
+            case op_find:
+            case op_insert:
+            case op_erase:
+                res.push(kind, k);
+                break;
+            default:
+                throw std::runtime_error(
+                    "unknown operation '" + std::string(1, kind) +
+                    "' in '" + path + "'"
+                );
+        }
+    }
+
+    return res;
+}
+
+} // bench
+
+#endif // hashmap__bench__workload__hpp
@@ -0,0 +1,67 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// CursorTemplate.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__CursorTemplate__hpp
+#define hashmap__CursorTemplate__hpp
+
+#include "HashTemplate.hpp"
+#include "HashCursorClass.h"
+
+namespace hashmap {
+
+// Holds a position in a HashTemplate<K, V>. Each call to next_chunk
+// resumes where the previous one stopped, so a full pass is linear in
+// the size of the map and only one chunk is materialized at a time.
+template <typename HashType>
+class CursorTemplate : public cursor_base {
+private:
+    typedef typename HashType::position position_t;
+
+    boost::shared_ptr<HashType> hash;
+    position_t pos;
+
+public:
+    explicit CursorTemplate(const boost::shared_ptr<HashType>& hash_)
+        : hash(hash_), pos(hash_->begin_position())
+    {}
+
+    SEXP next_chunk(int n)
+    { return Rcpp::wrap(hash->next_chunk(pos, n)); }
+
+    // (an error once the map has been modified, like next_chunk, so
+    // that a loop over the chunks cannot end early without notice)
+    bool has_next() const
+    {
+        if (pos.version != hash->version()) {
+            Rcpp::stop("Hashmap was modified during iteration");
+        }
+        return pos.done < hash->size();
+    }
+
+    double position() const
+    { return (double)pos.done; }
+
+    void reset()
+    { pos = hash->begin_position(); }
+};
+
+} // hashmap
+
+#endif // hashmap__CursorTemplate__hpp
@@ -0,0 +1,387 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// EngineTemplate.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__EngineTemplate__hpp
+#define hashmap__EngineTemplate__hpp
+
+#include "HashTemplate.hpp"
+#include "CursorTemplate.hpp"
+#include <boost/make_shared.hpp>
+#include <boost/mpl/vector.hpp>
+#include <boost/mpl/for_each.hpp>
+#include <boost/mpl/identity.hpp>
+#include <boost/mpl/placeholders.hpp>
+#include <map>
+#include <set>
+#include <utility>
+
+namespace hashmap {
+
+// engine implementation for one HashTemplate instantiation; it
+// shares ownership of the table with any cursors over it
+template <typename HashType>
+class EngineTemplate : public engine {
+private:
+    boost::shared_ptr<HashType> hash;
+
+    static engine_ptr make(const HashType& x)
+    {
+        return boost::make_shared<EngineTemplate>(
+            boost::make_shared<HashType>(x)
+        );
+    }
+
+public:
+    explicit EngineTemplate(const boost::shared_ptr<HashType>& hash_)
+        : hash(hash_)
+    {}
+
+    engine_ptr clone() const
+    { return make(hash->clone()); }
+
+    engine_ptr snapshot()
+    { return make(hash->snapshot()); }
+
+    engine_ptr filter(value_cmp op, SEXP operand) const
+    { return make(hash->keep_if(op, operand)); }
+
+    std::size_t size() const
+    { return hash->size(); }
+
+    int key_sexptype() const
+    { return hash->key_sexptype(); }
+
+    int value_sexptype() const
+    { return hash->value_sexptype(); }
+
+    std::string key_class_name() const
+    { return hash->key_class_name(); }
+
+    std::string value_class_name() const
+    { return hash->value_class_name(); }
+
+    bool keys_cached() const
+    { return hash->keys_cached(); }
+
+    bool values_cached() const
+    { return hash->values_cached(); }
+
+    bool incremental() const
+    { return hash->incremental(); }
+
+    void set_incremental(bool flag)
+    { hash->set_incremental(flag); }
+
+    bool frozen() const
+    { return hash->frozen(); }
+
+    void freeze()
+    { hash->freeze(); }
+
+    bool encoded() const
+    { return hash->encoded(); }
+
+    bool persistent() const
+    { return hash->persistent(); }
+
+    void set_persistent(bool flag)
+    { hash->set_persistent(flag); }
+
+    bool bloom() const
+    { return hash->bloom(); }
+
+    void set_bloom(bool flag, double bits_per_key)
+    { hash->set_bloom(flag, bits_per_key); }
+
+    void set_journal(const std::string& path, bool sync)
+    { hash->set_journal(path, sync); }
+
+    void open_journal(const std::string& path, bool sync)
+    { hash->open_journal(path, sync); }
+
+    void close_journal()
+    { hash->close_journal(); }
+
+    void checkpoint()
+    { hash->checkpoint(); }
+
+    std::string journal_path() const
+    { return hash->journal_path(); }
+
+    bool journal_sync() const
+    { return hash->journal_sync(); }
+
+    SEXP memory_stats() const
+    { return Rcpp::wrap(hash->memory_stats()); }
+
+    SEXP key_vector(int n) const
+    { return hash->key_vector(n); }
+
+    SEXP value_vector(int n) const
+    { return hash->value_vector(n); }
+
+    SEXP na_value_vector(int n) const
+    { return hash->na_value_vector(n); }
+
+    void clear()
+    { hash->clear(); }
+
+    std::size_t bucket_count() const
+    { return hash->bucket_count(); }
+
+    void rehash(std::size_t n)
+    { hash->rehash(n); }
+
+    void reserve(std::size_t n)
+    { hash->reserve(n); }
+
+    SEXP hash_value(SEXP keys) const
+    { return Rcpp::wrap(hash->hash_value(keys)); }
+
+    void insert(SEXP keys, SEXP values)
+    { hash->insert(keys, values); }
+
+    void update(const engine& other, merge_policy policy)
+    {
+        const EngineTemplate* rhs =
+            dynamic_cast<const EngineTemplate*>(&other);
+        if (!rhs) {
+            Rcpp::stop(
+                "Attempt to update a Hashmap of %s => %s with one of %s => %s",
+                key_class_name().c_str(),
+                value_class_name().c_str(),
+                other.key_class_name().c_str(),
+                other.value_class_name().c_str()
+            );
+        }
+        hash->update(*rhs->hash, policy);
+    }
+
+    double erase_if(value_cmp op, SEXP operand)
+    { return (double)hash->erase_if(op, operand); }
+
+    void transform(value_arith op, SEXP operand)
+    { hash->transform(op, operand); }
+
+    double na_omit()
+    { return (double)hash->na_omit(); }
+
+    SEXP keys() const
+    { return Rcpp::wrap(hash->keys()); }
+
+    SEXP keys_n(int n) const
+    { return Rcpp::wrap(hash->keys_n(n)); }
+
+    SEXP values() const
+    { return Rcpp::wrap(hash->values()); }
+
+    SEXP values_n(int n) const
+    { return Rcpp::wrap(hash->values_n(n)); }
+
+    void cache_keys()
+    { hash->cache_keys(); }
+
+    void cache_values()
+    { hash->cache_values(); }
+
+    void erase(SEXP keys)
+    { hash->erase(keys); }
+
+    SEXP find(SEXP keys) const
+    { return Rcpp::wrap(hash->find(keys)); }
+
+    bool has_key(SEXP key) const
+    { return hash->has_key(key); }
+
+    SEXP has_keys(SEXP keys) const
+    { return Rcpp::wrap(hash->has_keys(keys)); }
+
+    SEXP get_scalar(SEXP key) const
+    { return hash->get_scalar(key); }
+
+    void set_scalar(SEXP key, SEXP value)
+    { hash->set_scalar(key, value); }
+
+    bool has_scalar(SEXP key) const
+    { return hash->has_scalar(key); }
+
+    bool erase_scalar(SEXP key)
+    { return hash->erase_scalar(key); }
+
+    void find_raw(const void* keys, R_xlen_t n,
+                  void* values, int* found) const
+    { hash->find_raw(keys, n, values, found); }
+
+    bool insert_raw(const void* keys, const void* values, R_xlen_t n)
+    { return hash->insert_raw(keys, values, n); }
+
+    void erase_raw(const void* keys, R_xlen_t n)
+    { hash->erase_raw(keys, n); }
+
+    void iterate_raw(raw_visit_fn fn, void* data) const
+    { hash->iterate_raw(fn, data); }
+
+    SEXP floor(SEXP keys) const
+    { return Rcpp::wrap(hash->floor(keys)); }
+
+    SEXP ceiling(SEXP keys) const
+    { return Rcpp::wrap(hash->ceiling(keys)); }
+
+    SEXP rank(SEXP keys) const
+    { return Rcpp::wrap(hash->rank(keys)); }
+
+    SEXP range(SEXP lo, SEXP hi) const
+    { return Rcpp::wrap(hash->range(lo, hi)); }
+
+    SEXP data() const
+    { return Rcpp::wrap(hash->data()); }
+
+    SEXP data_n(int n) const
+    { return Rcpp::wrap(hash->data_n(n)); }
+
+    SEXP data_frame() const
+    { return Rcpp::wrap(hash->data_frame()); }
+
+    SEXP cursor() const
+    {
+        cursor_ptr ptr = boost::make_shared<CursorTemplate<HashType> >(hash);
+        return Rcpp::internal::make_new_object(new HashCursor(ptr));
+    }
+
+    SEXP left_outer_join(const HashMap& other) const
+    { return Rcpp::wrap(hash->left_outer_join(other)); }
+
+    SEXP right_outer_join(const HashMap& other) const
+    { return Rcpp::wrap(hash->right_outer_join(other)); }
+
+    SEXP inner_join(const HashMap& other) const
+    { return Rcpp::wrap(hash->inner_join(other)); }
+
+    SEXP full_outer_join(const HashMap& other) const
+    { return Rcpp::wrap(hash->full_outer_join(other)); }
+};
+
+// an engine over a table built elsewhere (e.g. from a file)
+template <typename HashType>
+engine_ptr make_engine(const boost::shared_ptr<HashType>& hash)
+{ return boost::make_shared<EngineTemplate<HashType> >(hash); }
+
+// The supported key and value types; every combination is
+// registered with engine_registry below.
+typedef boost::mpl::vector<std::string, double, int> key_types;
+typedef boost::mpl::vector<
+    std::string, double, int, bool, Rcomplex
+> value_types;
+
+// Maps the SEXPTYPEs of a key and a value vector to the constructor
+// of the matching HashTemplate, instantiated from the type lists
+// above, so that HashMap::init need not enumerate the combinations.
+class engine_registry {
+public:
+    typedef engine_ptr (*create_fn)(SEXP keys, SEXP values, bool ordered);
+
+private:
+    typedef std::map<std::pair<int, int>, create_fn> map_t;
+
+    map_t creators;
+    std::set<int> key_rtypes;
+
+    template <typename K, typename V>
+    static engine_ptr make(SEXP keys, SEXP values, bool ordered)
+    {
+        typedef HashTemplate<K, V> hash_t;
+        return make_engine(boost::make_shared<hash_t>(
+            Rcpp::as<typename hash_t::key_vec>(keys),
+            Rcpp::as<typename hash_t::value_vec>(values),
+            ordered
+        ));
+    }
+
+    template <typename K>
+    struct add_values {
+        engine_registry* self;
+
+        explicit add_values(engine_registry* self_)
+            : self(self_)
+        {}
+
+        template <typename V>
+        void operator()(boost::mpl::identity<V>) const
+        {
+            typedef HashTemplate<K, V> hash_t;
+            self->creators[std::make_pair(
+                (int)hash_t::key_rtype, (int)hash_t::value_rtype
+            )] = &make<K, V>;
+        }
+    };
+
+    struct add_keys {
+        engine_registry* self;
+
+        explicit add_keys(engine_registry* self_)
+            : self(self_)
+        {}
+
+        template <typename K>
+        void operator()(boost::mpl::identity<K>) const
+        {
+            self->key_rtypes.insert(traits::sexp_traits<K>::rtype);
+            boost::mpl::for_each<
+                value_types, boost::mpl::make_identity<boost::mpl::_1>
+            >(add_values<K>(self));
+        }
+    };
+
+    engine_registry()
+    {
+        boost::mpl::for_each<
+            key_types, boost::mpl::make_identity<boost::mpl::_1>
+        >(add_keys(this));
+    }
+
+    engine_registry(const engine_registry&);
+    engine_registry& operator=(const engine_registry&);
+
+public:
+    static const engine_registry& instance()
+    {
+        static engine_registry res;
+        return res;
+    }
+
+    engine_ptr create(SEXP keys, SEXP values, bool ordered) const
+    {
+        if (!key_rtypes.count(TYPEOF(keys))) {
+            Rcpp::stop("Invalid key type!");
+        }
+
+        map_t::const_iterator pos =
+            creators.find(std::make_pair(TYPEOF(keys), TYPEOF(values)));
+        if (pos == creators.end()) {
+            Rcpp::stop("Invalid value type!");
+        }
+
+        return pos->second(keys, values, ordered);
+    }
+};
+
+} // hashmap
+
+#endif // hashmap__EngineTemplate__hpp
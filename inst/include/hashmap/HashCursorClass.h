@@ -0,0 +1,67 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// HashCursorClass.h
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__HashCursorClass__h
+#define hashmap__HashCursorClass__h
+
+#include <Rcpp.h>
+#include <boost/shared_ptr.hpp>
+
+namespace hashmap {
+
+// Type-erased iteration state over one of the HashTemplate
+// instantiations behind a HashMap; see CursorTemplate.hpp.
+class cursor_base {
+public:
+    virtual ~cursor_base() {}
+
+    virtual SEXP next_chunk(int n) = 0;
+
+    virtual bool has_next() const = 0;
+
+    virtual double position() const = 0;
+
+    virtual void reset() = 0;
+};
+
+typedef boost::shared_ptr<cursor_base> cursor_ptr;
+
+// Returned by Hashmap$cursor(); pages through the entries of the map
+// without materializing them all at once. The cursor keeps the
+// underlying table alive, and fails if it is modified in the meantime.
+class HashCursor {
+private:
+    cursor_ptr impl;
+
+public:
+    explicit HashCursor(const cursor_ptr& impl_);
+
+    SEXP next_chunk(int n);
+
+    bool has_next() const;
+
+    double position() const;
+
+    void reset();
+};
+
+} // hashmap
+
+#endif // hashmap__HashCursorClass__h
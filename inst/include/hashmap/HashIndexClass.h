@@ -0,0 +1,150 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// HashIndexClass.h
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__HashIndexClass__h
+#define hashmap__HashIndexClass__h
+
+#include <Rcpp.h>
+#include <boost/variant.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace hashmap {
+
+template <typename KeyType>
+class IndexTemplate;
+
+#define MAKE_PTR_TYPE(__TYPE__)                                \
+    typedef boost::shared_ptr<__TYPE__> __TYPE__##_ptr
+
+typedef IndexTemplate<std::string> s_index;
+MAKE_PTR_TYPE(s_index);
+
+typedef IndexTemplate<double> d_index;
+MAKE_PTR_TYPE(d_index);
+
+typedef IndexTemplate<int> i_index;
+MAKE_PTR_TYPE(i_index);
+
+#undef MAKE_PTR_TYPE
+
+typedef boost::variant<
+    s_index_ptr, d_index_ptr, i_index_ptr
+> variant_index;
+
+class HashIndex {
+private:
+    variant_index variant;
+
+    struct clone_visitor
+        : public boost::static_visitor<variant_index>
+    {
+        template <typename T>
+        variant_index operator()(const T& t) const;
+    };
+
+    struct size_visitor
+        : public boost::static_visitor<std::size_t>
+    {
+        template <typename T>
+        std::size_t operator()(const T& t) const;
+    };
+
+    struct length_visitor
+        : public boost::static_visitor<double>
+    {
+        template <typename T>
+        double operator()(const T& t) const;
+    };
+
+    struct key_sexptype_visitor
+        : public boost::static_visitor<int>
+    {
+        template <typename T>
+        int operator()(const T& t) const;
+    };
+
+    struct match_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        SEXP keys;
+        int nomatch;
+        match_visitor(SEXP keys_, int nomatch_);
+
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+    struct contains_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        SEXP keys;
+        contains_visitor(SEXP keys_);
+
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+    struct any_duplicated_visitor
+        : public boost::static_visitor<double>
+    {
+        SEXP keys;
+        any_duplicated_visitor(SEXP keys_);
+
+        template <typename T>
+        double operator()(const T& t) const;
+    };
+
+    struct tabulate_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        SEXP keys;
+        tabulate_visitor(SEXP keys_);
+
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+public:
+    HashIndex(SEXP x);
+
+    HashIndex(const HashIndex& other);
+
+    int size() const;
+
+    double length() const;
+
+    int key_sexptype() const;
+
+    SEXP match(SEXP x) const;
+
+    SEXP match_nomatch(SEXP x, int nomatch) const;
+
+    SEXP contains(SEXP x) const;
+
+    double any_duplicated() const;
+
+    double any_duplicated_in(SEXP x) const;
+
+    SEXP tabulate(SEXP x) const;
+};
+
+} // hashmap
+
+#endif // hashmap__HashIndexClass__h
@@ -22,384 +22,253 @@
 #define hashmap__HashMapClass__h
 
 #include <Rcpp.h>
-#include <boost/variant.hpp>
 #include <boost/shared_ptr.hpp>
 
+// Arrow C data interface structures; see arrow_bridge.hpp
+struct ArrowSchema;
+struct ArrowArray;
+
 namespace hashmap {
 
-template <typename KeyType, typename ValueType>
-class HashTemplate;
+// callback for HashMap::iterate_raw (hashmap_visit_fn in the C API);
+// return 0 to stop the iteration
+typedef int (*raw_visit_fn)(const void* key, const void* value, void* data);
+
+// resolution of keys present in both maps, for HashMap::update
+enum merge_policy {
+    merge_overwrite = 0,
+    merge_keep,
+    merge_sum,
+    merge_min,
+    merge_max,
+    merge_error
+};
+
+// value comparisons of HashMap::erase_if / filter, and value
+// arithmetic of HashMap::transform
+enum value_cmp {
+    cmp_eq = 0,
+    cmp_ne,
+    cmp_lt,
+    cmp_le,
+    cmp_gt,
+    cmp_ge
+};
+
+enum value_arith {
+    arith_add = 0,
+    arith_sub,
+    arith_mul,
+    arith_div,
+    arith_pow
+};
+
+class HashMap;
+
+class engine;
+typedef boost::shared_ptr<engine> engine_ptr;
+
+// Batch-oriented interface to the table behind a HashMap, implemented
+// for each HashTemplate instantiation by EngineTemplate, so that each
+// HashMap method costs one indirect call (per batch, for the
+// vectorized, scalar and C API operations) and the set of key and
+// value types is fixed in one place (see engine_registry).
+class engine {
+public:
+    virtual ~engine() {}
+
+    // a deep copy of the table
+    virtual engine_ptr clone() const = 0;
+
+    // an O(1) copy sharing storage; see HashTemplate::snapshot
+    virtual engine_ptr snapshot() = 0;
+
+    virtual engine_ptr filter(value_cmp op, SEXP operand) const = 0;
+
+    virtual std::size_t size() const = 0;
+
+    virtual int key_sexptype() const = 0;
+
+    virtual int value_sexptype() const = 0;
+
+    virtual std::string key_class_name() const = 0;
+
+    virtual std::string value_class_name() const = 0;
+
+    virtual bool keys_cached() const = 0;
+
+    virtual bool values_cached() const = 0;
+
+    virtual bool incremental() const = 0;
+
+    virtual void set_incremental(bool flag) = 0;
+
+    virtual bool frozen() const = 0;
+
+    virtual void freeze() = 0;
+
+    virtual bool encoded() const = 0;
+
+    virtual bool persistent() const = 0;
+
+    virtual void set_persistent(bool flag) = 0;
+
+    virtual bool bloom() const = 0;
+
+    virtual void set_bloom(bool flag, double bits_per_key) = 0;
+
+    virtual void set_journal(const std::string& path, bool sync) = 0;
+
+    virtual void open_journal(const std::string& path, bool sync) = 0;
+
+    virtual void close_journal() = 0;
+
+    virtual void checkpoint() = 0;
+
+    virtual std::string journal_path() const = 0;
+
+    virtual bool journal_sync() const = 0;
+
+    virtual SEXP memory_stats() const = 0;
+
+    virtual SEXP key_vector(int n) const = 0;
+
+    virtual SEXP value_vector(int n) const = 0;
+
+    virtual SEXP na_value_vector(int n) const = 0;
+
+    virtual void clear() = 0;
+
+    virtual std::size_t bucket_count() const = 0;
+
+    virtual void rehash(std::size_t n) = 0;
+
+    virtual void reserve(std::size_t n) = 0;
+
+    virtual SEXP hash_value(SEXP keys) const = 0;
+
+    virtual void insert(SEXP keys, SEXP values) = 0;
+
+    // merges other, which must hold a table of the same type
+    virtual void update(const engine& other, merge_policy policy) = 0;
+
+    virtual double erase_if(value_cmp op, SEXP operand) = 0;
+
+    virtual void transform(value_arith op, SEXP operand) = 0;
+
+    virtual double na_omit() = 0;
+
+    virtual SEXP keys() const = 0;
+
+    virtual SEXP keys_n(int n) const = 0;
+
+    virtual SEXP values() const = 0;
+
+    virtual SEXP values_n(int n) const = 0;
+
+    virtual void cache_keys() = 0;
 
-#define MAKE_PTR_TYPE(__TYPE__)                                \
-    typedef boost::shared_ptr<__TYPE__> __TYPE__##_ptr
+    virtual void cache_values() = 0;
 
-typedef HashTemplate<std::string, std::string> ss_hash;
-MAKE_PTR_TYPE(ss_hash);
+    virtual void erase(SEXP keys) = 0;
 
-typedef HashTemplate<std::string, double> sd_hash;
-MAKE_PTR_TYPE(sd_hash);
+    virtual SEXP find(SEXP keys) const = 0;
 
-typedef HashTemplate<std::string, int> si_hash;
-MAKE_PTR_TYPE(si_hash);
+    virtual bool has_key(SEXP key) const = 0;
 
-typedef HashTemplate<std::string, bool> sb_hash;
-MAKE_PTR_TYPE(sb_hash);
+    virtual SEXP has_keys(SEXP keys) const = 0;
 
-typedef HashTemplate<std::string, Rcomplex> sx_hash;
-MAKE_PTR_TYPE(sx_hash);
+    virtual SEXP get_scalar(SEXP key) const = 0;
 
-typedef HashTemplate<double, double> dd_hash;
-MAKE_PTR_TYPE(dd_hash);
+    virtual void set_scalar(SEXP key, SEXP value) = 0;
 
-typedef HashTemplate<double, std::string> ds_hash;
-MAKE_PTR_TYPE(ds_hash);
+    virtual bool has_scalar(SEXP key) const = 0;
 
-typedef HashTemplate<double, int> di_hash;
-MAKE_PTR_TYPE(di_hash);
+    virtual bool erase_scalar(SEXP key) = 0;
 
-typedef HashTemplate<double, bool> db_hash;
-MAKE_PTR_TYPE(db_hash);
+    virtual void find_raw(const void* keys, R_xlen_t n,
+                          void* values, int* found) const = 0;
 
-typedef HashTemplate<double, Rcomplex> dx_hash;
-MAKE_PTR_TYPE(dx_hash);
+    virtual bool insert_raw(const void* keys, const void* values,
+                            R_xlen_t n) = 0;
 
-typedef HashTemplate<int, int> ii_hash;
-MAKE_PTR_TYPE(ii_hash);
+    virtual void erase_raw(const void* keys, R_xlen_t n) = 0;
 
-typedef HashTemplate<int, std::string> is_hash;
-MAKE_PTR_TYPE(is_hash);
+    virtual void iterate_raw(raw_visit_fn fn, void* data) const = 0;
 
-typedef HashTemplate<int, double> id_hash;
-MAKE_PTR_TYPE(id_hash);
+    virtual SEXP floor(SEXP keys) const = 0;
 
-typedef HashTemplate<int, bool> ib_hash;
-MAKE_PTR_TYPE(ib_hash);
+    virtual SEXP ceiling(SEXP keys) const = 0;
 
-typedef HashTemplate<int, Rcomplex> ix_hash;
-MAKE_PTR_TYPE(ix_hash);
+    virtual SEXP rank(SEXP keys) const = 0;
 
-#undef MAKE_PTR_TYPE
+    virtual SEXP range(SEXP lo, SEXP hi) const = 0;
 
-typedef boost::variant<
-    ss_hash_ptr, sd_hash_ptr, si_hash_ptr, sb_hash_ptr, sx_hash_ptr,
-    dd_hash_ptr, ds_hash_ptr, di_hash_ptr, db_hash_ptr, dx_hash_ptr,
-    ii_hash_ptr, is_hash_ptr, id_hash_ptr, ib_hash_ptr, ix_hash_ptr
-> variant_hash;
+    virtual SEXP data() const = 0;
+
+    virtual SEXP data_n(int n) const = 0;
+
+    virtual SEXP data_frame() const = 0;
+
+    // a new HashCursor over the table
+    virtual SEXP cursor() const = 0;
+
+    virtual SEXP left_outer_join(const HashMap& other) const = 0;
+
+    virtual SEXP right_outer_join(const HashMap& other) const = 0;
+
+    virtual SEXP inner_join(const HashMap& other) const = 0;
+
+    virtual SEXP full_outer_join(const HashMap& other) const = 0;
+};
 
 class HashMap {
 private:
-    variant_hash variant;
-
-    struct clone_visitor
-        : public boost::static_visitor<variant_hash>
-    {
-        template <typename T>
-        variant_hash operator()(const T& t) const;
-    };
-
-    struct size_visitor
-        : public boost::static_visitor<std::size_t>
-    {
-        template <typename T>
-        std::size_t operator()(const T& t) const;
-    };
-
-    struct empty_visitor
-        : public boost::static_visitor<bool>
-    {
-        template <typename T>
-        bool operator()(const T& t) const;
-    };
-
-    struct keys_cached_visitor
-        : public boost::static_visitor<bool>
-    {
-        template <typename T>
-        bool operator()(const T& t) const;
-    };
-
-    struct values_cached_visitor
-        : public boost::static_visitor<bool>
-    {
-        template <typename T>
-        bool operator()(const T& t) const;
-    };
-
-    struct key_sexptype_visitor
-        : public boost::static_visitor<int>
-    {
-        template <typename T>
-        int operator()(const T& t) const;
-    };
-
-    struct value_sexptype_visitor
-        : public boost::static_visitor<int>
-    {
-        template <typename T>
-        int operator()(const T& t) const;
-    };
-
-    struct key_vector_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        int n;
-        key_vector_visitor(int n_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct value_vector_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        int n;
-        value_vector_visitor(int n_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct na_value_vector_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        int n;
-        na_value_vector_visitor(int n_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct clear_visitor
-        : public boost::static_visitor<>
-    {
-        template <typename T>
-        void operator()(T& t);
-    };
-
-    struct bucket_count_visitor
-        : public boost::static_visitor<std::size_t>
-    {
-        template <typename T>
-        std::size_t operator()(const T& t) const;
-    };
-
-    struct rehash_visitor
-        : public boost::static_visitor<>
-    {
-        std::size_t n;
-        rehash_visitor(std::size_t n_);
-
-        template <typename T>
-        void operator()(T& t);
-    };
-
-    struct reserve_visitor
-        : public boost::static_visitor<>
-    {
-        std::size_t n;
-        reserve_visitor(std::size_t n_);
-
-        template <typename T>
-        void operator()(T& t);
-    };
-
-    struct hash_value_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        SEXP keys;
-        hash_value_visitor(SEXP keys_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct insert_visitor
-        : public boost::static_visitor<>
-    {
-        SEXP keys, values;
-        insert_visitor(SEXP keys_, SEXP values_);
-
-        template <typename T>
-        void operator()(T& t);
-    };
-
-    struct keys_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct keys_n_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        int n;
-        keys_n_visitor(int n_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct values_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct values_n_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        int n;
-        values_n_visitor(int n_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct cache_keys_visitor
-        : public boost::static_visitor<>
-    {
-        template <typename T>
-        void operator()(T& t);
-    };
-
-    struct cache_values_visitor
-        : public boost::static_visitor<>
-    {
-        template <typename T>
-        void operator()(T& t);
-    };
-
-    struct erase_visitor
-        : public boost::static_visitor<>
-    {
-        SEXP keys;
-        erase_visitor(SEXP keys_);
-
-        template <typename T>
-        void operator()(T& t);
-    };
-
-    struct find_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        SEXP keys;
-        find_visitor(SEXP keys_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct has_key_visitor
-        : public boost::static_visitor<bool>
-    {
-        SEXP keys;
-        has_key_visitor(SEXP keys_);
-
-        template <typename T>
-        bool operator()(const T& t) const;
-    };
-
-    struct has_keys_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        SEXP keys;
-        has_keys_visitor(SEXP keys_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct data_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct data_n_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        int n;
-        data_n_visitor(int n_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct data_frame_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct key_class_name_visitor
-        : public boost::static_visitor<std::string>
-    {
-        template <typename T>
-        std::string operator()(const T& t) const;
-    };
-
-    struct value_class_name_visitor
-        : public boost::static_visitor<std::string>
-    {
-        template <typename T>
-        std::string operator()(const T& t) const;
-    };
-
-    struct left_outer_join_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        const HashMap& other;
-        left_outer_join_visitor(const HashMap& other_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct right_outer_join_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        const HashMap& other;
-        right_outer_join_visitor(const HashMap& other_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct inner_join_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        const HashMap& other;
-        inner_join_visitor(const HashMap& other_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    struct full_outer_join_visitor
-        : public boost::static_visitor<SEXP>
-    {
-        const HashMap& other;
-        full_outer_join_visitor(const HashMap& other_);
-
-        template <typename T>
-        SEXP operator()(const T& t) const;
-    };
-
-    void init(SEXP x, SEXP y);
+    engine_ptr impl;
+
+    explicit HashMap(const engine_ptr& x);
+
+    // replaces the table with tmp's, carrying over the persistent
+    // mode and the journal
+    void replace(HashMap& tmp);
+
+    void init(SEXP x, SEXP y, bool ordered);
 
 public:
     HashMap(SEXP x, SEXP y);
 
+    HashMap(SEXP x, SEXP y, bool ordered);
+
     HashMap(const HashMap& other);
 
     HashMap(const Rcpp::XPtr<HashMap>& ptr);
 
     HashMap clone() const;
 
+    // builds a map from two columns of a delimited text file; see
+    // from_file.cpp
+    static HashMap* from_file(const std::string& path,
+                              int key_col, int value_col, char sep,
+                              const std::string& key_type,
+                              const std::string& value_type,
+                              bool header);
+
+    // builds a map from Arrow key and value arrays, without taking
+    // ownership of them; see arrow.cpp
+    static HashMap* from_arrow(const ArrowSchema* key_schema,
+                               const ArrowArray* keys,
+                               const ArrowSchema* value_schema,
+                               const ArrowArray* values);
+
+    // exports the keys and values, in storage order, into
+    // caller-allocated Arrow structures
+    void to_arrow(ArrowArray* keys, ArrowSchema* key_schema,
+                  ArrowArray* values, ArrowSchema* value_schema) const;
+
+    // restores a map from a journal written by set_journal(), and
+    // continues journaling to it; see journal.cpp
+    static HashMap* open_journal(const std::string& path, bool sync);
+
     void renew(SEXP x, SEXP y);
 
     int size() const;
@@ -410,6 +279,51 @@ public:
 
     bool values_cached() const;
 
+    bool incremental() const;
+
+    void set_incremental(bool flag);
+
+    bool frozen() const;
+
+    void freeze();
+
+    bool persistent() const;
+
+    void set_persistent(bool flag);
+
+    // an O(1) copy sharing storage with *this; see
+    // HashTemplate::snapshot
+    SEXP snapshot();
+
+    bool bloom() const;
+
+    void set_bloom(bool flag);
+
+    void set_bloom_bits(bool flag, double bits_per_key);
+
+    // write-ahead journaling to disk; see HashTemplate::set_journal
+    void set_journal(const std::string& path);
+
+    void set_journal_sync(const std::string& path, bool sync);
+
+    void close_journal();
+
+    void checkpoint();
+
+    bool durable() const;
+
+    std::string journal_path() const;
+
+    bool journal_sync() const;
+
+    // character values stored as codes into a dictionary of their
+    // distinct strings; see factor_dict::encode
+    bool encoded() const;
+
+    void set_encoded(bool flag);
+
+    SEXP memory_stats() const;
+
     int key_sexptype() const;
 
     int value_sexptype() const;
@@ -432,6 +346,23 @@ public:
 
     void insert(SEXP x, SEXP y);
 
+    // merges the entries of another Hashmap (or its .pointer) with
+    // the same key and value types into this one, table to table
+    void update(SEXP other);
+
+    void update_policy(SEXP other, const std::string& policy);
+
+    // single-pass value predicates and arithmetic, without copying
+    // the values into an R vector; erase_if and na_omit return the
+    // number of entries erased, filter a new Hashmap
+    double erase_if(const std::string& op, SEXP operand);
+
+    SEXP filter(const std::string& op, SEXP operand) const;
+
+    void transform(const std::string& op, SEXP operand);
+
+    double na_omit();
+
     SEXP keys() const;
 
     SEXP keys_n(int n) const;
@@ -452,12 +383,41 @@ public:
 
     SEXP has_keys(SEXP x) const;
 
+    void find_raw(const void* keys, R_xlen_t n,
+                  void* values, int* found) const;
+
+    // false (inserting nothing) if a value would need a new level of
+    // encoded values
+    bool insert_raw(const void* keys, const void* values, R_xlen_t n);
+
+    void erase_raw(const void* keys, R_xlen_t n);
+
+    void iterate_raw(raw_visit_fn fn, void* data) const;
+
+    SEXP get_scalar(SEXP x) const;
+
+    void set_scalar(SEXP x, SEXP y);
+
+    bool has_scalar(SEXP x) const;
+
+    bool erase_scalar(SEXP x);
+
+    SEXP floor(SEXP x) const;
+
+    SEXP ceiling(SEXP x) const;
+
+    SEXP rank(SEXP x) const;
+
+    SEXP range(SEXP lo, SEXP hi) const;
+
     SEXP data() const;
 
     SEXP data_n(int n) const;
 
     SEXP data_frame() const;
 
+    SEXP cursor() const;
+
     std::string key_class_name() const;
 
     std::string value_class_name() const;
@@ -479,6 +439,9 @@ public:
     SEXP full_outer_join(const Rcpp::XPtr<HashMap>& other) const;
 };
 
+// the HashMap behind a Hashmap object or its .pointer; see scalar.cpp
+HashMap* hashmap_pointer(SEXP x);
+
 } // hashmap
 
 #endif // hashmap__HashMapClass__h
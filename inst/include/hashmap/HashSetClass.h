@@ -0,0 +1,253 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// HashSetClass.h
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__HashSetClass__h
+#define hashmap__HashSetClass__h
+
+#include <Rcpp.h>
+#include <boost/variant.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace hashmap {
+
+template <typename KeyType>
+class SetTemplate;
+
+#define MAKE_PTR_TYPE(__TYPE__)                                \
+    typedef boost::shared_ptr<__TYPE__> __TYPE__##_ptr
+
+typedef SetTemplate<std::string> s_set;
+MAKE_PTR_TYPE(s_set);
+
+typedef SetTemplate<double> d_set;
+MAKE_PTR_TYPE(d_set);
+
+typedef SetTemplate<int> i_set;
+MAKE_PTR_TYPE(i_set);
+
+#undef MAKE_PTR_TYPE
+
+typedef boost::variant<
+    s_set_ptr, d_set_ptr, i_set_ptr
+> variant_set;
+
+class HashSet {
+private:
+    variant_set variant;
+
+    explicit HashSet(const variant_set& x);
+
+    struct clone_visitor
+        : public boost::static_visitor<variant_set>
+    {
+        template <typename T>
+        variant_set operator()(const T& t) const;
+    };
+
+    struct size_visitor
+        : public boost::static_visitor<std::size_t>
+    {
+        template <typename T>
+        std::size_t operator()(const T& t) const;
+    };
+
+    struct empty_visitor
+        : public boost::static_visitor<bool>
+    {
+        template <typename T>
+        bool operator()(const T& t) const;
+    };
+
+    struct key_sexptype_visitor
+        : public boost::static_visitor<int>
+    {
+        template <typename T>
+        int operator()(const T& t) const;
+    };
+
+    struct key_class_name_visitor
+        : public boost::static_visitor<std::string>
+    {
+        template <typename T>
+        std::string operator()(const T& t) const;
+    };
+
+    struct clear_visitor
+        : public boost::static_visitor<>
+    {
+        template <typename T>
+        void operator()(T& t);
+    };
+
+    struct bucket_count_visitor
+        : public boost::static_visitor<std::size_t>
+    {
+        template <typename T>
+        std::size_t operator()(const T& t) const;
+    };
+
+    struct rehash_visitor
+        : public boost::static_visitor<>
+    {
+        std::size_t n;
+        rehash_visitor(std::size_t n_);
+
+        template <typename T>
+        void operator()(T& t);
+    };
+
+    struct reserve_visitor
+        : public boost::static_visitor<>
+    {
+        std::size_t n;
+        reserve_visitor(std::size_t n_);
+
+        template <typename T>
+        void operator()(T& t);
+    };
+
+    struct hash_value_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        SEXP keys;
+        hash_value_visitor(SEXP keys_);
+
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+    struct insert_visitor
+        : public boost::static_visitor<>
+    {
+        SEXP keys;
+        insert_visitor(SEXP keys_);
+
+        template <typename T>
+        void operator()(T& t);
+    };
+
+    struct erase_visitor
+        : public boost::static_visitor<>
+    {
+        SEXP keys;
+        erase_visitor(SEXP keys_);
+
+        template <typename T>
+        void operator()(T& t);
+    };
+
+    struct contains_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        SEXP keys;
+        contains_visitor(SEXP keys_);
+
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+    struct keys_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+    struct keys_n_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        int n;
+        keys_n_visitor(int n_);
+
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+    enum set_op { op_union, op_intersect, op_diff, op_symdiff };
+
+    struct set_op_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        SEXP other;
+        set_op op;
+        set_op_visitor(SEXP other_, set_op op_);
+
+        template <typename T>
+        SEXP operator()(const T& t) const;
+
+        // lhs <op> rhs, rhs being a set or a vector of keys
+        template <typename S, typename R>
+        SEXP apply(const S& lhs, const R& rhs) const;
+    };
+
+    // the operand of a set operation, if it is another Hashset (which
+    // must have the same key type), or NULL
+    template <typename T>
+    static const T* operand(SEXP x);
+
+public:
+    HashSet();
+
+    HashSet(SEXP x);
+
+    HashSet(const Rcpp::XPtr<HashSet>& ptr);
+
+    HashSet(const HashSet& other);
+
+    int size() const;
+
+    bool empty() const;
+
+    int key_sexptype() const;
+
+    std::string key_class_name() const;
+
+    void clear();
+
+    int bucket_count() const;
+
+    void rehash(int n);
+
+    void reserve(int n);
+
+    SEXP hash_value(SEXP x) const;
+
+    void insert(SEXP x);
+
+    void erase(SEXP x);
+
+    SEXP contains(SEXP x) const;
+
+    SEXP keys() const;
+
+    SEXP keys_n(int n) const;
+
+    SEXP set_union(SEXP other) const;
+
+    SEXP set_intersect(SEXP other) const;
+
+    SEXP set_diff(SEXP other) const;
+
+    SEXP set_symdiff(SEXP other) const;
+};
+
+} // hashmap
+
+#endif // hashmap__HashSetClass__h
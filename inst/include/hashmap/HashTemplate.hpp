@@ -22,6 +22,16 @@
 #define hashmap__HashTemplate__hpp
 
 #include "traits.hpp"
+#include "bloom_filter.hpp"
+#include "dense_table.hpp"
+#include "frozen_table.hpp"
+#include "hamt_table.hpp"
+#include "sorted_index.hpp"
+#include "key_hash.hpp"
+#include "batch_hash.hpp"
+#include "factor_dict.hpp"
+#include "profile.hpp"
+#include "journal.hpp"
 #include <boost/unordered_map.hpp>
 #include <boost/functional/hash.hpp>
 #include "HashMapClass.h"
@@ -42,6 +52,72 @@ inline std::string
 extractor<STRSXP>(const Rcpp::Vector<STRSXP>& vec, R_xlen_t i)
 { return Rcpp::as<std::string>(vec[i]); }
 
+// x as a single T, read directly when it already has the matching
+// SEXPTYPE and otherwise coerced like the vectorized methods do
+template <typename T>
+inline T scalar_extractor(SEXP x, const char* what)
+{
+    enum { rtype = traits::sexp_traits<T>::rtype };
+
+    if (TYPEOF(x) == rtype && Rf_xlength(x) == 1) {
+        return traits::scalar_value<T>(x);
+    }
+
+    Rcpp::Vector<rtype> tmp = Rcpp::as<Rcpp::Vector<rtype> >(x);
+    if (tmp.size() != 1) {
+        Rcpp::stop("'%s' must have length 1", what);
+    }
+
+    return extractor(tmp, 0);
+}
+
+// contiguous storage of x, or NULL if it cannot be read without
+// the R API
+inline const int* raw_keys(const Rcpp::Vector<INTSXP>& x)
+{ return x.begin(); }
+
+inline const double* raw_keys(const Rcpp::Vector<REALSXP>& x)
+{ return x.begin(); }
+
+inline const std::string* raw_keys(const Rcpp::Vector<STRSXP>&)
+{ return 0; }
+
+enum { hash_block_size = 1024 };
+
+// res[i] = Hasher()(x[i]), truncated to int; keys are hashed a block
+// at a time when batch_hasher has a vector kernel for them
+template <typename Hasher, int RTYPE>
+inline void hash_values(const Rcpp::Vector<RTYPE>& x, int* res)
+{
+    typedef typename traits::cpp_traits<RTYPE>::type key_t;
+    typedef batch_hasher<key_t, Hasher> batch_t;
+
+    R_xlen_t i = 0, n = x.size();
+    const key_t* px = raw_keys(x);
+
+    if (px && batch_t::vectorized) {
+        std::size_t h[hash_block_size];
+
+        for (; i < n; i += hash_block_size) {
+            HASHMAP_CHECK_INTERRUPT(i / hash_block_size, 64);
+            R_xlen_t j = 0, m = n - i;
+            if (m > (R_xlen_t)hash_block_size) m = hash_block_size;
+
+            batch_t::run(px + i, m, h);
+            for (; j < m; j++) {
+                res[i + j] = h[j];
+            }
+        }
+        return;
+    }
+
+    Hasher h;
+    for (; i < n; i++) {
+        HASHMAP_CHECK_INTERRUPT(i, 50000);
+        res[i] = h(extractor(x, i));
+    }
+}
+
 class HashMap;
 
 template <typename KeyType, typename ValueType>
@@ -52,9 +128,17 @@ public:
 
 
 #if defined(HASHMAP_NO_SPP) || (defined(__sun) && defined(__SVR4))  // solaris
-    typedef boost::unordered_map<key_t, value_t> map_t;
+    typedef boost::unordered_map<
+        key_t, value_t,
+        typename key_hash<key_t>::hasher,
+        typename key_hash<key_t>::key_equal
+    > map_t;
 #else
-    typedef spp::sparse_hash_map<key_t, value_t> map_t;
+    typedef spp::sparse_hash_map<
+        key_t, value_t,
+        typename key_hash<key_t>::hasher,
+        typename key_hash<key_t>::key_equal
+    > map_t;
 #endif
 
     enum { key_rtype = traits::sexp_traits<key_t>::rtype };
@@ -67,9 +151,30 @@ public:
     typedef typename map_t::const_iterator const_iterator;
     typedef typename map_t::iterator iterator;
     typedef typename map_t::hasher hasher;
+    typedef typename map_t::key_equal key_equal;
+
+    typedef batch_hasher<key_t, hasher> batch_t;
+    typedef dense_table<key_t, value_t, hasher, key_equal> dense_t;
+    typedef frozen_table<key_t, value_t, hasher, key_equal> frozen_t;
+    typedef hamt_table<key_t, value_t, hasher, key_equal> hamt_t;
 
 private:
     map_t map;
+    dense_t dense;
+    frozen_t mphf;
+    hamt_t trie;
+
+    bool incremental_;
+    bool frozen_;
+    bool persistent_;
+
+    // bumped by every modification, so that cursors can detect that
+    // the table changed under them
+    std::size_t version_;
+
+    mutable sorted_index<key_t> sorted;
+
+    bloom_filter filter;
 
     key_t key_na() const
     { return traits::get_na<key_t>(); }
@@ -114,7 +219,23 @@ private:
     posix_t posix_keys;
     posix_t posix_values;
 
+    // level dictionaries of factor keys / values (integer codes)
+    factor_dict key_levels;
+    factor_dict value_levels;
+
+    // write-ahead journal of modifications (see journal.hpp), if any;
+    // copies of the table (clone(), snapshot(), keep_if()) are not
+    // journaled
+    boost::shared_ptr<journal> wal;
+
     HashTemplate(const map_t& xmap,
+                 const dense_t& xdense,
+                 const frozen_t& xfrozen,
+                 const hamt_t& xtrie,
+                 bool xincremental_,
+                 bool xfrozen_,
+                 bool xpersistent_,
+                 const bloom_filter& xfilter,
                  bool xkeys_cached_,
                  bool xvalues_cached_,
                  const key_vec& xkvec,
@@ -122,8 +243,18 @@ private:
                  bool xdate_keys,
                  bool xdate_values,
                  const posix_t& xposix_keys,
-                 const posix_t& xposix_values)
+                 const posix_t& xposix_values,
+                 const factor_dict& xkey_levels,
+                 const factor_dict& xvalue_levels)
         : map(xmap),
+          dense(xdense),
+          mphf(xfrozen),
+          trie(xtrie),
+          incremental_(xincremental_),
+          frozen_(xfrozen_),
+          persistent_(xpersistent_),
+          version_(0),
+          filter(xfilter),
           keys_cached_(xkeys_cached_),
           values_cached_(xvalues_cached_),
           kvec(Rcpp::clone(xkvec)),
@@ -131,192 +262,1540 @@ private:
           date_keys(xdate_keys),
           date_values(xdate_values),
           posix_keys(xposix_keys),
-          posix_values(xposix_values)
+          posix_values(xposix_values),
+          key_levels(xkey_levels),
+          value_levels(xvalue_levels)
     {}
 
-    void set_key_attr(key_vec& x) const
+    static bloom_filter::hash_t bloom_hash(const key_t& k)
+    { return static_cast<bloom_filter::hash_t>(hasher()(k)); }
+
+    // All reads and writes of the underlying storage go through
+    // the following helpers, which dispatch on frozen_, persistent_
+    // and incremental_, and consult the Bloom filter (if any) first.
+    // Public mutators call check_mutable() first.
+    const value_t* lookup(const key_t& k) const
     {
-        if (date_keys) {
-            x.attr("class") = "Date";
-        } else if (posix_keys.is) {
-            x.attr("class") =
-                Rcpp::CharacterVector::create("POSIXct", "POSIXt");
-            x.attr("tzone") = posix_keys.tz;
+        if (filter.active() && !filter.may_contain(bloom_hash(k))) return 0;
+        return probe(k);
+    }
+
+    // lookup() without the filter
+    const value_t* probe(const key_t& k) const
+    {
+        if (frozen_) return mphf.find(k);
+        if (persistent_) return trie.find(k);
+        if (incremental_) return dense.find(k);
+
+        const_iterator pos = map.find(k);
+        return pos != map.end() ? &pos->second : 0;
+    }
+
+    // probe() given h = hasher()(k); the default map hashes k itself
+    const value_t* probe(const key_t& k, std::size_t h) const
+    {
+        if (frozen_) return mphf.find(k, h);
+        if (persistent_) return trie.find(k, h);
+        if (incremental_) return dense.find(k, h);
+
+        const_iterator pos = map.find(k);
+        return pos != map.end() ? &pos->second : 0;
+    }
+
+    // Bulk lookups and inserts hash keys a block at a time when they
+    // have a vector kernel (batch_hash.hpp), and the hashes are of
+    // use: for the filter, or for the tables which take precomputed
+    // hashes
+    bool batch_hashing(const key_vec& x) const
+    {
+        return batch_t::vectorized && raw_keys(x) != 0 &&
+            (filter.active() || frozen_ || persistent_ || incremental_);
+    }
+
+    // pos[i] = lookup(x[i]), i < n <= hash_block_size
+    void lookup_block(const key_t* x, std::size_t n,
+                      const value_t** pos) const
+    {
+        std::size_t h[hash_block_size];
+        batch_t::run(x, n, h);
+
+        bool check = filter.active();
+        for (std::size_t i = 0; i < n; i++) {
+            bool pass = !check || filter.may_contain(
+                static_cast<bloom_filter::hash_t>(h[i])
+            );
+            pos[i] = pass ? probe(x[i], h[i]) : 0;
         }
     }
 
-    void set_value_attr(value_vec& x) const
+    // lookup() for in-place updates of existing entries; in
+    // persistent mode this copies the nodes shared with snapshots
+    value_t* lookup_mutable(const key_t& k)
     {
-        if (date_values) {
-            x.attr("class") = "Date";
-        } else if (posix_values.is) {
-            x.attr("class") =
-                Rcpp::CharacterVector::create("POSIXct", "POSIXt");
-            x.attr("tzone") = posix_values.tz;
+        if (persistent_) {
+            if (filter.active() && !filter.may_contain(bloom_hash(k))) {
+                return 0;
+            }
+            return trie.find_mutable(k);
         }
+        return const_cast<value_t*>(lookup(k));
     }
 
-    template <typename KT, typename VT>
-    Rcpp::DataFrame empty_join_result(const HashTemplate<KT, VT>& other) const
+    // returns true if k was not previously present
+    bool put(const key_t& k, const value_t& v)
+    { return put(k, v, 0); }
+
+    // put() given *h = hasher()(k), if h is not NULL
+    bool put(const key_t& k, const value_t& v, const std::size_t* h)
     {
-        return Rcpp::DataFrame::create(
-            Rcpp::Named("Keys") = key_vec(),
-            Rcpp::Named("Values.x") = value_vec(),
-            Rcpp::Named("Values.y") = typename HashTemplate<KT, VT>::value_vec(),
-            Rcpp::Named("stringsAsFactors") = false
-        );
+        bool added;
+        ++version_;
+        HASHMAP_PROFILE_REHASH_BEGIN(bucket_count());
+
+        if (persistent_) {
+            added = h ? trie.insert(k, v, *h) : trie.insert(k, v);
+        } else if (incremental_) {
+            added = h ? dense.insert(k, v, *h) : dense.insert(k, v);
+        } else {
+            size_type sz = map.size();
+            map[k] = v;
+            added = map.size() != sz;
+        }
+
+        HASHMAP_PROFILE_REHASH_END(bucket_count());
+
+        if (added && !traits::is_na_key(k)) sorted.add(k);
+
+        if (added && filter.active()) {
+            filter.add(
+                h ? static_cast<bloom_filter::hash_t>(*h) : bloom_hash(k)
+            );
+            if (filter.overloaded()) rebuild_filter();
+        }
+
+        if (wal) journal_put(*wal, k, v, value_levels);
+        return added;
     }
 
-    Rcpp::DataFrame empty_join_result(const HashMap& ptr) const
+    // put(x[i], y[i]), i < n, with the keys hashed a block at a time;
+    // only if batch_hashing(x)
+    void put_block(const key_vec& x, const value_vec& y, R_xlen_t n)
     {
-        return Rcpp::DataFrame::create(
-            Rcpp::Named("Keys") = key_vec(),
-            Rcpp::Named("Values.x") = value_vec(),
-            Rcpp::Named("Values.y") = ptr.value_vector(0),
-            Rcpp::Named("stringsAsFactors") = false
-        );
+        const key_t* px = raw_keys(x);
+        std::size_t h[hash_block_size];
+
+        for (R_xlen_t i = 0; i < n; i += hash_block_size) {
+            HASHMAP_CHECK_INTERRUPT(i / hash_block_size, 64);
+            R_xlen_t j = 0, m = n - i;
+            if (m > (R_xlen_t)hash_block_size) m = hash_block_size;
+
+            batch_t::run(px + i, m, h);
+            for (; j < m; j++) {
+                put(px[i + j], extractor(y, i + j), &h[j]);
+            }
+        }
     }
 
-public:
-    HashTemplate()
-        : keys_cached_(false),
-          values_cached_(false),
-          date_keys(false),
-          date_values(false),
-          posix_keys(posix_t()),
-          posix_values(posix_t())
+    // returns true if k was present
+    bool remove(const key_t& k)
     {
-        kvec = key_vec(0);
-        vvec = value_vec(0);
+        if (filter.active() && !filter.may_contain(bloom_hash(k))) {
+            return false;
+        }
+
+        bool removed;
+        if (persistent_) {
+            removed = trie.erase(k);
+        } else {
+            removed = incremental_ ? dense.erase(k) : map.erase(k) > 0;
+        }
+
+        if (removed) ++version_;
+        if (removed && !traits::is_na_key(k)) sorted.remove(k);
+        if (removed && filter.active()) filter.note_erase();
+        if (removed && wal) wal->erase(k);
+        return removed;
     }
 
-    HashTemplate(const key_vec& keys_, const value_vec& values_)
-        : keys_cached_(false),
-          values_cached_(false),
-          posix_keys(keys_),
-          posix_values(values_)
+    // Journal records of k => v, as a modification or as an entry of
+    // a checkpoint; encoded values are recorded as their level
+    // strings, i.e. as plain character values would be.
+    static void journal_put(journal& j, const key_t& k, const value_t& v,
+                            const factor_dict& levels)
     {
-        R_xlen_t nk = keys_.size(), nv = values_.size(), i = 0, n;
-        if (nk != nv) {
-            Rcpp::warning("length(keys) != length(values)!");
+        if (levels.encoded()) {
+            j.put(k, levels.level(v));
+        } else {
+            j.put(k, v);
         }
-        n = nk < nv ? nk : nv;
+    }
 
-        map.reserve((size_type)(n * 1.05));
-        kvec = key_vec(n);
-        vvec = value_vec(n);
+    static void journal_add(journal& j, const key_t& k, const value_t& v,
+                            const factor_dict& levels)
+    {
+        if (levels.encoded()) {
+            j.add(k, levels.level(v));
+        } else {
+            j.add(k, v);
+        }
+    }
 
-        for (; i < n; i++) {
+    // v = code x, for encoded values (whose value_t is int)
+    static void set_code(int& v, int x)
+    { v = x; }
+
+    template <typename T>
+    static void set_code(T&, int)
+    {}
+
+    template <typename F>
+    struct journaled_modifier {
+        F& f;
+        journal& wal;
+        const factor_dict& levels;
+
+        journaled_modifier(F& f_, journal& wal_, const factor_dict& levels_)
+            : f(f_), wal(wal_), levels(levels_)
+        {}
+
+        void operator()(const key_t& k, value_t& v)
+        {
+            f(k, v);
+            journal_put(wal, k, v, levels);
+        }
+    };
+
+    // calls f(key, value) for each entry of a mutable table, in
+    // storage order, with a modifiable value
+    template <typename F>
+    void modify(F& f)
+    {
+        if (wal) {
+            journaled_modifier<F> g(f, *wal, value_levels);
+            modify_entries(g);
+        } else {
+            modify_entries(f);
+        }
+    }
+
+    template <typename F>
+    void modify_entries(F& f)
+    {
+        if (persistent_) {
+            trie.modify(f);
+            return;
+        }
+
+        if (incremental_) {
+            size_type s = 0, ns = dense.slots();
+            for (; s < ns; s++) {
+                if (dense.live(s)) f(dense.key(s), dense.value(s));
+            }
+            return;
+        }
+
+        iterator first = map.begin(), last = map.end();
+        for (; first != last; ++first) {
+            f(first->first, first->second);
+        }
+    }
+
+    template <typename F>
+    struct matcher {
+        std::vector<key_t>& out;
+        const F& f;
+
+        matcher(std::vector<key_t>& out_, const F& f_)
+            : out(out_), f(f_)
+        {}
+
+        bool operator()(const key_t& k, const value_t& v)
+        {
+            if (f(k, v)) out.push_back(k);
+            return true;
+        }
+    };
+
+    template <typename F>
+    struct journaled_test {
+        const F& f;
+        journal& wal;
+
+        journaled_test(const F& f_, journal& wal_)
+            : f(f_), wal(wal_)
+        {}
+
+        bool operator()(const key_t& k, const value_t& v) const
+        {
+            if (!f(k, v)) return false;
+            wal.erase(k);
+            return true;
+        }
+    };
+
+    // erases the entries of a mutable table for which f(key, value)
+    // is true, in a single pass; returns the number erased
+    template <typename F>
+    R_xlen_t erase_where(const F& f)
+    {
+        if (!wal) return erase_entries(f);
+        return erase_entries(journaled_test<F>(f, *wal));
+    }
+
+    template <typename F>
+    R_xlen_t erase_entries(const F& f)
+    {
+        R_xlen_t i = 0, n = 0;
+
+        // before erasing anything, in case of a user interrupt
+        ++version_;
+        sorted.invalidate();
+        keys_cached_ = false;
+        values_cached_ = false;
+
+        if (persistent_) {
+            // the trie has no single-pass erase; collect the keys first
+            std::vector<key_t> ks;
+            matcher<F> m(ks, f);
+            visit(m);
+
+            for (; i < (R_xlen_t)ks.size(); i++) {
+                HASHMAP_CHECK_INTERRUPT(i, 50000);
+                trie.erase(ks[i]);
+            }
+            n = ks.size();
+        } else if (incremental_) {
+            n = dense.erase_if(f);
+        } else {
+            iterator first = map.begin();
+            for (; first != map.end(); ++i) {
+                HASHMAP_CHECK_INTERRUPT(i, 50000);
+                if (f(first->first, first->second)) {
+                    first = map.erase(first);
+                    ++n;
+                } else {
+                    ++first;
+                }
+            }
+        }
+
+        if (n && filter.active()) {
+            filter.note_erase(n);
+            if (filter.stale()) rebuild_filter();
+        }
+
+        return n;
+    }
+
+    // calls f(key, value) for each entry, in storage order, until
+    // f returns false
+    template <typename F>
+    void visit(F& f) const
+    {
+        if (frozen_) {
+            size_type s = 0, ns = mphf.size();
+            for (; s < ns; s++) {
+                if (!f(mphf.key(s), mphf.value(s))) return;
+            }
+            return;
+        }
+
+        if (persistent_) {
+            trie.visit(f);
+            return;
+        }
+
+        if (incremental_) {
+            size_type s = 0, ns = dense.slots();
+            for (; s < ns; s++) {
+                if (dense.live(s) && !f(dense.key(s), dense.value(s))) return;
+            }
+            return;
+        }
+
+        const_iterator first = map.begin(), last = map.end();
+        for (; first != last; ++first) {
+            if (!f(first->first, first->second)) return;
+        }
+    }
+
+    struct filler {
+        key_vec* kres;
+        value_vec* vres;
+        R_xlen_t i, n;
+
+        filler(key_vec* kres_, value_vec* vres_, R_xlen_t n_)
+            : kres(kres_), vres(vres_), i(0), n(n_)
+        {}
+
+        bool operator()(const key_t& k, const value_t& v)
+        {
+            if (i >= n) return false;
             HASHMAP_CHECK_INTERRUPT(i, 50000);
-            map[extractor(keys_, i)] = extractor(values_, i);
+            if (kres) (*kres)[i] = k;
+            if (vres) (*vres)[i] = v;
+            ++i;
+            return true;
         }
+    };
 
-        date_keys = Rf_inherits(keys_, "Date");
-        date_values = Rf_inherits(values_, "Date");
+    // copies the first n entries into kres and / or vres (either
+    // may be NULL) and returns the number of entries copied
+    R_xlen_t fill(key_vec* kres, value_vec* vres, R_xlen_t n) const
+    {
+        filler f(kres, vres, n);
+        visit(f);
+        return f.i;
     }
 
-    HashTemplate clone() const
+    struct key_collector {
+        std::vector<key_t>& out;
+
+        key_collector(std::vector<key_t>& out_)
+            : out(out_)
+        {}
+
+        bool operator()(const key_t& k, const value_t&)
+        {
+            if (!traits::is_na_key(k)) out.push_back(k);
+            return true;
+        }
+    };
+
+    void check_mutable() const
     {
-        return HashTemplate(
-            map, keys_cached_, values_cached_,
-            kvec, vvec, date_keys, date_values,
-            posix_keys, posix_values
-        );
+        if (frozen_) Rcpp::stop("Attempt to modify a frozen Hashmap");
     }
 
-    size_type size() const
-    { return map.size(); }
+    // applies the records of a journal while reopening it
+    struct journal_applier {
+        typedef KeyType key_t;
+        typedef ValueType value_t;
 
-    bool empty() const
-    { return map.empty(); }
+        HashTemplate& self;
+        R_xlen_t i;
 
-    bool keys_cached() const
-    { return keys_cached_; }
+        journal_applier(HashTemplate& self_)
+            : self(self_), i(0)
+        {}
 
-    bool values_cached() const
-    { return values_cached_; }
+        void put(const key_t& k, const value_t& v)
+        {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            ++i;
+            self.put(k, v);
+        }
+
+        void erase(const key_t& k)
+        { self.remove(k); }
+
+        void clear()
+        { self.clear(); }
+    };
+
+    // as journal_applier, for encoded values, which are journaled as
+    // their level strings; the new levels are installed once the
+    // journal has been replayed
+    struct encoded_applier : journal_applier {
+        typedef KeyType key_t;
+        typedef std::string value_t;
+
+        std::vector<std::string> added;
+
+        encoded_applier(HashTemplate& self_)
+            : journal_applier(self_)
+        {}
+
+        void put(const key_t& k, const std::string& v)
+        {
+            ValueType x = ValueType();
+            set_code(x, this->self.value_levels.code(v, added));
+            journal_applier::put(k, x);
+        }
+    };
+
+    struct checkpoint_writer {
+        journal& wal;
+        const factor_dict& levels;
+
+        checkpoint_writer(journal& wal_, const factor_dict& levels_)
+            : wal(wal_), levels(levels_)
+        {}
+
+        bool operator()(const key_t& k, const value_t& v)
+        {
+            journal_add(wal, k, v, levels);
+            return true;
+        }
+    };
+
+    static std::string tz_name(const posix_t& x)
+    {
+        if (!x.is || TYPEOF(x.tz) != STRSXP || !Rf_length(x.tz)) return "";
+        return CHAR(STRING_ELT(x.tz, 0));
+    }
+
+    journal_schema make_schema() const
+    {
+        journal_schema res;
+        res.key_type = key_rtype;
+        res.value_type = value_levels.encoded() ? (int)STRSXP : value_rtype;
+        res.flags = (incremental_ ? journal_schema::ordered : 0) |
+            (persistent_ ? journal_schema::persistent : 0) |
+            (frozen_ ? journal_schema::frozen : 0) |
+            (value_levels.encoded() ? journal_schema::encoded : 0);
+
+        res.key_class = date_keys ? "Date" : (posix_keys.is ? "POSIXct" : "");
+        res.key_tz = tz_name(posix_keys);
+        res.value_class = date_values ?
+            "Date" : (posix_values.is ? "POSIXct" : "");
+        res.value_tz = tz_name(posix_values);
+
+        return res;
+    }
+
+    void write_checkpoint(journal& j) const
+    {
+        j.begin_checkpoint(make_schema());
+        try {
+            checkpoint_writer f(j, value_levels);
+            visit(f);
+            j.end_checkpoint();
+        } catch (...) {
+            j.abort_checkpoint();
+            throw;
+        }
+    }
+
+    // Called by each public mutator once it is done, so that the
+    // journal records its modifications as a unit; the log is folded
+    // into a new checkpoint once it outgrows the last one.
+    void journal_commit()
+    {
+        if (!wal) return;
+        wal->commit();
+        if (wal->checkpoint_due()) write_checkpoint(*wal);
+    }
+
+    // factor codes of another table, through a factor_dict::merge table
+    static int translate(int x, const std::vector<int>& tr)
+    { return factor_dict::translate(x, tr); }
+
+    template <typename T>
+    static const T& translate(const T& x, const std::vector<int>&)
+    { return x; }
+
+    typedef traits::value_combine<value_t> combine_t;
+
+    // counts the keys of another table whose values differ from ours
+    struct conflict_counter {
+        const HashTemplate& self;
+        const std::vector<int>& ktr;
+        const std::vector<int>& vtr;
+        R_xlen_t i;
+        double n;
+
+        conflict_counter(const HashTemplate& self_,
+                         const std::vector<int>& ktr_,
+                         const std::vector<int>& vtr_)
+            : self(self_), ktr(ktr_), vtr(vtr_), i(0), n(0)
+        {}
+
+        bool operator()(const key_t& k, const value_t& v)
+        {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            ++i;
+            const value_t* pos = self.lookup(translate(k, ktr));
+            if (pos && !traits::values_equal(*pos, translate(v, vtr))) ++n;
+            return true;
+        }
+    };
+
+    // v op operand, for the values v of erase_if / keep_if; NA values
+    // (and an NA operand) never match
+    struct value_test {
+        value_cmp op;
+        value_t operand;
+        const factor_dict* levels;
+        bool na;
+
+        value_test(value_cmp op_, const value_t& operand_,
+                   const factor_dict& levels_)
+            : op(op_), operand(operand_), levels(&levels_),
+              na(is_na(operand_, levels_))
+        {}
+
+        bool operator()(const key_t&, const value_t& v) const
+        {
+            if (na || is_na(v, *levels)) return false;
+
+            switch (op) {
+                case cmp_eq: return traits::values_equal(v, operand);
+                case cmp_ne: return !traits::values_equal(v, operand);
+                case cmp_lt: return combine_t::less(v, operand);
+                case cmp_le: return !combine_t::less(operand, v);
+                case cmp_gt: return combine_t::less(operand, v);
+                case cmp_ge: return !combine_t::less(v, operand);
+                default: return false;
+            }
+        }
+    };
+
+    struct na_test {
+        const factor_dict& levels;
+
+        explicit na_test(const factor_dict& levels_)
+            : levels(levels_)
+        {}
+
+        bool operator()(const key_t&, const value_t& v) const
+        { return is_na(v, levels); }
+    };
+
+    // whether value v is NA, which encoded values store as "NA"
+    static bool is_na(const value_t& v, const factor_dict& levels)
+    { return traits::is_na_value(v) || levels.is_na_code(v); }
+
+    // operand is read as a value, translating factor levels
+    value_test make_test(value_cmp op, SEXP operand) const
+    {
+        bool ordered = op != cmp_eq && op != cmp_ne;
+        if (ordered && (!combine_t::arithmetic || value_levels.active())) {
+            Rcpp::stop(
+                "Comparisons '<', '<=', '>' and '>=' require integer or "
+                "numeric values, not %s",
+                value_class_name().c_str()
+            );
+        }
+
+        return value_test(
+            op,
+            scalar_extractor<value_t>(value_levels.recode(operand), "operand"),
+            value_levels
+        );
+    }
+
+    // copies the entries which pass test into res
+    struct selector {
+        HashTemplate& res;
+        const value_test& test;
+        R_xlen_t i;
+
+        selector(HashTemplate& res_, const value_test& test_)
+            : res(res_), test(test_), i(0)
+        {}
+
+        bool operator()(const key_t& k, const value_t& v)
+        {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            ++i;
+            if (test(k, v)) res.put(k, v);
+            return true;
+        }
+    };
+
+    struct transformer {
+        value_arith op;
+        value_t operand;
+        R_xlen_t i;
+        bool overflow;
+
+        transformer(value_arith op_, const value_t& operand_)
+            : op(op_), operand(operand_), i(0), overflow(false)
+        {}
+
+        void operator()(const key_t&, value_t& v)
+        {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            ++i;
+
+            switch (op) {
+                case arith_add: {
+                    v = combine_t::sum(v, operand, overflow);
+                    break;
+                }
+                case arith_sub: {
+                    v = combine_t::diff(v, operand, overflow);
+                    break;
+                }
+                case arith_mul: {
+                    v = combine_t::prod(v, operand, overflow);
+                    break;
+                }
+                case arith_div: {
+                    v = combine_t::quot(v, operand);
+                    break;
+                }
+                case arith_pow: {
+                    v = combine_t::power(v, operand);
+                    break;
+                }
+                default: break;
+            }
+        }
+    };
+
+    // whether an integer operand y lost a fraction of x in coercion
+    static bool truncated(double x, int y)
+    { return !ISNAN(x) && x != (double)y; }
+
+    template <typename T>
+    static bool truncated(double, const T&)
+    { return false; }
+
+    // merges the entries of another table according to policy
+    struct merger {
+        HashTemplate& self;
+        merge_policy policy;
+        const std::vector<int>& ktr;
+        const std::vector<int>& vtr;
+        R_xlen_t i;
+        bool overflow;
+
+        merger(HashTemplate& self_, merge_policy policy_,
+               const std::vector<int>& ktr_,
+               const std::vector<int>& vtr_)
+            : self(self_), policy(policy_), ktr(ktr_), vtr(vtr_),
+              i(0), overflow(false)
+        {}
+
+        bool operator()(const key_t& xk, const value_t& xv)
+        {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            ++i;
+
+            key_t k = translate(xk, ktr);
+            value_t v = translate(xv, vtr);
+
+            if (policy == merge_overwrite || policy == merge_error) {
+                self.put(k, v);
+                return true;
+            }
+
+            value_t* pos = self.lookup_mutable(k);
+            if (!pos) {
+                self.put(k, v);
+                return true;
+            }
+
+            switch (policy) {
+                case merge_sum: {
+                    *pos = combine_t::sum(*pos, v, overflow);
+                    break;
+                }
+                case merge_min: {
+                    *pos = combine_t::min(*pos, v);
+                    break;
+                }
+                case merge_max: {
+                    *pos = combine_t::max(*pos, v);
+                    break;
+                }
+                default: return true;
+            }
+
+            if (self.wal) journal_put(*self.wal, k, *pos, self.value_levels);
+            return true;
+        }
+    };
+
+    struct column_collector {
+        boost::container::vector<key_t>& kout;
+        boost::container::vector<value_t>& vout;
+
+        column_collector(boost::container::vector<key_t>& kout_,
+                         boost::container::vector<value_t>& vout_)
+            : kout(kout_), vout(vout_)
+        {}
+
+        bool operator()(const key_t& k, const value_t& v)
+        {
+            kout.push_back(k);
+            vout.push_back(v);
+            return true;
+        }
+    };
+
+    struct trie_builder {
+        hamt_t& out;
+
+        trie_builder(hamt_t& out_)
+            : out(out_)
+        {}
+
+        bool operator()(const key_t& k, const value_t& v)
+        {
+            HASHMAP_CHECK_INTERRUPT(out.size(), 50000);
+            out.insert(k, v);
+            return true;
+        }
+    };
+
+    struct filter_builder {
+        bloom_filter& out;
+
+        filter_builder(bloom_filter& out_)
+            : out(out_)
+        {}
+
+        bool operator()(const key_t& k, const value_t&)
+        {
+            out.add(bloom_hash(k));
+            return true;
+        }
+    };
+
+    void rebuild_filter(double bits_per_key = 0)
+    {
+        if (bits_per_key <= 0) bits_per_key = filter.bits_per_key();
+        filter.reset(size(), bits_per_key);
+
+        filter_builder f(filter);
+        visit(f);
+    }
+
+    // rough heap usage of the table itself, excluding string payloads
+    size_type table_memory() const
+    {
+        if (frozen_) return mphf.memory_usage();
+        if (persistent_) return trie.memory_usage();
+        if (incremental_) return dense.memory_usage();
+
+        typedef typename map_t::value_type entry_t;
+
+#if defined(HASHMAP_NO_SPP) || (defined(__sun) && defined(__SVR4))  // solaris
+        return map.size() * (sizeof(entry_t) + 2 * sizeof(void*)) +
+            map.bucket_count() * sizeof(void*);
+#else
+        // sparsepp: dense groups of entries, ~4 bits of overhead per bucket
+        return map.size() * sizeof(entry_t) + map.bucket_count() / 2;
+#endif
+    }
+
+    void ensure_sorted() const
+    {
+        if ((int)key_rtype == STRSXP) {
+            Rcpp::stop("Ordered queries require integer or numeric keys");
+        }
+
+        if (!sorted.active()) {
+            std::vector<key_t> tmp;
+            tmp.reserve(size());
+            key_collector f(tmp);
+            visit(f);
+            sorted.build(tmp.begin(), tmp.end());
+        }
+
+        sorted.flush();
+    }
+
+    void set_key_attr(key_vec& x) const
+    {
+        if (date_keys) {
+            x.attr("class") = "Date";
+        } else if (posix_keys.is) {
+            x.attr("class") =
+                Rcpp::CharacterVector::create("POSIXct", "POSIXt");
+            x.attr("tzone") = posix_keys.tz;
+        }
+        key_levels.set_attr(x);
+    }
+
+    // x as a key vector, translated to codes if the keys are factors
+    key_vec key_input(SEXP x) const
+    { return Rcpp::as<key_vec>(key_levels.recode(x)); }
+
+    void set_value_attr(value_vec& x) const
+    {
+        if (date_values) {
+            x.attr("class") = "Date";
+        } else if (posix_values.is) {
+            x.attr("class") =
+                Rcpp::CharacterVector::create("POSIXct", "POSIXt");
+            x.attr("tzone") = posix_values.tz;
+        }
+        value_levels.set_attr(x);
+    }
+
+    template <typename KT, typename VT>
+    Rcpp::DataFrame empty_join_result(const HashTemplate<KT, VT>& other) const
+    {
+        return Rcpp::DataFrame::create(
+            Rcpp::Named("Keys") = key_vec(),
+            Rcpp::Named("Values.x") = value_vector(0),
+            Rcpp::Named("Values.y") = other.value_vector(0),
+            Rcpp::Named("stringsAsFactors") = false
+        );
+    }
+
+    Rcpp::DataFrame empty_join_result(const HashMap& ptr) const
+    {
+        return Rcpp::DataFrame::create(
+            Rcpp::Named("Keys") = key_vec(),
+            Rcpp::Named("Values.x") = value_vector(0),
+            Rcpp::Named("Values.y") = ptr.value_vector(0),
+            Rcpp::Named("stringsAsFactors") = false
+        );
+    }
+
+public:
+    HashTemplate()
+        : incremental_(false),
+          frozen_(false),
+          persistent_(false),
+          version_(0),
+          keys_cached_(false),
+          values_cached_(false),
+          date_keys(false),
+          date_values(false),
+          posix_keys(posix_t()),
+          posix_values(posix_t())
+    {
+        kvec = key_vec(0);
+        vvec = value_vec(0);
+    }
+
+    HashTemplate(const key_vec& keys_, const value_vec& values_,
+                 bool ordered = false)
+        : incremental_(ordered),
+          frozen_(false),
+          persistent_(false),
+          version_(0),
+          keys_cached_(false),
+          values_cached_(false),
+          posix_keys(keys_),
+          posix_values(values_),
+          key_levels(keys_),
+          value_levels(values_)
+    {
+        R_xlen_t nk = keys_.size(), nv = values_.size(), i = 0, n;
+        if (nk != nv) {
+            Rcpp::warning("length(keys) != length(values)!");
+        }
+        n = nk < nv ? nk : nv;
+
+        reserve((size_type)(n * 1.05));
+        kvec = key_vec(n);
+        vvec = value_vec(n);
+
+        if (batch_hashing(keys_)) {
+            put_block(keys_, values_, n);
+        } else {
+            for (; i < n; i++) {
+                HASHMAP_CHECK_INTERRUPT(i, 50000);
+                put(extractor(keys_, i), extractor(values_, i));
+            }
+        }
+
+        date_keys = Rf_inherits(keys_, "Date");
+        date_values = Rf_inherits(values_, "Date");
+    }
+
+    HashTemplate clone() const
+    {
+        HASHMAP_PROFILE_OP(op_clone, size());
+        return HashTemplate(
+            map, dense, mphf, trie, incremental_, frozen_, persistent_,
+            filter,
+            keys_cached_, values_cached_,
+            kvec, vvec, date_keys, date_values,
+            posix_keys, posix_values, key_levels, value_levels
+        );
+    }
+
+    size_type size() const
+    {
+        if (frozen_) return mphf.size();
+        if (persistent_) return trie.size();
+        return incremental_ ? dense.size() : map.size();
+    }
+
+    bool empty() const
+    { return size() == 0; }
+
+    bool incremental() const
+    { return incremental_; }
+
+    void set_incremental(bool flag)
+    {
+        check_mutable();
+        if (flag == incremental_) return;
+        if (persistent_) set_persistent(false);
+
+        if (flag) {
+            dense.reserve(map.size());
+            const_iterator first = map.begin(), last = map.end();
+            for (R_xlen_t i = 0; first != last; ++first, ++i) {
+                HASHMAP_CHECK_INTERRUPT(i, 50000);
+                dense.insert(first->first, first->second);
+            }
+            map_t().swap(map);
+        } else {
+            map.reserve(dense.size());
+            size_type s = 0, ns = dense.slots();
+            for (; s < ns; s++) {
+                HASHMAP_CHECK_INTERRUPT(s, 50000);
+                if (dense.live(s)) map[dense.key(s)] = dense.value(s);
+            }
+            dense_t().swap(dense);
+        }
+
+        incremental_ = flag;
+        ++version_;
+        keys_cached_ = false;
+        values_cached_ = false;
+
+        // the checkpoint records the storage mode
+        if (wal) write_checkpoint(*wal);
+    }
+
+    bool frozen() const
+    { return frozen_; }
+
+    // Rebuilds the table as a minimal perfect hash over its current
+    // keys (see frozen_table.hpp) and releases the mutable storage.
+    // The entries are reordered, and insertion order is not kept.
+    void freeze()
+    {
+        if (frozen_) return;
+
+        boost::container::vector<key_t> ks;
+        boost::container::vector<value_t> vs;
+        ks.reserve(size());
+        vs.reserve(size());
+
+        column_collector f(ks, vs);
+        visit(f);
+
+        mphf.build(ks, vs);
+
+        map_t().swap(map);
+        dense_t().swap(dense);
+        trie.clear();
+
+        frozen_ = true;
+        incremental_ = false;
+        persistent_ = false;
+        ++version_;
+        keys_cached_ = false;
+        values_cached_ = false;
+
+        // the checkpoint records that the table is frozen
+        if (wal) write_checkpoint(*wal);
+    }
+
+    bool persistent() const
+    { return persistent_; }
+
+    // Moves the entries into (or out of) a hash array mapped trie
+    // (see hamt_table.hpp), whose nodes can be shared with snapshots.
+    // Entering persistent mode leaves incremental mode, and leaving
+    // it returns to the default (unordered) storage.
+    void set_persistent(bool flag)
+    {
+        check_mutable();
+        if (flag == persistent_) return;
+
+        if (flag) {
+            hamt_t tmp;
+            trie_builder f(tmp);
+            visit(f);
+
+            trie.swap(tmp);
+            map_t().swap(map);
+            dense_t().swap(dense);
+            incremental_ = false;
+        } else {
+            map.reserve(trie.size());
+            typename hamt_t::const_iterator first = trie.begin();
+            for (R_xlen_t i = 0; !first.done(); ++first, ++i) {
+                HASHMAP_CHECK_INTERRUPT(i, 50000);
+                map[first->first] = first->second;
+            }
+            trie.clear();
+        }
+
+        persistent_ = flag;
+        ++version_;
+        keys_cached_ = false;
+        values_cached_ = false;
+
+        if (wal) write_checkpoint(*wal);
+    }
+
+    // A copy of the table that shares the trie with *this, switching
+    // it to persistent mode first if need be; taking it is then O(1),
+    // and each later modification of either table copies only the
+    // trie nodes on the path to the key. The snapshot is itself a
+    // mutable table in persistent mode, without a Bloom filter. A
+    // frozen table is cloned instead. An ordered table is refused,
+    // since persistent mode would not keep its insertion order.
+    HashTemplate snapshot()
+    {
+        if (frozen_) return clone();
+        if (incremental_) {
+            Rcpp::stop(
+                "Cannot take a snapshot of an ordered Hashmap, as it "
+                "would lose its insertion order; use clone() instead, "
+                "or call set_persistent(TRUE) first"
+            );
+        }
+        set_persistent(true);
+
+        return HashTemplate(
+            map_t(), dense_t(), frozen_t(), trie, false, false, true,
+            bloom_filter(), false, false, key_vec(0), value_vec(0),
+            date_keys, date_values, posix_keys, posix_values,
+            key_levels, value_levels
+        );
+    }
+
+    bool bloom() const
+    { return filter.active(); }
+
+    // Enables (rebuilding from the current keys) or disables the
+    // blocked Bloom filter consulted before each lookup / erase.
+    void set_bloom(bool flag, double bits_per_key)
+    {
+        if (!flag) {
+            filter.release();
+            return;
+        }
+
+        if (!(bits_per_key >= 1 && bits_per_key <= 64)) {
+            Rcpp::stop("'bits_per_key' must be between 1 and 64");
+        }
+        rebuild_filter(bits_per_key);
+    }
+
+    Rcpp::Vector<REALSXP> memory_stats() const
+    {
+        Rcpp::Vector<REALSXP> res = Rcpp::Vector<REALSXP>::create(
+            Rcpp::Named("size") = (double)size(),
+            Rcpp::Named("table_bytes") = (double)table_memory(),
+            Rcpp::Named("bloom_bytes") = (double)filter.memory_usage(),
+            Rcpp::Named("bloom_bits_per_key") = filter.bits_per_key()
+        );
+
+        return res;
+    }
+
+    // Journals the modifications of the table to path + ".log",
+    // starting from a checkpoint of its current contents at path
+    // (replacing any existing one); see journal.hpp. With sync, each
+    // modifying method returns only once its records are on disk.
+    void set_journal(const std::string& path, bool sync)
+    {
+        check_mutable();
+        if (key_levels.active() ||
+            (value_levels.active() && !value_levels.encoded())) {
+            Rcpp::stop("Factor keys and values cannot be journaled");
+        }
+
+        close_journal();
+        boost::shared_ptr<journal> tmp(
+            new journal(path, make_schema(), sync)
+        );
+        write_checkpoint(*tmp);
+        wal = tmp;
+    }
+
+    // Restores an empty table (with the key and value types of the
+    // journal) from the checkpoint at path and the log that follows
+    // it, and continues journaling to them. A torn log tail, left by
+    // a crash while writing it, is dropped by writing a new
+    // checkpoint.
+    void open_journal(const std::string& path, bool sync)
+    {
+        close_journal();
+        boost::shared_ptr<journal> tmp(
+            new journal(path, make_schema(), sync)
+        );
+
+        bool clean;
+        if (value_levels.encoded()) {
+            encoded_applier f(*this);
+            clean = replay_journal(*tmp, f);
+            value_levels.append(f.added);
+        } else {
+            journal_applier f(*this);
+            clean = replay_journal(*tmp, f);
+        }
+
+        // (a table is checkpointed as it is frozen, and not modified
+        // after that)
+        if (tmp->schema().flags & journal_schema::frozen) freeze();
+
+        if (clean) {
+            tmp->open_log();
+        } else {
+            write_checkpoint(*tmp);
+        }
+
+        keys_cached_ = false;
+        values_cached_ = false;
+        wal = tmp;
+    }
+
+    // replays the checkpoint and then the log of j into the table;
+    // returns false if the log is missing or has a torn tail
+    template <typename F>
+    bool replay_journal(journal& j, F& f)
+    {
+        if (!j.replay(j.path(), journal::kind_checkpoint, f)) {
+            Rcpp::stop("Journal checkpoint '%s' is corrupt", j.path().c_str());
+        }
+        return j.replay(j.log_path(), journal::kind_log, f);
+    }
+
+    // writes a checkpoint now, and starts a new log
+    void checkpoint()
+    {
+        if (!wal) Rcpp::stop("Hashmap is not journaled");
+        write_checkpoint(*wal);
+    }
+
+    // flushes the log and stops journaling; the files are kept
+    void close_journal()
+    {
+        if (!wal) return;
+        boost::shared_ptr<journal> tmp;
+        tmp.swap(wal);
+        tmp->commit();
+    }
+
+    std::string journal_path() const
+    { return wal ? wal->path() : std::string(); }
+
+    bool journal_sync() const
+    { return wal && wal->sync(); }
+
+    bool keys_cached() const
+    { return keys_cached_; }
+
+    bool values_cached() const
+    { return values_cached_; }
+
+    int key_sexptype() const
+    { return key_rtype; }
+
+    int value_sexptype() const
+    { return value_rtype; }
+
+    key_vec key_vector(int n) const
+    { return key_vec(n); }
+
+    value_vec value_vector(int n) const
+    {
+        value_vec res(n);
+        set_value_attr(res);
+
+        return res;
+    }
+
+    // true iff the values are character strings stored as codes into
+    // an encoded dictionary (see factor_dict::encode)
+    bool encoded() const
+    { return value_levels.encoded(); }
+
+    void clear()
+    {
+        check_mutable();
+        map.clear();
+        dense.clear();
+        trie.clear();
+        ++version_;
+        sorted.invalidate();
+        if (filter.active()) filter.reset(0, filter.bits_per_key());
+        keys_cached_ = false;
+        values_cached_ = false;
+
+        if (wal) wal->clear();
+        journal_commit();
+    }
+
+    size_type bucket_count() const
+    {
+        if (frozen_) return mphf.bucket_count();
+        if (persistent_) return 0;
+        return incremental_ ? dense.bucket_count() : map.bucket_count();
+    }
+
+    void rehash(size_type n)
+    {
+        check_mutable();
+        if (persistent_) return;  // a trie has no buckets
+
+        ++version_;
+        HASHMAP_PROFILE_REHASH_BEGIN(bucket_count());
+        if (incremental_) {
+            dense.rehash(n);
+        } else {
+            map.rehash(n);
+        }
+        HASHMAP_PROFILE_REHASH_END(bucket_count());
+    }
+
+    void reserve(size_type n)
+    {
+        check_mutable();
+        if (persistent_) return;  // a trie has no buckets
+
+        ++version_;
+        HASHMAP_PROFILE_REHASH_BEGIN(bucket_count());
+        if (incremental_) {
+            dense.reserve(n);
+        } else {
+            map.reserve(n);
+        }
+        HASHMAP_PROFILE_REHASH_END(bucket_count());
+    }
+
+    Rcpp::Vector<INTSXP> hash_value(const key_vec& keys_) const
+    {
+        Rcpp::Vector<INTSXP> res = Rcpp::no_init_vector(keys_.size());
+        hash_values<hasher>(keys_, res.begin());
+        return res;
+    }
+
+    // keys_ and values_ hold the codes of factor keys and values (see
+    // the SEXP overload below)
+    void insert(const key_vec& keys_, const value_vec& values_)
+    {
+        HASHMAP_PROFILE_OP(op_insert, keys_.size());
+        check_mutable();
+        R_xlen_t nk = keys_.size(), nv = values_.size(), i = 0, n;
+        if (nk != nv) {
+            Rcpp::warning("length(keys) != length(values)!");
+        }
+        n = nk < nv ? nk : nv;
+        keys_cached_ = false;
+        values_cached_ = false;
+        HASHMAP_PROFILE_PHASE(phase_convert);
+
+        if (batch_hashing(keys_)) {
+            put_block(keys_, values_, n);
+            HASHMAP_PROFILE_PHASE(phase_probe);
+            journal_commit();
+            return;
+        }
+
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            key_t k = extractor(keys_, i);
+            value_t v = extractor(values_, i);
+            HASHMAP_PROFILE_PHASE(phase_convert);
+            HASHMAP_PROFILE_HASH(hasher(), k);
+            put(k, v);
+            HASHMAP_PROFILE_PHASE(phase_probe);
+        }
+
+        journal_commit();
+    }
+
+    void insert(SEXP keys_, SEXP values_)
+    {
+        HASHMAP_PROFILE_OP(op_insert, Rf_xlength(keys_));
+        check_mutable();
+        insert(
+            Rcpp::as<key_vec>(key_levels.recode_extend(keys_)),
+            Rcpp::as<value_vec>(value_levels.recode_extend(values_))
+        );
+    }
+
+    // inserts the pairs (*kfirst, *vfirst), ... up to klast
+    template <typename KeyIt, typename ValueIt>
+    void insert_range(KeyIt kfirst, KeyIt klast, ValueIt vfirst)
+    {
+        check_mutable();
+        keys_cached_ = false;
+        values_cached_ = false;
+
+        for (R_xlen_t i = 0; kfirst != klast; ++kfirst, ++vfirst, ++i) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            put(*kfirst, *vfirst);
+        }
+
+        journal_commit();
+    }
+
+    // Merges the entries of other (a table of the same type, which may
+    // be frozen or incremental) into *this, without going through R
+    // vectors. Keys present in both are resolved by policy: take the
+    // value of other (merge_overwrite), keep ours (merge_keep),
+    // combine the two (merge_sum / min / max; integer and numeric
+    // values only), or fail before modifying anything if any of the
+    // values differ (merge_error). Factor codes of other are
+    // translated, extending our levels as needed.
+    void update(const HashTemplate& other, merge_policy policy)
+    {
+        HASHMAP_PROFILE_OP(op_insert, other.size());
+        check_mutable();
+
+        if (&other == this) {
+            HashTemplate tmp(other.clone());
+            update(tmp, policy);
+            return;
+        }
+
+        std::string lhs_kcn = key_class_name(),
+            rhs_kcn = other.key_class_name();
+        if (lhs_kcn != rhs_kcn) {
+            Rcpp::stop(
+                "Attempt to update with different key types: %s and %s",
+                lhs_kcn.c_str(),
+                rhs_kcn.c_str()
+            );
+        }
+
+        std::string lhs_vcn = value_class_name(),
+            rhs_vcn = other.value_class_name();
+        if (lhs_vcn != rhs_vcn) {
+            Rcpp::stop(
+                "Attempt to update with different value types: %s and %s",
+                lhs_vcn.c_str(),
+                rhs_vcn.c_str()
+            );
+        }
+
+        bool arithmetic = policy == merge_sum || policy == merge_min ||
+            policy == merge_max;
+        if (arithmetic && (!combine_t::arithmetic || value_levels.active())) {
+            Rcpp::stop(
+                "Policies 'sum', 'min' and 'max' require integer or "
+                "numeric values, not %s",
+                lhs_vcn.c_str()
+            );
+        }
 
-    int key_sexptype() const
-    { return key_rtype; }
+        if (other.empty()) return;
 
-    int value_sexptype() const
-    { return value_rtype; }
+        std::vector<int> ktr = key_levels.merge(other.key_levels);
+        std::vector<int> vtr = value_levels.merge(other.value_levels);
 
-    key_vec key_vector(int n) const
-    { return key_vec(n); }
+        if (policy == merge_error && !empty()) {
+            conflict_counter f(*this, ktr, vtr);
+            other.visit(f);
+            if (f.n) {
+                Rcpp::stop(
+                    "%.0f keys have different values in the two Hashmaps",
+                    f.n
+                );
+            }
+        }
+        HASHMAP_PROFILE_PHASE(phase_probe);
 
-    value_vec value_vector(int n) const
-    { return value_vec(n); }
+        reserve(size() + other.size());
+        HASHMAP_PROFILE_PHASE(phase_alloc);
 
-    void clear()
-    {
-        map.clear();
+        ++version_;
         keys_cached_ = false;
         values_cached_ = false;
-    }
 
-    size_type bucket_count() const
-    { return map.bucket_count(); }
+        merger f(*this, policy, ktr, vtr);
+        other.visit(f);
+        HASHMAP_PROFILE_PHASE(phase_probe);
+        journal_commit();
 
-    void rehash(size_type n)
-    { map.rehash(n); }
+        if (f.overflow) {
+            Rcpp::warning("NAs produced by integer overflow");
+        }
+    }
 
-    void reserve(size_type n)
-    { map.reserve(n); }
+    // erases the entries whose values satisfy v op operand
+    R_xlen_t erase_if(value_cmp op, SEXP operand)
+    {
+        HASHMAP_PROFILE_OP(op_erase, size());
+        check_mutable();
+        R_xlen_t n = erase_where(make_test(op, operand));
+        journal_commit();
+        return n;
+    }
 
-    Rcpp::Vector<INTSXP> hash_value(const key_vec& keys_) const
+    // erases the entries with NA values
+    R_xlen_t na_omit()
     {
-        R_xlen_t i = 0, nk = keys_.size();
-        Rcpp::Vector<INTSXP> res = Rcpp::no_init_vector(nk);
-        hasher h;
+        HASHMAP_PROFILE_OP(op_erase, size());
+        check_mutable();
+        R_xlen_t n = erase_where(na_test(value_levels));
+        journal_commit();
+        return n;
+    }
 
-        for (; i < nk; i++) {
-            HASHMAP_CHECK_INTERRUPT(i, 50000);
-            res[i] = h(extractor(keys_, i));
-        }
+    // A new (mutable) table with the entries whose values satisfy
+    // v op operand, in storage order; it keeps the mode, attributes
+    // and Bloom filter setting of *this.
+    HashTemplate keep_if(value_cmp op, SEXP operand) const
+    {
+        value_test test = make_test(op, operand);
+
+        HashTemplate res(
+            map_t(), dense_t(), frozen_t(), hamt_t(), incremental_, false,
+            persistent_,
+            bloom_filter(), false, false, key_vec(0), value_vec(0),
+            date_keys, date_values, posix_keys, posix_values,
+            key_levels, value_levels
+        );
 
+        selector f(res, test);
+        visit(f);
+
+        if (filter.active()) res.rebuild_filter(filter.bits_per_key());
         return res;
     }
 
-    void insert(const key_vec& keys_, const value_vec& values_)
+    // v = v op operand for every value, in place; integer values
+    // support +, - and * with a whole operand, numeric values also
+    // / and ^
+    void transform(value_arith op, SEXP operand)
     {
-        R_xlen_t nk = keys_.size(), nv = values_.size(), i = 0, n;
-        if (nk != nv) {
-            Rcpp::warning("length(keys) != length(values)!");
+        check_mutable();
+
+        if (!combine_t::arithmetic || value_levels.active()) {
+            Rcpp::stop(
+                "transform() requires integer or numeric values, not %s",
+                value_class_name().c_str()
+            );
         }
-        n = nk < nv ? nk : nv;
-        keys_cached_ = false;
-        values_cached_ = false;
 
-        for (; i < n; i++) {
-            HASHMAP_CHECK_INTERRUPT(i, 50000);
-            map[extractor(keys_, i)] = extractor(values_, i);
+        if ((op == arith_div || op == arith_pow) && !combine_t::fractional) {
+            Rcpp::stop(
+                "Operators '/' and '^' require numeric values, not %s",
+                value_class_name().c_str()
+            );
         }
-    }
 
-    void insert(SEXP keys_, SEXP values_)
-    {
-        insert(
-            Rcpp::as<key_vec>(keys_),
-            Rcpp::as<value_vec>(values_)
-        );
+        value_t y = scalar_extractor<value_t>(operand, "operand");
+        if (TYPEOF(operand) == REALSXP &&
+            truncated(Rf_asReal(operand), y)) {
+            Rcpp::stop("'operand' must be a whole number for integer values");
+        }
+
+        ++version_;
+        values_cached_ = false;
+
+        transformer f(op, y);
+        modify(f);
+        journal_commit();
+
+        if (f.overflow) {
+            Rcpp::warning("NAs produced by integer overflow");
+        }
     }
 
     key_vec keys() const
     {
+        HASHMAP_PROFILE_OP(op_keys, size());
         if (keys_cached_) {
             return kvec;
         }
 
-        const_iterator first = map.begin(), last = map.end();
-        key_vec res(map.size());
-
-        for (R_xlen_t i = 0; first != last; ++first) {
-            HASHMAP_CHECK_INTERRUPT(i, 50000);
-            res[i++] = first->first;
-        }
+        key_vec res(size());
+        HASHMAP_PROFILE_PHASE(phase_alloc);
+        fill(&res, 0, res.size());
 
         set_key_attr(res);
+        HASHMAP_PROFILE_PHASE(phase_build);
 
         kvec = res;
         keys_cached_ = true;
@@ -327,7 +1806,7 @@ public:
     key_vec keys_n(int nx) const
     {
         if (nx < 0) nx = 0;
-        if ((size_type)nx > map.size()) nx = map.size();
+        if ((size_type)nx > size()) nx = size();
 
         if (keys_cached_) {
             key_vec res = kvec[Rcpp::seq(0, nx - 1)];
@@ -335,13 +1814,8 @@ public:
             return res;
         }
 
-        const_iterator first = map.begin(), last = map.end();
         key_vec res(nx);
-
-        for (R_xlen_t i = 0; first != last && i < nx; ++first) {
-            HASHMAP_CHECK_INTERRUPT(i, 50000);
-            res[i++] = first->first;
-        }
+        fill(&res, 0, nx);
 
         set_key_attr(res);
 
@@ -350,19 +1824,17 @@ public:
 
     value_vec values() const
     {
+        HASHMAP_PROFILE_OP(op_values, size());
         if (values_cached_) {
             return vvec;
         }
 
-        const_iterator first = map.begin(), last = map.end();
-        value_vec res(map.size());
-
-        for (R_xlen_t i = 0; first != last; ++first) {
-            HASHMAP_CHECK_INTERRUPT(i, 50000);
-            res[i++] = first->second;
-        }
+        value_vec res(size());
+        HASHMAP_PROFILE_PHASE(phase_alloc);
+        fill(0, &res, res.size());
 
         set_value_attr(res);
+        HASHMAP_PROFILE_PHASE(phase_build);
 
         vvec = res;
         values_cached_ = true;
@@ -373,7 +1845,7 @@ public:
     value_vec values_n(int nx) const
     {
         if (nx < 0) nx = 0;
-        if ((size_type)nx > map.size()) nx = map.size();
+        if ((size_type)nx > size()) nx = size();
 
         if (values_cached_) {
             value_vec res =  vvec[Rcpp::seq(0, nx - 1)];
@@ -381,13 +1853,8 @@ public:
             return res;
         }
 
-        const_iterator first = map.begin(), last = map.end();
         value_vec res(nx);
-
-        for (R_xlen_t i = 0; first != last && i < nx; ++first) {
-            HASHMAP_CHECK_INTERRUPT(i, 50000);
-            res[i++] = first->second;
-        }
+        fill(0, &res, nx);
 
         set_value_attr(res);
 
@@ -398,16 +1865,12 @@ public:
     {
         if (keys_cached_) return;
 
-        R_xlen_t i = 0, n = map.size();
+        R_xlen_t n = size();
         if (kvec.size() != n) {
             kvec = key_vec(n);
         }
 
-        const_iterator first = map.begin(), last = map.end();
-        for (; first != last; ++first) {
-            HASHMAP_CHECK_INTERRUPT(i, 50000);
-            kvec[i++] = first->first;
-        }
+        fill(&kvec, 0, n);
 
         set_key_attr(kvec);
         keys_cached_ = true;
@@ -417,80 +1880,518 @@ public:
     {
         if (values_cached_) return;
 
-        R_xlen_t i = 0, n = map.size();
+        R_xlen_t n = size();
         if (vvec.size() != n) {
             vvec = value_vec(n);
         }
 
-        const_iterator first = map.begin(), last = map.end();
-        for (; first != last; ++first) {
-            HASHMAP_CHECK_INTERRUPT(i, 50000);
-            vvec[i++] = first->second;
-        }
+        fill(0, &vvec, n);
 
         set_value_attr(vvec);
         values_cached_ = true;
     }
 
-    void erase(const key_vec& keys_)
+    void erase(const key_vec& x)
     {
+        HASHMAP_PROFILE_OP(op_erase, x.size());
+        check_mutable();
+        key_vec keys_ = key_input(x);
         R_xlen_t i = 0, n = keys_.size();
 
+        HASHMAP_PROFILE_PHASE(phase_convert);
+
         for (; i < n; i++) {
             HASHMAP_CHECK_INTERRUPT(i, 50000);
-            map.erase(extractor(keys_, i));
+            key_t k = extractor(keys_, i);
+            HASHMAP_PROFILE_PHASE(phase_convert);
+            HASHMAP_PROFILE_HASH(hasher(), k);
+            remove(k);
+            HASHMAP_PROFILE_PHASE(phase_probe);
         }
 
+        if (filter.active() && filter.stale()) rebuild_filter();
+
         keys_cached_ = false;
         values_cached_ = false;
+        journal_commit();
     }
 
-    value_vec find(const key_vec& keys_) const
+    void erase(SEXP keys_)
     {
+        HASHMAP_PROFILE_OP(op_erase, Rf_xlength(keys_));
+        erase(key_input(keys_));
+    }
+
+    value_vec find(const key_vec& x) const
+    {
+        HASHMAP_PROFILE_OP(op_find, x.size());
+        key_vec keys_ = key_input(x);
         R_xlen_t i = 0, n = keys_.size();
+        HASHMAP_PROFILE_PHASE(phase_convert);
         value_vec res(n);
-        const_iterator last = map.end();
+        HASHMAP_PROFILE_PHASE(phase_alloc);
+
+        if (batch_hashing(keys_)) {
+            const key_t* px = raw_keys(keys_);
+            const value_t* pos[hash_block_size];
+
+            for (; i < n; i += hash_block_size) {
+                HASHMAP_CHECK_INTERRUPT(i / hash_block_size, 64);
+                R_xlen_t j = 0, m = n - i;
+                if (m > (R_xlen_t)hash_block_size) m = hash_block_size;
+
+                lookup_block(px + i, m, pos);
+                HASHMAP_PROFILE_PHASE(phase_probe);
+                for (; j < m; j++) {
+                    if (pos[j]) {
+                        res[i + j] = *pos[j];
+                    } else {
+                        res[i + j] = Rcpp::traits::get_na<value_rtype>();
+                    }
+                }
+                HASHMAP_PROFILE_PHASE(phase_build);
+            }
+
+            set_value_attr(res);
+            return res;
+        }
 
         for (; i < n; i++) {
             HASHMAP_CHECK_INTERRUPT(i, 50000);
-            const_iterator pos = map.find(extractor(keys_, i));
-            if (pos != last) {
-                res[i] = pos->second;
+            key_t k = extractor(keys_, i);
+            HASHMAP_PROFILE_PHASE(phase_convert);
+            HASHMAP_PROFILE_HASH(hasher(), k);
+            const value_t* pos = lookup(k);
+            HASHMAP_PROFILE_PHASE(phase_probe);
+            if (pos) {
+                res[i] = *pos;
             } else {
                 res[i] = Rcpp::traits::get_na<value_rtype>();
             }
+            HASHMAP_PROFILE_PHASE(phase_build);
         }
 
         set_value_attr(res);
+        HASHMAP_PROFILE_PHASE(phase_build);
         return res;
     }
 
     value_vec find(SEXP keys_) const
-    { return find(Rcpp::as<key_vec>(keys_)); }
+    {
+        HASHMAP_PROFILE_OP(op_find, Rf_xlength(keys_));
+        return find(key_input(keys_));
+    }
+
+    // Single-key versions of find, insert, has_key and erase, used
+    // by the .Call entry points in scalar.cpp; they skip building
+    // key_vec / value_vec wrappers for the common case.
+    SEXP get_scalar(SEXP key_) const
+    {
+        HASHMAP_PROFILE_OP(op_get_scalar, 1);
+        key_t k = scalar_extractor<key_t>(key_levels.recode(key_), "key");
+        HASHMAP_PROFILE_PHASE(phase_convert);
+        HASHMAP_PROFILE_HASH(hasher(), k);
+        const value_t* pos = lookup(k);
+        HASHMAP_PROFILE_PHASE(phase_probe);
+
+        if (pos && !date_values && !posix_values.is &&
+            !value_levels.active()) {
+            return traits::scalar_sexp(*pos);
+        }
+
+        value_vec res(1);
+        if (pos) {
+            res[0] = *pos;
+        } else {
+            res[0] = Rcpp::traits::get_na<value_rtype>();
+        }
+
+        set_value_attr(res);
+        return res;
+    }
+
+    void set_scalar(SEXP key_, SEXP value_)
+    {
+        HASHMAP_PROFILE_OP(op_set_scalar, 1);
+        check_mutable();
+
+        key_t k = scalar_extractor<key_t>(
+            key_levels.recode_extend(key_), "key"
+        );
+        value_t v = scalar_extractor<value_t>(
+            value_levels.recode_extend(value_), "value"
+        );
+        HASHMAP_PROFILE_PHASE(phase_convert);
+        HASHMAP_PROFILE_HASH(hasher(), k);
+
+        // overwriting an existing key leaves the key order intact
+        if (put(k, v)) keys_cached_ = false;
+        values_cached_ = false;
+        HASHMAP_PROFILE_PHASE(phase_probe);
+        journal_commit();
+    }
+
+    bool has_scalar(SEXP key_) const
+    {
+        return lookup(
+            scalar_extractor<key_t>(key_levels.recode(key_), "key")
+        ) != 0;
+    }
+
+    // returns true if the key was present
+    bool erase_scalar(SEXP key_)
+    {
+        check_mutable();
+
+        key_t k = scalar_extractor<key_t>(key_levels.recode(key_), "key");
+        if (!remove(k)) return false;
+        if (filter.active() && filter.stale()) rebuild_filter();
+
+        keys_cached_ = false;
+        values_cached_ = false;
+        journal_commit();
+        return true;
+    }
+
+    // Raw-pointer access backing the C API (api.cpp). keys and
+    // values point to arrays of api_traits<key_t>::type and
+    // api_traits<value_t>::type, or of const char* for encoded values
+    // (as for plain character values); none of these touch the R API.
+    typedef traits::api_traits<key_t> key_api;
+    typedef traits::api_traits<value_t> value_api;
+
+    // values (if not NULL) receive NA for absent keys; found (if not
+    // NULL) receives 1 / 0
+    void find_raw(const void* keys_, R_xlen_t n,
+                  void* values_, int* found) const
+    {
+        const typename key_api::type* ks =
+            static_cast<const typename key_api::type*>(keys_);
+        typename value_api::type* vs =
+            static_cast<typename value_api::type*>(values_);
+
+        if (value_levels.encoded()) {
+            const char** cs = static_cast<const char**>(values_);
+            for (R_xlen_t i = 0; i < n; i++) {
+                const value_t* pos = lookup(key_api::from(ks[i]));
+                if (cs) cs[i] = pos ? value_levels.level_chars(*pos) : 0;
+                if (found) found[i] = pos != 0;
+            }
+            return;
+        }
+
+        for (R_xlen_t i = 0; i < n; i++) {
+            const value_t* pos = lookup(key_api::from(ks[i]));
+            if (vs) vs[i] = pos ? value_api::to(*pos) : value_api::na();
+            if (found) found[i] = pos != 0;
+        }
+    }
+
+    // Returns false, inserting nothing, if the values are encoded and
+    // one of them is not yet a level (which only R can create).
+    bool insert_raw(const void* keys_, const void* values_, R_xlen_t n)
+    {
+        check_mutable();
+
+        const typename key_api::type* ks =
+            static_cast<const typename key_api::type*>(keys_);
+        const typename value_api::type* vs =
+            static_cast<const typename value_api::type*>(values_);
+
+        if (value_levels.encoded()) {
+            const char* const* cs = static_cast<const char* const*>(values_);
+            boost::container::vector<value_t> codes(n);
+
+            for (R_xlen_t i = 0; i < n; i++) {
+                int x = value_levels.find_code(cs[i]);
+                if (!x) return false;
+                set_code(codes[i], x);
+            }
+
+            keys_cached_ = false;
+            values_cached_ = false;
+
+            for (R_xlen_t i = 0; i < n; i++) {
+                put(key_api::from(ks[i]), codes[i]);
+            }
+
+            journal_commit();
+            return true;
+        }
+
+        keys_cached_ = false;
+        values_cached_ = false;
+
+        for (R_xlen_t i = 0; i < n; i++) {
+            put(key_api::from(ks[i]), value_api::from(vs[i]));
+        }
+
+        journal_commit();
+        return true;
+    }
+
+    void erase_raw(const void* keys_, R_xlen_t n)
+    {
+        check_mutable();
+
+        const typename key_api::type* ks =
+            static_cast<const typename key_api::type*>(keys_);
+
+        keys_cached_ = false;
+        values_cached_ = false;
+
+        for (R_xlen_t i = 0; i < n; i++) {
+            remove(key_api::from(ks[i]));
+        }
+
+        if (filter.active() && filter.stale()) rebuild_filter();
+        journal_commit();
+    }
+
+    struct raw_visitor {
+        raw_visit_fn fn;
+        void* data;
+        const factor_dict& levels;
+
+        raw_visitor(raw_visit_fn fn_, void* data_, const factor_dict& levels_)
+            : fn(fn_), data(data_), levels(levels_)
+        {}
+
+        bool operator()(const key_t& k, const value_t& v)
+        {
+            typename key_api::type kc = key_api::to(k);
+            if (levels.encoded()) {
+                const char* cc = levels.level_chars(v);
+                return fn(&kc, &cc, data) != 0;
+            }
+
+            typename value_api::type vc = value_api::to(v);
+            return fn(&kc, &vc, data) != 0;
+        }
+    };
+
+    void iterate_raw(raw_visit_fn fn, void* data) const
+    {
+        raw_visitor f(fn, data, value_levels);
+        visit(f);
+    }
 
-    bool has_key(const key_vec& keys_) const
-    { return map.find(extractor(keys_, 0)) != map.end(); }
+    // Resumable iteration state for cursors (CursorTemplate.hpp); a
+    // position is only valid while version() is unchanged.
+    struct position {
+        std::size_t version;
+        size_type done;
+        size_type slot;
+        const_iterator it;
+        typename hamt_t::const_iterator node;
+    };
+
+    std::size_t version() const
+    { return version_; }
+
+    position begin_position() const
+    {
+        position res;
+        res.version = version_;
+        res.done = 0;
+        res.slot = 0;
+        res.it = map.begin();
+        res.node = trie.begin();
+        return res;
+    }
+
+    // Returns the (at most n) entries following pos, in storage
+    // order, as a data.frame like data_frame(), and advances pos.
+    Rcpp::DataFrame next_chunk(position& pos, int n) const
+    {
+        if (pos.version != version_) {
+            Rcpp::stop("Hashmap was modified during iteration");
+        }
+
+        size_type remaining = size() - pos.done;
+        if (n < 0) n = 0;
+        if ((size_type)n > remaining) n = remaining;
+
+        key_vec kres(n);
+        value_vec vres(n);
+        R_xlen_t i = 0;
+
+        if (frozen_) {
+            for (; i < n; ++pos.slot, ++i) {
+                HASHMAP_CHECK_INTERRUPT(i, 50000);
+                kres[i] = mphf.key(pos.slot);
+                vres[i] = mphf.value(pos.slot);
+            }
+        } else if (persistent_) {
+            for (; i < n; ++pos.node, ++i) {
+                HASHMAP_CHECK_INTERRUPT(i, 50000);
+                kres[i] = pos.node->first;
+                vres[i] = pos.node->second;
+            }
+        } else if (incremental_) {
+            for (; i < n; ++pos.slot) {
+                if (!dense.live(pos.slot)) continue;
+                HASHMAP_CHECK_INTERRUPT(i, 50000);
+                kres[i] = dense.key(pos.slot);
+                vres[i] = dense.value(pos.slot);
+                ++i;
+            }
+        } else {
+            for (; i < n; ++pos.it, ++i) {
+                HASHMAP_CHECK_INTERRUPT(i, 50000);
+                kres[i] = pos.it->first;
+                vres[i] = pos.it->second;
+            }
+        }
+
+        pos.done += n;
+
+        set_key_attr(kres);
+        set_value_attr(vres);
+
+        return Rcpp::DataFrame::create(
+            Rcpp::Named("Keys") = kres,
+            Rcpp::Named("Values") = vres,
+            Rcpp::Named("stringsAsFactors") = false
+        );
+    }
+
+    bool has_key(const key_vec& x) const
+    { return lookup(extractor(key_input(x), 0)) != 0; }
 
     bool has_key(SEXP keys_) const
-    { return has_key(Rcpp::as<key_vec>(keys_)); }
+    { return has_key(key_input(keys_)); }
 
-    Rcpp::Vector<LGLSXP> has_keys(const key_vec& keys_) const
+    Rcpp::Vector<LGLSXP> has_keys(const key_vec& x) const
     {
+        HASHMAP_PROFILE_OP(op_has_keys, x.size());
+        key_vec keys_ = key_input(x);
         R_xlen_t i = 0, n = keys_.size();
+        HASHMAP_PROFILE_PHASE(phase_convert);
         Rcpp::Vector<LGLSXP> res = Rcpp::no_init_vector(n);
-        const_iterator last = map.end();
+        HASHMAP_PROFILE_PHASE(phase_alloc);
+
+        if (batch_hashing(keys_)) {
+            const key_t* px = raw_keys(keys_);
+            const value_t* pos[hash_block_size];
+
+            for (; i < n; i += hash_block_size) {
+                HASHMAP_CHECK_INTERRUPT(i / hash_block_size, 64);
+                R_xlen_t j = 0, m = n - i;
+                if (m > (R_xlen_t)hash_block_size) m = hash_block_size;
+
+                lookup_block(px + i, m, pos);
+                for (; j < m; j++) {
+                    res[i + j] = pos[j] ? true : false;
+                }
+                HASHMAP_PROFILE_PHASE(phase_probe);
+            }
+
+            return res;
+        }
 
         for (; i < n; i++) {
             HASHMAP_CHECK_INTERRUPT(i, 50000);
-            res[i] = (map.find(extractor(keys_, i)) != last) ?
-                true : false;
+            key_t k = extractor(keys_, i);
+            HASHMAP_PROFILE_PHASE(phase_convert);
+            HASHMAP_PROFILE_HASH(hasher(), k);
+            res[i] = lookup(k) ? true : false;
+            HASHMAP_PROFILE_PHASE(phase_probe);
         }
 
         return res;
     }
 
     Rcpp::Vector<LGLSXP> has_keys(SEXP keys_) const
-    { return has_keys(Rcpp::as<key_vec>(keys_)); }
+    {
+        HASHMAP_PROFILE_OP(op_has_keys, Rf_xlength(keys_));
+        return has_keys(key_input(keys_));
+    }
+
+    key_vec floor(const key_vec& keys_) const
+    {
+        ensure_sorted();
+
+        R_xlen_t i = 0, n = keys_.size();
+        key_vec res(n);
+
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            key_t k = extractor(keys_, i);
+            const key_t* pos = traits::is_na_key(k) ? 0 : sorted.floor(k);
+            res[i] = pos ? *pos : key_na();
+        }
+
+        set_key_attr(res);
+        return res;
+    }
+
+    key_vec floor(SEXP keys_) const
+    { return floor(key_input(keys_)); }
+
+    key_vec ceiling(const key_vec& keys_) const
+    {
+        ensure_sorted();
+
+        R_xlen_t i = 0, n = keys_.size();
+        key_vec res(n);
+
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            key_t k = extractor(keys_, i);
+            const key_t* pos = traits::is_na_key(k) ? 0 : sorted.ceiling(k);
+            res[i] = pos ? *pos : key_na();
+        }
+
+        set_key_attr(res);
+        return res;
+    }
+
+    key_vec ceiling(SEXP keys_) const
+    { return ceiling(key_input(keys_)); }
+
+    Rcpp::Vector<INTSXP> rank(const key_vec& keys_) const
+    {
+        ensure_sorted();
+
+        R_xlen_t i = 0, n = keys_.size();
+        Rcpp::Vector<INTSXP> res = Rcpp::no_init_vector(n);
+
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            key_t k = extractor(keys_, i);
+            res[i] = traits::is_na_key(k) ?
+                NA_INTEGER : (int)sorted.rank(k);
+        }
+
+        return res;
+    }
+
+    Rcpp::Vector<INTSXP> rank(SEXP keys_) const
+    { return rank(key_input(keys_)); }
+
+    key_vec range(const key_vec& lo, const key_vec& hi) const
+    {
+        ensure_sorted();
+
+        if (!lo.size() || !hi.size()) {
+            Rcpp::stop("'lo' and 'hi' must have length >= 1");
+        }
+
+        std::vector<key_t> tmp;
+        key_t klo = extractor(lo, 0), khi = extractor(hi, 0);
+
+        if (!traits::is_na_key(klo) && !traits::is_na_key(khi)) {
+            sorted.range(klo, khi, tmp);
+        }
+
+        key_vec res(tmp.begin(), tmp.end());
+        set_key_attr(res);
+        return res;
+    }
+
+    key_vec range(SEXP lo, SEXP hi) const
+    { return range(key_input(lo), key_input(hi)); }
 
     value_vec data() const
     {
@@ -500,19 +2401,12 @@ public:
             return res;
         }
 
-        R_xlen_t i = 0, n = map.size();
+        R_xlen_t n = size();
 
         value_vec res(n);
         key_vec knames(n);
 
-        const_iterator first = map.begin(), last = map.end();
-
-        for (; first != last; ++first) {
-            HASHMAP_CHECK_INTERRUPT(i, 50000);
-            knames[i] = first->first;
-            res[i] = first->second;
-            ++i;
-        }
+        fill(&knames, &res, n);
 
         set_value_attr(res);
 
@@ -539,7 +2433,7 @@ public:
     value_vec data_n(int nx) const
     {
         if (nx < 0) nx = 0;
-        if ((size_type)nx > map.size()) nx = map.size();
+        if ((size_type)nx > size()) nx = size();
 
         if (values_cached_ && keys_cached_) {
             Rcpp::Range vidx = Rcpp::seq(0, nx - 1);
@@ -548,19 +2442,10 @@ public:
             return res;
         }
 
-        R_xlen_t i = 0, n = 0;
-
         value_vec res(nx);
         key_vec knames(nx);
 
-        const_iterator first = map.begin(), last = map.end();
-
-        for (; first != last && n != nx; ++first, ++n) {
-            HASHMAP_CHECK_INTERRUPT(i, 50000);
-            knames[i] = first->first;
-            res[i] = first->second;
-            ++i;
-        }
+        fill(&knames, &res, nx);
 
         set_value_attr(res);
 
@@ -629,6 +2514,7 @@ public:
     {
         if (date_keys) return "Date";
         if (posix_keys.is) return "POSIXct";
+        if (key_levels.active()) return "factor";
 
         switch ((int)key_rtype) {
             case INTSXP: return "integer";
@@ -646,6 +2532,8 @@ public:
     {
         if (date_values) return "Date";
         if (posix_values.is) return "POSIXct";
+        if (value_levels.encoded()) return "character";
+        if (value_levels.active()) return "factor";
 
         switch ((int)value_rtype) {
             case INTSXP: return "integer";
@@ -0,0 +1,242 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// IndexTemplate.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__IndexTemplate__hpp
+#define hashmap__IndexTemplate__hpp
+
+#include "HashTemplate.hpp"
+#include "HashIndexClass.h"
+#include <boost/unordered_set.hpp>
+#include <climits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace hashmap {
+
+// Maps each distinct element of a "table" vector to the (1-based)
+// position of its first occurrence, i.e. a reusable match(, table).
+//
+// Lookups for integer and numeric keys run in parallel (OpenMP) once
+// the input has at least parallel_threshold elements; they only read
+// the input through a raw pointer and the table through const
+// member functions, and do not check for user interrupts. Character
+// keys are always looked up serially, since reading a CHARSXP
+// requires the R API.
+template <typename KeyType>
+class IndexTemplate {
+public:
+    typedef KeyType key_t;
+
+    typedef typename key_hash<key_t>::hasher hasher;
+    typedef typename key_hash<key_t>::key_equal key_equal;
+
+#if defined(HASHMAP_NO_SPP) || (defined(__sun) && defined(__SVR4))  // solaris
+    typedef boost::unordered_map<key_t, int, hasher, key_equal> map_t;
+    typedef boost::unordered_set<key_t, hasher, key_equal> set_t;
+#else
+    typedef spp::sparse_hash_map<key_t, int, hasher, key_equal> map_t;
+    typedef spp::sparse_hash_set<key_t, hasher, key_equal> set_t;
+#endif
+
+    enum { key_rtype = traits::sexp_traits<key_t>::rtype };
+    enum { parallel_threshold = 100000 };
+
+    typedef Rcpp::Vector<key_rtype> key_vec;
+
+    typedef typename map_t::size_type size_type;
+    typedef typename map_t::const_iterator const_iterator;
+
+private:
+    map_t map;
+
+    R_xlen_t length_;
+    R_xlen_t first_dup;
+
+    // position of the first NA_character_ in the table, or 0; as
+    // character keys are read as std::string, NA is kept out of map
+    // so that it does not match "NA"
+    int na_pos;
+
+    // whether x[i] is NA_character_
+    template <int RTYPE>
+    static bool is_na_string(const Rcpp::Vector<RTYPE>&, R_xlen_t)
+    { return false; }
+
+    static bool is_na_string(const Rcpp::Vector<STRSXP>& x, R_xlen_t i)
+    { return STRING_ELT(x, i) == NA_STRING; }
+
+    int position(const key_t& k, int nomatch) const
+    {
+        const_iterator pos = map.find(k);
+        return pos != map.end() ? pos->second : nomatch;
+    }
+
+    // res[i] = position(x[i]), or nomatch
+    void positions(const key_vec& x, int nomatch, int* res) const
+    {
+        R_xlen_t i = 0, n = x.size();
+        const key_t* px = raw_keys(x);
+
+        if (px && n >= (R_xlen_t)parallel_threshold) {
+#ifdef _OPENMP
+            #pragma omp parallel for schedule(static)
+#endif
+            for (i = 0; i < n; i++) {
+                res[i] = position(px[i], nomatch);
+            }
+            return;
+        }
+
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            if (is_na_string(x, i)) {
+                res[i] = na_pos ? na_pos : nomatch;
+            } else {
+                res[i] = position(extractor(x, i), nomatch);
+            }
+        }
+    }
+
+public:
+    IndexTemplate()
+        : length_(0), first_dup(0), na_pos(0)
+    {}
+
+    IndexTemplate(const key_vec& table)
+        : length_(table.size()), first_dup(0), na_pos(0)
+    {
+        if (length_ > (R_xlen_t)INT_MAX) {
+            Rcpp::stop("'table' is too long");
+        }
+
+        map.reserve((size_type)(length_ * 1.05));
+
+        for (R_xlen_t i = 0; i < length_; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            if (is_na_string(table, i)) {
+                if (!na_pos) {
+                    na_pos = (int)(i + 1);
+                } else if (!first_dup) {
+                    first_dup = i + 1;
+                }
+                continue;
+            }
+
+            bool added = map.insert(
+                std::make_pair(extractor(table, i), (int)(i + 1))
+            ).second;
+            if (!added && !first_dup) first_dup = i + 1;
+        }
+    }
+
+    IndexTemplate clone() const
+    { return IndexTemplate(*this); }
+
+    size_type size() const
+    { return map.size() + (na_pos != 0); }
+
+    R_xlen_t length() const
+    { return length_; }
+
+    int key_sexptype() const
+    { return key_rtype; }
+
+    Rcpp::Vector<INTSXP> match(const key_vec& x, int nomatch) const
+    {
+        Rcpp::Vector<INTSXP> res = Rcpp::no_init_vector(x.size());
+        positions(x, nomatch, res.begin());
+        return res;
+    }
+
+    Rcpp::Vector<INTSXP> match(SEXP x, int nomatch) const
+    { return match(Rcpp::as<key_vec>(x), nomatch); }
+
+    Rcpp::Vector<LGLSXP> contains(const key_vec& x) const
+    {
+        R_xlen_t i = 0, n = x.size();
+        Rcpp::Vector<INTSXP> pos = Rcpp::no_init_vector(n);
+        positions(x, 0, pos.begin());
+
+        Rcpp::Vector<LGLSXP> res = Rcpp::no_init_vector(n);
+        for (; i < n; i++) {
+            res[i] = pos[i] != 0;
+        }
+
+        return res;
+    }
+
+    Rcpp::Vector<LGLSXP> contains(SEXP x) const
+    { return contains(Rcpp::as<key_vec>(x)); }
+
+    // anyDuplicated(table)
+    double any_duplicated() const
+    { return (double)first_dup; }
+
+    // first i such that x[i] is in the table or in x[1:(i - 1)],
+    // i.e. anyDuplicated(c(table, x)) restricted to x; 0 if none
+    double any_duplicated(const key_vec& x) const
+    {
+        R_xlen_t i = 0, n = x.size();
+        set_t seen;
+        bool seen_na = na_pos != 0;
+
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            if (is_na_string(x, i)) {
+                if (seen_na) return (double)(i + 1);
+                seen_na = true;
+                continue;
+            }
+
+            key_t k = extractor(x, i);
+            if (map.find(k) != map.end()) return (double)(i + 1);
+            if (!seen.insert(k).second) return (double)(i + 1);
+        }
+
+        return 0;
+    }
+
+    double any_duplicated(SEXP x) const
+    { return any_duplicated(Rcpp::as<key_vec>(x)); }
+
+    // tabulate(match(x, table), nbins = length(table))
+    Rcpp::Vector<INTSXP> tabulate(const key_vec& x) const
+    {
+        R_xlen_t i = 0, n = x.size();
+        std::vector<int> pos(n);
+        positions(x, 0, n ? &pos[0] : 0);
+
+        Rcpp::Vector<INTSXP> res(length_);
+        for (; i < n; i++) {
+            if (pos[i]) ++res[pos[i] - 1];
+        }
+
+        return res;
+    }
+
+    Rcpp::Vector<INTSXP> tabulate(SEXP x) const
+    { return tabulate(Rcpp::as<key_vec>(x)); }
+};
+
+} // hashmap
+
+#endif // hashmap__IndexTemplate__hpp
@@ -0,0 +1,383 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// SetTemplate.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__SetTemplate__hpp
+#define hashmap__SetTemplate__hpp
+
+#include "HashTemplate.hpp"
+#include "HashSetClass.h"
+#include <boost/unordered_set.hpp>
+
+namespace hashmap {
+
+// Key-only counterpart of HashTemplate, backing the Hashset class.
+// The binary set operations always iterate over the smaller operand
+// and probe the larger one; the result takes its key attributes
+// (Date, POSIXct) from *this. Their overloads for a vector operand
+// walk the vector once, probing *this, rather than building a set
+// from it first.
+template <typename KeyType>
+class SetTemplate {
+public:
+    typedef KeyType key_t;
+
+#if defined(HASHMAP_NO_SPP) || (defined(__sun) && defined(__SVR4))  // solaris
+    typedef boost::unordered_set<
+        key_t,
+        typename key_hash<key_t>::hasher,
+        typename key_hash<key_t>::key_equal
+    > set_t;
+#else
+    typedef spp::sparse_hash_set<
+        key_t,
+        typename key_hash<key_t>::hasher,
+        typename key_hash<key_t>::key_equal
+    > set_t;
+#endif
+
+    enum { key_rtype = traits::sexp_traits<key_t>::rtype };
+
+    typedef Rcpp::Vector<key_rtype> key_vec;
+
+    typedef typename set_t::size_type size_type;
+    typedef typename set_t::const_iterator const_iterator;
+    typedef typename set_t::hasher hasher;
+
+private:
+    set_t set;
+
+    mutable bool keys_cached_;
+    mutable key_vec kvec;
+
+    Rcpp::RObject key_class;
+    Rcpp::RObject key_tzone;
+
+    void set_key_attr(key_vec& x) const
+    {
+        if (!key_class.isNULL()) x.attr("class") = key_class;
+        if (!key_tzone.isNULL()) x.attr("tzone") = key_tzone;
+    }
+
+    void copy_attr(const SetTemplate& other)
+    {
+        key_class = other.key_class;
+        key_tzone = other.key_tzone;
+    }
+
+    bool has(const key_t& k) const
+    { return set.find(k) != set.end(); }
+
+public:
+    SetTemplate()
+        : keys_cached_(false),
+          kvec(0),
+          key_class(R_NilValue),
+          key_tzone(R_NilValue)
+    {}
+
+    SetTemplate(const key_vec& keys_)
+        : keys_cached_(false),
+          kvec(0),
+          key_class(Rf_getAttrib(keys_, R_ClassSymbol)),
+          key_tzone(Rf_getAttrib(keys_, Rf_install("tzone")))
+    {
+        if (Rf_inherits(keys_, "POSIXt") && key_tzone.isNULL()) {
+            key_tzone = Rcpp::wrap("UTC");
+        }
+
+        set.reserve((size_type)(keys_.size() * 1.05));
+        insert(keys_);
+    }
+
+    SetTemplate clone() const
+    {
+        SetTemplate res(*this);
+        res.keys_cached_ = false;
+        res.kvec = key_vec(0);
+        return res;
+    }
+
+    size_type size() const
+    { return set.size(); }
+
+    bool empty() const
+    { return set.empty(); }
+
+    int key_sexptype() const
+    { return key_rtype; }
+
+    std::string key_class_name() const
+    {
+        if (!key_class.isNULL()) {
+            Rcpp::CharacterVector cls(key_class);
+            return Rcpp::as<std::string>(cls[0]);
+        }
+
+        switch ((int)key_rtype) {
+            case INTSXP: return "integer";
+            case REALSXP: return "numeric";
+            case STRSXP: return "character";
+            default: return "";
+        }
+
+        return "";
+    }
+
+    void clear()
+    {
+        set.clear();
+        keys_cached_ = false;
+    }
+
+    size_type bucket_count() const
+    { return set.bucket_count(); }
+
+    void rehash(size_type n)
+    { set.rehash(n); }
+
+    void reserve(size_type n)
+    { set.reserve(n); }
+
+    Rcpp::Vector<INTSXP> hash_value(const key_vec& keys_) const
+    {
+        Rcpp::Vector<INTSXP> res = Rcpp::no_init_vector(keys_.size());
+        hash_values<hasher>(keys_, res.begin());
+        return res;
+    }
+
+    void insert(const key_vec& keys_)
+    {
+        R_xlen_t i = 0, n = keys_.size();
+        keys_cached_ = false;
+
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            set.insert(extractor(keys_, i));
+        }
+    }
+
+    void insert(SEXP keys_)
+    { insert(Rcpp::as<key_vec>(keys_)); }
+
+    void erase(const key_vec& keys_)
+    {
+        R_xlen_t i = 0, n = keys_.size();
+        keys_cached_ = false;
+
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            set.erase(extractor(keys_, i));
+        }
+    }
+
+    void erase(SEXP keys_)
+    { erase(Rcpp::as<key_vec>(keys_)); }
+
+    Rcpp::Vector<LGLSXP> contains(const key_vec& keys_) const
+    {
+        R_xlen_t i = 0, n = keys_.size();
+        Rcpp::Vector<LGLSXP> res = Rcpp::no_init_vector(n);
+
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            res[i] = has(extractor(keys_, i));
+        }
+
+        return res;
+    }
+
+    Rcpp::Vector<LGLSXP> contains(SEXP keys_) const
+    { return contains(Rcpp::as<key_vec>(keys_)); }
+
+    key_vec keys() const
+    {
+        if (keys_cached_) return kvec;
+
+        key_vec res = keys_n(size());
+        kvec = res;
+        keys_cached_ = true;
+
+        return res;
+    }
+
+    key_vec keys_n(int nx) const
+    {
+        if (nx < 0) nx = 0;
+        if ((size_type)nx > size()) nx = size();
+
+        key_vec res(nx);
+        const_iterator first = set.begin();
+        for (R_xlen_t i = 0; i < nx; ++first, ++i) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            res[i] = *first;
+        }
+
+        set_key_attr(res);
+        return res;
+    }
+
+    // res = *this | other
+    void set_union(const SetTemplate& other, SetTemplate& res) const
+    {
+        const SetTemplate& smaller = size() < other.size() ? *this : other;
+        const SetTemplate& larger = size() < other.size() ? other : *this;
+
+        res.set = larger.set;
+        res.copy_attr(*this);
+
+        R_xlen_t i = 0;
+        const_iterator first = smaller.set.begin(), last = smaller.set.end();
+        for (; first != last; ++first, ++i) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            res.set.insert(*first);
+        }
+    }
+
+    // res = *this & other
+    void set_intersect(const SetTemplate& other, SetTemplate& res) const
+    {
+        const SetTemplate& smaller = size() < other.size() ? *this : other;
+        const SetTemplate& larger = size() < other.size() ? other : *this;
+
+        res.set.clear();
+        res.set.reserve(smaller.size());
+        res.copy_attr(*this);
+
+        R_xlen_t i = 0;
+        const_iterator first = smaller.set.begin(), last = smaller.set.end();
+        for (; first != last; ++first, ++i) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            if (larger.has(*first)) res.set.insert(*first);
+        }
+    }
+
+    // res = *this - other
+    void set_diff(const SetTemplate& other, SetTemplate& res) const
+    {
+        res.copy_attr(*this);
+        R_xlen_t i = 0;
+
+        if (size() <= other.size()) {
+            res.set.clear();
+            res.set.reserve(size());
+
+            const_iterator first = set.begin(), last = set.end();
+            for (; first != last; ++first, ++i) {
+                HASHMAP_CHECK_INTERRUPT(i, 50000);
+                if (!other.has(*first)) res.set.insert(*first);
+            }
+            return;
+        }
+
+        res.set = set;
+        const_iterator first = other.set.begin(), last = other.set.end();
+        for (; first != last; ++first, ++i) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            res.set.erase(*first);
+        }
+    }
+
+    // res = *this | other
+    void set_union(const key_vec& other, SetTemplate& res) const
+    {
+        res.set = set;
+        res.copy_attr(*this);
+
+        R_xlen_t i = 0, n = other.size();
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            res.set.insert(extractor(other, i));
+        }
+    }
+
+    // res = *this & other
+    void set_intersect(const key_vec& other, SetTemplate& res) const
+    {
+        res.set.clear();
+        res.copy_attr(*this);
+
+        R_xlen_t i = 0, n = other.size();
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            key_t k = extractor(other, i);
+            if (has(k)) res.set.insert(k);
+        }
+    }
+
+    // res = *this - other
+    void set_diff(const key_vec& other, SetTemplate& res) const
+    {
+        res.set = set;
+        res.copy_attr(*this);
+
+        R_xlen_t i = 0, n = other.size();
+        for (; i < n && !res.set.empty(); i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            res.set.erase(extractor(other, i));
+        }
+    }
+
+    // res = (*this - other) | (other - *this); only the elements of
+    // other seen before need to be remembered, to skip repeats
+    void set_symdiff(const key_vec& other, SetTemplate& res) const
+    {
+        res.set = set;
+        res.copy_attr(*this);
+
+        set_t seen;
+        R_xlen_t i = 0, n = other.size();
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            key_t k = extractor(other, i);
+            if (!seen.insert(k).second) continue;
+
+            if (has(k)) {
+                res.set.erase(k);
+            } else {
+                res.set.insert(k);
+            }
+        }
+    }
+
+    // res = (*this - other) | (other - *this)
+    void set_symdiff(const SetTemplate& other, SetTemplate& res) const
+    {
+        const SetTemplate& smaller = size() < other.size() ? *this : other;
+        const SetTemplate& larger = size() < other.size() ? other : *this;
+
+        res.set = larger.set;
+        res.copy_attr(*this);
+
+        R_xlen_t i = 0;
+        const_iterator first = smaller.set.begin(), last = smaller.set.end();
+        for (; first != last; ++first, ++i) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            if (larger.has(*first)) {
+                res.set.erase(*first);
+            } else {
+                res.set.insert(*first);
+            }
+        }
+    }
+};
+
+} // hashmap
+
+#endif // hashmap__SetTemplate__hpp
@@ -0,0 +1,264 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// SharedMapClass.h
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__SharedMapClass__h
+#define hashmap__SharedMapClass__h
+
+#include <Rcpp.h>
+#include <boost/variant.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace hashmap {
+
+template <typename KeyType, typename ValueType>
+class SharedTemplate;
+
+#define MAKE_PTR_TYPE(__TYPE__)                                \
+    typedef boost::shared_ptr<__TYPE__> __TYPE__##_ptr
+
+typedef SharedTemplate<std::string, std::string> ss_shared;
+MAKE_PTR_TYPE(ss_shared);
+
+typedef SharedTemplate<std::string, double> sd_shared;
+MAKE_PTR_TYPE(sd_shared);
+
+typedef SharedTemplate<std::string, int> si_shared;
+MAKE_PTR_TYPE(si_shared);
+
+typedef SharedTemplate<std::string, bool> sb_shared;
+MAKE_PTR_TYPE(sb_shared);
+
+typedef SharedTemplate<std::string, Rcomplex> sx_shared;
+MAKE_PTR_TYPE(sx_shared);
+
+typedef SharedTemplate<double, double> dd_shared;
+MAKE_PTR_TYPE(dd_shared);
+
+typedef SharedTemplate<double, std::string> ds_shared;
+MAKE_PTR_TYPE(ds_shared);
+
+typedef SharedTemplate<double, int> di_shared;
+MAKE_PTR_TYPE(di_shared);
+
+typedef SharedTemplate<double, bool> db_shared;
+MAKE_PTR_TYPE(db_shared);
+
+typedef SharedTemplate<double, Rcomplex> dx_shared;
+MAKE_PTR_TYPE(dx_shared);
+
+typedef SharedTemplate<int, int> ii_shared;
+MAKE_PTR_TYPE(ii_shared);
+
+typedef SharedTemplate<int, std::string> is_shared;
+MAKE_PTR_TYPE(is_shared);
+
+typedef SharedTemplate<int, double> id_shared;
+MAKE_PTR_TYPE(id_shared);
+
+typedef SharedTemplate<int, bool> ib_shared;
+MAKE_PTR_TYPE(ib_shared);
+
+typedef SharedTemplate<int, Rcomplex> ix_shared;
+MAKE_PTR_TYPE(ix_shared);
+
+#undef MAKE_PTR_TYPE
+
+typedef boost::variant<
+    ss_shared_ptr, sd_shared_ptr, si_shared_ptr, sb_shared_ptr,
+    sx_shared_ptr, dd_shared_ptr, ds_shared_ptr, di_shared_ptr,
+    db_shared_ptr, dx_shared_ptr, ii_shared_ptr, is_shared_ptr,
+    id_shared_ptr, ib_shared_ptr, ix_shared_ptr
+> variant_shared;
+
+// A Hashmap stored in a named POSIX shared memory segment, which
+// other processes can open by name (see shm_table.hpp).
+class SharedMap {
+private:
+    variant_shared variant;
+
+    struct size_visitor
+        : public boost::static_visitor<std::size_t>
+    {
+        template <typename T>
+        std::size_t operator()(const T& t) const;
+    };
+
+    struct name_visitor
+        : public boost::static_visitor<std::string>
+    {
+        template <typename T>
+        std::string operator()(const T& t) const;
+    };
+
+    struct writable_visitor
+        : public boost::static_visitor<bool>
+    {
+        template <typename T>
+        bool operator()(const T& t) const;
+    };
+
+    struct key_sexptype_visitor
+        : public boost::static_visitor<int>
+    {
+        template <typename T>
+        int operator()(const T& t) const;
+    };
+
+    struct value_sexptype_visitor
+        : public boost::static_visitor<int>
+    {
+        template <typename T>
+        int operator()(const T& t) const;
+    };
+
+    struct clear_visitor
+        : public boost::static_visitor<>
+    {
+        template <typename T>
+        void operator()(T& t) const;
+    };
+
+    struct reserve_visitor
+        : public boost::static_visitor<>
+    {
+        int n;
+        reserve_visitor(int n_);
+
+        template <typename T>
+        void operator()(T& t) const;
+    };
+
+    struct insert_visitor
+        : public boost::static_visitor<>
+    {
+        SEXP keys;
+        SEXP values;
+        insert_visitor(SEXP keys_, SEXP values_);
+
+        template <typename T>
+        void operator()(T& t) const;
+    };
+
+    struct erase_visitor
+        : public boost::static_visitor<>
+    {
+        SEXP keys;
+        erase_visitor(SEXP keys_);
+
+        template <typename T>
+        void operator()(T& t) const;
+    };
+
+    struct find_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        SEXP keys;
+        find_visitor(SEXP keys_);
+
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+    struct has_key_visitor
+        : public boost::static_visitor<bool>
+    {
+        SEXP keys;
+        has_key_visitor(SEXP keys_);
+
+        template <typename T>
+        bool operator()(const T& t) const;
+    };
+
+    struct has_keys_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        SEXP keys;
+        has_keys_visitor(SEXP keys_);
+
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+    struct keys_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+    struct values_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+    struct data_visitor
+        : public boost::static_visitor<SEXP>
+    {
+        template <typename T>
+        SEXP operator()(const T& t) const;
+    };
+
+public:
+    // Creates the segment name from keys and values, or opens an
+    // existing one if keys is NULL (writable only if requested).
+    SharedMap(std::string name, SEXP keys, SEXP values, bool writable);
+
+    int size() const;
+
+    bool empty() const;
+
+    std::string name() const;
+
+    bool writable() const;
+
+    int key_sexptype() const;
+
+    int value_sexptype() const;
+
+    void clear();
+
+    void reserve(int n);
+
+    void insert(SEXP x, SEXP y);
+
+    void erase(SEXP x);
+
+    SEXP find(SEXP x) const;
+
+    bool has_key(SEXP x) const;
+
+    SEXP has_keys(SEXP x) const;
+
+    SEXP keys() const;
+
+    SEXP values() const;
+
+    SEXP data() const;
+
+    // removes the name of this map's segment, which is freed once
+    // every process has closed it
+    void unlink() const;
+};
+
+} // hashmap
+
+#endif // hashmap__SharedMapClass__h
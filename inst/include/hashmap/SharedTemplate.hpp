@@ -0,0 +1,250 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// SharedTemplate.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__SharedTemplate__hpp
+#define hashmap__SharedTemplate__hpp
+
+#include "HashTemplate.hpp"
+#include "SharedMapClass.h"
+#include "shm_table.hpp"
+
+namespace hashmap {
+
+// Total number of string bytes in x (0 unless x is a character
+// vector); NA is stored as "NA", as by HashTemplate.
+template <int RTYPE>
+inline double string_bytes(const Rcpp::Vector<RTYPE>&)
+{ return 0; }
+
+template <>
+inline double string_bytes<STRSXP>(const Rcpp::Vector<STRSXP>& x)
+{
+    double res = 0;
+    for (R_xlen_t i = 0; i < x.size(); i++) {
+        SEXP s = STRING_ELT(x, i);
+        res += s == NA_STRING ? 2 : Rf_xlength(s);
+    }
+    return res;
+}
+
+// R interface to a shm_table, backing the SharedHashmap class. Keys
+// and values are stored as plain integer, numeric, character, logical
+// or complex data; attributes (Date, POSIXct, factor levels) are not
+// kept. Each lookup method reads a consistent state of the table, but
+// separate calls (e.g. keys() and values()) may observe different
+// states while another process is writing.
+template <typename KeyType, typename ValueType>
+class SharedTemplate {
+public:
+    typedef KeyType key_t;
+    typedef ValueType value_t;
+    typedef shm_table<key_t, value_t> table_t;
+
+    enum { key_rtype = traits::sexp_traits<key_t>::rtype };
+    enum { value_rtype = traits::sexp_traits<value_t>::rtype };
+
+    typedef Rcpp::Vector<key_rtype> key_vec;
+    typedef Rcpp::Vector<value_rtype> value_vec;
+
+    typedef typename table_t::size_type size_type;
+
+private:
+    table_t table;
+
+    // res[i] = value of x[i], or NA; found[i] (if given) tells which
+    void lookup(const key_vec& x, value_vec* res, int* found)
+    {
+        R_xlen_t i = 0, n = x.size();
+        key_t ks[hash_block_size];
+        value_t vs[hash_block_size];
+        bool fs[hash_block_size];
+
+        for (; i < n; i += hash_block_size) {
+            HASHMAP_CHECK_INTERRUPT(i / hash_block_size, 64);
+            R_xlen_t j = 0, m = n - i;
+            if (m > (R_xlen_t)hash_block_size) m = hash_block_size;
+
+            for (j = 0; j < m; j++) {
+                ks[j] = extractor(x, i + j);
+            }
+            table.find(ks, m, res ? vs : 0, fs);
+
+            for (j = 0; j < m; j++) {
+                if (found) found[i + j] = fs[j];
+                if (!res) continue;
+                if (fs[j]) {
+                    (*res)[i + j] = vs[j];
+                } else {
+                    (*res)[i + j] = Rcpp::traits::get_na<value_rtype>();
+                }
+            }
+        }
+    }
+
+public:
+    // creates the segment name, holding the pairs (keys_[i], values_[i])
+    SharedTemplate(const std::string& name, const key_vec& keys_,
+                   const value_vec& values_)
+        : table(name, key_rtype, value_rtype,
+                keys_.size(), string_bytes(keys_) + string_bytes(values_))
+    {
+        try {
+            insert(keys_, values_);
+        } catch (...) {
+            shm_segment::remove(name);
+            throw;
+        }
+    }
+
+    // opens the existing segment name
+    SharedTemplate(const std::string& name, bool writable)
+        : table(name, key_rtype, value_rtype, writable)
+    {}
+
+    size_type size() const
+    { return table.size(); }
+
+    bool empty() const
+    { return table.size() == 0; }
+
+    std::string name() const
+    { return table.name(); }
+
+    bool writable() const
+    { return table.writable(); }
+
+    int key_sexptype() const
+    { return key_rtype; }
+
+    int value_sexptype() const
+    { return value_rtype; }
+
+    void insert(const key_vec& keys_, const value_vec& values_)
+    {
+        table.check_writable();
+        R_xlen_t nk = keys_.size(), nv = values_.size(), i = 0, n;
+        if (nk != nv) {
+            Rcpp::warning("length(keys) != length(values)!");
+        }
+        n = nk < nv ? nk : nv;
+
+        // a single relocation, rather than one per doubling
+        table.reserve(n, string_bytes(keys_) + string_bytes(values_));
+
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            table.insert(extractor(keys_, i), extractor(values_, i));
+        }
+    }
+
+    void insert(SEXP keys_, SEXP values_)
+    { insert(Rcpp::as<key_vec>(keys_), Rcpp::as<value_vec>(values_)); }
+
+    void erase(const key_vec& keys_)
+    {
+        table.check_writable();
+        R_xlen_t i = 0, n = keys_.size();
+
+        for (; i < n; i++) {
+            HASHMAP_CHECK_INTERRUPT(i, 50000);
+            table.erase(extractor(keys_, i));
+        }
+    }
+
+    void erase(SEXP keys_)
+    { erase(Rcpp::as<key_vec>(keys_)); }
+
+    void clear()
+    {
+        table.check_writable();
+        table.clear();
+    }
+
+    void reserve(int n)
+    {
+        table.check_writable();
+        if (n > 0) table.reserve(n);
+    }
+
+    value_vec find(const key_vec& x)
+    {
+        value_vec res(x.size());
+        lookup(x, &res, 0);
+        return res;
+    }
+
+    value_vec find(SEXP keys_)
+    { return find(Rcpp::as<key_vec>(keys_)); }
+
+    bool has_key(const key_vec& x)
+    {
+        if (!x.size()) return false;
+        key_t k = extractor(x, 0);
+        bool res;
+        table.find(&k, 1, 0, &res);
+        return res;
+    }
+
+    bool has_key(SEXP keys_)
+    { return has_key(Rcpp::as<key_vec>(keys_)); }
+
+    Rcpp::Vector<LGLSXP> has_keys(const key_vec& x)
+    {
+        Rcpp::Vector<LGLSXP> res = Rcpp::no_init_vector(x.size());
+        lookup(x, 0, res.begin());
+        return res;
+    }
+
+    Rcpp::Vector<LGLSXP> has_keys(SEXP keys_)
+    { return has_keys(Rcpp::as<key_vec>(keys_)); }
+
+    Rcpp::DataFrame data()
+    {
+        std::vector<key_t> ks;
+        std::vector<value_t> vs;
+        table.entries(ks, vs);
+
+        return Rcpp::DataFrame::create(
+            Rcpp::Named("Keys") = key_vec(ks.begin(), ks.end()),
+            Rcpp::Named("Values") = value_vec(vs.begin(), vs.end()),
+            Rcpp::Named("stringsAsFactors") = false
+        );
+    }
+
+    key_vec keys()
+    {
+        std::vector<key_t> ks;
+        std::vector<value_t> vs;
+        table.entries(ks, vs);
+        return key_vec(ks.begin(), ks.end());
+    }
+
+    value_vec values()
+    {
+        std::vector<key_t> ks;
+        std::vector<value_t> vs;
+        table.entries(ks, vs);
+        return value_vec(vs.begin(), vs.end());
+    }
+};
+
+} // hashmap
+
+#endif // hashmap__SharedTemplate__hpp
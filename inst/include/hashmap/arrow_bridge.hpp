@@ -0,0 +1,392 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// arrow_bridge.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__arrow_bridge__hpp
+#define hashmap__arrow_bridge__hpp
+
+#include "traits.hpp"
+#include <stdint.h>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// The Arrow C data interface structures, as specified in
+// https://arrow.apache.org/docs/format/CDataInterface.html; the
+// guard lets them coexist with the definitions from arrow/c/abi.h or
+// nanoarrow.h.
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+namespace hashmap {
+namespace arrow {
+
+inline bool get_bit(const void* bits, int64_t i)
+{ return (static_cast<const uint8_t*>(bits)[i >> 3] >> (i & 7)) & 1; }
+
+inline void set_bit(std::vector<uint8_t>& bits, int64_t i, bool x)
+{
+    if ((std::size_t)(i >> 3) >= bits.size()) bits.push_back(0);
+    if (x) bits[i >> 3] |= (uint8_t)(1 << (i & 7));
+}
+
+// Read-only view of a primitive or (large) utf8 array, which must
+// stay alive while the view is used. operator[] returns NA for null
+// slots; strings are copied straight out of the data buffer, so no
+// CHARSXPs are created.
+template <typename T>
+class column;
+
+class column_base {
+protected:
+    const ArrowArray* array;
+
+    column_base(const ArrowSchema* schema, const ArrowArray* array_,
+                int64_t n_buffers)
+        : array(array_)
+    {
+        if (!schema || !array || !schema->release || !array->release) {
+            Rcpp::stop("Invalid (released) Arrow array or schema");
+        }
+        if (array->n_children || array->dictionary ||
+            array->n_buffers != n_buffers) {
+            Rcpp::stop("Unsupported Arrow array layout");
+        }
+    }
+
+    bool is_valid(int64_t i) const
+    {
+        return !array->null_count || !array->buffers[0] ||
+            get_bit(array->buffers[0], i + array->offset);
+    }
+
+    template <typename U>
+    const U* data(int64_t k) const
+    { return static_cast<const U*>(array->buffers[k]); }
+
+public:
+    int64_t size() const
+    { return array->length; }
+};
+
+template <>
+class column<int> : public column_base {
+public:
+    typedef int value_type;
+
+    column(const ArrowSchema* schema, const ArrowArray* array_)
+        : column_base(schema, array_, 2)
+    {}
+
+    int operator[](int64_t i) const
+    {
+        return is_valid(i) ?
+            data<int32_t>(1)[i + array->offset] : NA_INTEGER;
+    }
+};
+
+template <>
+class column<double> : public column_base {
+public:
+    typedef double value_type;
+
+    column(const ArrowSchema* schema, const ArrowArray* array_)
+        : column_base(schema, array_, 2)
+    {}
+
+    double operator[](int64_t i) const
+    {
+        return is_valid(i) ?
+            data<double>(1)[i + array->offset] : NA_REAL;
+    }
+};
+
+template <>
+class column<bool> : public column_base {
+public:
+    typedef bool value_type;
+
+    column(const ArrowSchema* schema, const ArrowArray* array_)
+        : column_base(schema, array_, 2)
+    {}
+
+    bool operator[](int64_t i) const
+    {
+        return is_valid(i) ?
+            get_bit(array->buffers[1], i + array->offset) :
+            traits::get_na<bool>();
+    }
+};
+
+template <>
+class column<std::string> : public column_base {
+private:
+    bool large;
+
+    template <typename O>
+    std::string get(int64_t i) const
+    {
+        const O* offsets = data<O>(1) + array->offset;
+        const char* chars = data<char>(2);
+        return std::string(chars + offsets[i], chars + offsets[i + 1]);
+    }
+
+public:
+    typedef std::string value_type;
+
+    column(const ArrowSchema* schema, const ArrowArray* array_)
+        : column_base(schema, array_, 3),
+          large(schema->format[0] == 'U')
+    {}
+
+    std::string operator[](int64_t i) const
+    {
+        if (!is_valid(i)) return traits::get_na<std::string>();
+        return large ? get<int64_t>(i) : get<int32_t>(i);
+    }
+};
+
+// minimal input iterator over a column, for HashTemplate::insert_range
+template <typename T>
+class column_iterator {
+private:
+    const column<T>* col;
+    int64_t i;
+
+public:
+    column_iterator(const column<T>& col_, int64_t i_)
+        : col(&col_), i(i_)
+    {}
+
+    T operator*() const
+    { return (*col)[i]; }
+
+    column_iterator& operator++()
+    {
+        ++i;
+        return *this;
+    }
+
+    bool operator!=(const column_iterator& other) const
+    { return i != other.i; }
+};
+
+// Accumulates one exported column from the values handed out by
+// HashMap::iterate_raw (see api_traits), then moves its buffers into
+// an ArrowArray / ArrowSchema pair that owns them until released.
+class column_builder {
+private:
+    struct array_data {
+        std::vector<uint8_t> validity;
+        std::vector<uint8_t> values;
+        std::vector<uint8_t> offsets;
+        const void* buffers[3];
+    };
+
+    struct schema_data {
+        std::string format;
+        std::string name;
+    };
+
+    static void release_array(ArrowArray* x)
+    {
+        delete static_cast<array_data*>(x->private_data);
+        x->release = 0;
+    }
+
+    static void release_schema(ArrowSchema* x)
+    {
+        delete static_cast<schema_data*>(x->private_data);
+        x->release = 0;
+    }
+
+    int type;
+    int64_t length;
+    int64_t null_count;
+    std::vector<uint8_t> validity;
+    std::vector<uint8_t> values;
+    std::vector<int64_t> offsets;
+
+    template <typename U>
+    void push_value(const U& x)
+    {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&x);
+        values.insert(values.end(), p, p + sizeof(U));
+    }
+
+    template <typename U>
+    static std::vector<uint8_t> narrow_offsets(const std::vector<int64_t>& x)
+    {
+        std::vector<uint8_t> res(x.size() * sizeof(U));
+        U* p = reinterpret_cast<U*>(res.empty() ? 0 : &res[0]);
+        for (std::size_t i = 0; i < x.size(); i++) {
+            p[i] = (U)x[i];
+        }
+        return res;
+    }
+
+public:
+    // type is the SEXPTYPE of the column (INTSXP, REALSXP, LGLSXP or
+    // STRSXP), n the expected number of elements
+    column_builder(int type_, R_xlen_t n)
+        : type(type_), length(0), null_count(0)
+    {
+        switch (type) {
+            case INTSXP: values.reserve(n * sizeof(int32_t)); break;
+            case REALSXP: values.reserve(n * sizeof(double)); break;
+            case LGLSXP: values.reserve(n / 8 + 1); break;
+            case STRSXP: offsets.reserve(n + 1); offsets.push_back(0); break;
+            default:
+                Rcpp::stop("Cannot export %s columns to Arrow",
+                           Rf_type2char(type));
+        }
+        validity.reserve(n / 8 + 1);
+    }
+
+    void push(const void* x)
+    {
+        bool valid = true;
+
+        switch (type) {
+            case INTSXP: {
+                int32_t v = *static_cast<const int*>(x);
+                valid = v != NA_INTEGER;
+                push_value(v);
+                break;
+            }
+            case REALSXP: {
+                double v = *static_cast<const double*>(x);
+                valid = !R_IsNA(v);
+                push_value(v);
+                break;
+            }
+            case LGLSXP: {
+                int v = *static_cast<const int*>(x);
+                valid = v != NA_LOGICAL;
+                set_bit(values, length, valid && v);
+                break;
+            }
+            case STRSXP: {
+                const char* v = *static_cast<const char* const*>(x);
+                valid = v != 0;
+                if (v) {
+                    const uint8_t* p = reinterpret_cast<const uint8_t*>(v);
+                    values.insert(values.end(), p, p + std::strlen(v));
+                }
+                offsets.push_back((int64_t)values.size());
+                break;
+            }
+        }
+
+        if (!valid) ++null_count;
+        set_bit(validity, length, valid);
+        ++length;
+    }
+
+    // Fills the caller-allocated array and schema; the caller (the
+    // consumer, in Arrow terms) must eventually release both.
+    void finish(ArrowArray* array, ArrowSchema* schema, const char* name)
+    {
+        array_data* ad = new array_data;
+        schema_data* sd = new schema_data;
+
+        if (null_count) ad->validity.swap(validity);
+        ad->values.swap(values);
+
+        switch (type) {
+            case INTSXP: sd->format = "i"; break;
+            case REALSXP: sd->format = "g"; break;
+            case LGLSXP: sd->format = "b"; break;
+            case STRSXP:
+                if (offsets.back() <= INT_MAX) {
+                    sd->format = "u";
+                    ad->offsets = narrow_offsets<int32_t>(offsets);
+                } else {
+                    sd->format = "U";
+                    ad->offsets = narrow_offsets<int64_t>(offsets);
+                }
+                break;
+        }
+        sd->name = name;
+
+        ad->buffers[0] = ad->validity.empty() ? 0 : &ad->validity[0];
+        if (type == STRSXP) {
+            ad->buffers[1] = &ad->offsets[0];
+            // the data buffer must not be NULL, even if all strings
+            // are empty
+            if (ad->values.empty()) ad->values.push_back(0);
+            ad->buffers[2] = &ad->values[0];
+        } else {
+            ad->buffers[1] = ad->values.empty() ? 0 : &ad->values[0];
+            ad->buffers[2] = 0;
+        }
+
+        std::memset(array, 0, sizeof(ArrowArray));
+        array->length = length;
+        array->null_count = null_count;
+        array->n_buffers = type == STRSXP ? 3 : 2;
+        array->buffers = ad->buffers;
+        array->release = release_array;
+        array->private_data = ad;
+
+        std::memset(schema, 0, sizeof(ArrowSchema));
+        schema->format = sd->format.c_str();
+        schema->name = sd->name.c_str();
+        schema->flags = ARROW_FLAG_NULLABLE;
+        schema->release = release_schema;
+        schema->private_data = sd;
+    }
+};
+
+} // arrow
+} // hashmap
+
+#endif // hashmap__arrow_bridge__hpp
@@ -0,0 +1,347 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// batch_hash.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+
+#ifndef hashmap__batch_hash__hpp
+#define hashmap__batch_hash__hpp
+
+#include "key_hash.hpp"
+#include <cstddef>
+
+// AVX2 and SSE4.2 kernels are compiled with target attributes and
+// selected at run time, so the package itself needs no special
+// compiler flags; define HASHMAP_NO_SIMD to build the scalar code
+// only.
+#if !defined(HASHMAP_NO_SIMD) && defined(__x86_64__) &&                \
+    (defined(__clang__) ||                                              \
+     (defined(__GNUC__) && !defined(__INTEL_COMPILER) &&                \
+      (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define HASHMAP_BATCH_AVX2 1
+#define HASHMAP_BATCH_SSE42 1
+#include <immintrin.h>
+#endif
+
+namespace hashmap {
+
+// Hashes of a block of keys, out[i] = Hasher()(x[i]), computed
+// several keys at a time where a vector kernel exists for the
+// (key, hasher) pair: spp_hash<int> (8 keys per AVX2 register, 4 per
+// SSE4.2 register) and double_hash (4 and 2 keys). The results are
+// identical to the scalar hasher's. They are consumed by
+// hash_value(), the Bloom filter pre-check, and the probes of the
+// ordered, frozen and persistent tables, which accept precomputed
+// hashes; the default hash map hashes keys itself.
+template <typename T, typename Hasher>
+struct batch_hasher {
+    enum { vectorized = 0 };
+
+    static void run(const T* x, std::size_t n, std::size_t* out)
+    {
+        Hasher h;
+        for (std::size_t i = 0; i < n; i++) {
+            out[i] = h(x[i]);
+        }
+    }
+};
+
+namespace simd {
+
+#ifdef HASHMAP_BATCH_AVX2
+
+inline bool has_avx2()
+{
+    static const int res = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return res != 0;
+}
+
+// spp_mix_32 on 8 lanes, zero-extended to 64 bits
+__attribute__((target("avx2")))
+inline void hash_int_avx2(const int* x, std::size_t n, std::size_t* out)
+{
+    const __m256i magic = _mm256_set1_epi32((int)0xdeadbeef);
+    std::size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(x + i)
+        );
+        a = _mm256_xor_si256(a, _mm256_srli_epi32(a, 4));
+        a = _mm256_add_epi32(_mm256_xor_si256(a, magic),
+                             _mm256_slli_epi32(a, 5));
+        a = _mm256_xor_si256(a, _mm256_srli_epi32(a, 11));
+
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i*>(out + i),
+            _mm256_cvtepu32_epi64(_mm256_castsi256_si128(a))
+        );
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i*>(out + i + 4),
+            _mm256_cvtepu32_epi64(_mm256_extracti128_si256(a, 1))
+        );
+    }
+
+    spp::spp_hash<int> h;
+    for (; i < n; i++) {
+        out[i] = h(x[i]);
+    }
+}
+
+// low 64 bits of a * b on 4 lanes (AVX2 has no 64-bit multiply)
+__attribute__((target("avx2")))
+inline __m256i mullo64(__m256i a, __m256i b)
+{
+    __m256i lo = _mm256_mul_epu32(a, b);
+    __m256i t1 = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+    __m256i t2 = _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32));
+    return _mm256_add_epi64(
+        lo, _mm256_slli_epi64(_mm256_add_epi64(t1, t2), 32)
+    );
+}
+
+__attribute__((target("avx2")))
+inline __m256i mix64(__m256i x)
+{
+    const __m256i c1 = _mm256_set1_epi64x((long long)0xff51afd7ed558ccdULL);
+    const __m256i c2 = _mm256_set1_epi64x((long long)0xc4ceb93fe53ec26dULL);
+
+    x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+    x = mullo64(x, c1);
+    x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+    x = mullo64(x, c2);
+    return _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+}
+
+// double_hash on 4 lanes. Integers below 2^51 in magnitude are
+// converted with the 1.5 * 2^52 trick; the other lanes hash their bit
+// pattern, except for NaNs and larger integers, which are rare and
+// are redone with the scalar hasher.
+__attribute__((target("avx2")))
+inline void hash_double_avx2(const double* x, std::size_t n,
+                             std::size_t* out)
+{
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d limit = _mm256_set1_pd(2251799813685248.0);   // 2^51
+    const __m256d shift = _mm256_set1_pd(6755399441055744.0);   // 1.5 * 2^52
+    const __m256i shift_bits = _mm256_castpd_si256(shift);
+
+    double_hash h;
+    std::size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(x + i);
+        __m256d t = _mm256_round_pd(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+
+        __m256d integral = _mm256_cmp_pd(t, v, _CMP_EQ_OQ);
+        __m256d small = _mm256_and_pd(
+            integral,
+            _mm256_cmp_pd(_mm256_andnot_pd(sign, v), limit, _CMP_LT_OQ)
+        );
+
+        __m256i as_int = _mm256_sub_epi64(
+            _mm256_castpd_si256(_mm256_add_pd(v, shift)), shift_bits
+        );
+        __m256i key = _mm256_castpd_si256(_mm256_blendv_pd(
+            v, _mm256_castsi256_pd(as_int), small
+        ));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), mix64(key));
+
+        __m256d slow = _mm256_or_pd(
+            _mm256_cmp_pd(v, v, _CMP_UNORD_Q),
+            _mm256_andnot_pd(small, integral)
+        );
+        int mask = _mm256_movemask_pd(slow);
+        for (int j = 0; mask; j++, mask >>= 1) {
+            if (mask & 1) out[i + j] = h(x[i + j]);
+        }
+    }
+
+    for (; i < n; i++) {
+        out[i] = h(x[i]);
+    }
+}
+
+#endif // HASHMAP_BATCH_AVX2
+
+#ifdef HASHMAP_BATCH_SSE42
+
+inline bool has_sse42()
+{
+    static const int res = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    return res != 0;
+}
+
+// hash_int_avx2 on 4 lanes
+__attribute__((target("sse4.2")))
+inline void hash_int_sse42(const int* x, std::size_t n, std::size_t* out)
+{
+    const __m128i magic = _mm_set1_epi32((int)0xdeadbeef);
+    std::size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        a = _mm_xor_si128(a, _mm_srli_epi32(a, 4));
+        a = _mm_add_epi32(_mm_xor_si128(a, magic), _mm_slli_epi32(a, 5));
+        a = _mm_xor_si128(a, _mm_srli_epi32(a, 11));
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i*>(out + i), _mm_cvtepu32_epi64(a)
+        );
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i*>(out + i + 2),
+            _mm_cvtepu32_epi64(_mm_srli_si128(a, 8))
+        );
+    }
+
+    spp::spp_hash<int> h;
+    for (; i < n; i++) {
+        out[i] = h(x[i]);
+    }
+}
+
+__attribute__((target("sse4.2")))
+inline __m128i mullo64_sse42(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_mul_epu32(a, b);
+    __m128i t1 = _mm_mul_epu32(_mm_srli_epi64(a, 32), b);
+    __m128i t2 = _mm_mul_epu32(a, _mm_srli_epi64(b, 32));
+    return _mm_add_epi64(lo, _mm_slli_epi64(_mm_add_epi64(t1, t2), 32));
+}
+
+__attribute__((target("sse4.2")))
+inline __m128i mix64_sse42(__m128i x)
+{
+    const __m128i c1 = _mm_set1_epi64x((long long)0xff51afd7ed558ccdULL);
+    const __m128i c2 = _mm_set1_epi64x((long long)0xc4ceb93fe53ec26dULL);
+
+    x = _mm_xor_si128(x, _mm_srli_epi64(x, 33));
+    x = mullo64_sse42(x, c1);
+    x = _mm_xor_si128(x, _mm_srli_epi64(x, 33));
+    x = mullo64_sse42(x, c2);
+    return _mm_xor_si128(x, _mm_srli_epi64(x, 33));
+}
+
+// hash_double_avx2 on 2 lanes
+__attribute__((target("sse4.2")))
+inline void hash_double_sse42(const double* x, std::size_t n,
+                              std::size_t* out)
+{
+    const __m128d sign = _mm_set1_pd(-0.0);
+    const __m128d limit = _mm_set1_pd(2251799813685248.0);      // 2^51
+    const __m128d shift = _mm_set1_pd(6755399441055744.0);      // 1.5 * 2^52
+    const __m128i shift_bits = _mm_castpd_si128(shift);
+
+    double_hash h;
+    std::size_t i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(x + i);
+        __m128d t = _mm_round_pd(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+
+        __m128d integral = _mm_cmpeq_pd(t, v);
+        __m128d small = _mm_and_pd(
+            integral, _mm_cmplt_pd(_mm_andnot_pd(sign, v), limit)
+        );
+
+        __m128i as_int = _mm_sub_epi64(
+            _mm_castpd_si128(_mm_add_pd(v, shift)), shift_bits
+        );
+        __m128i key = _mm_castpd_si128(_mm_blendv_pd(
+            v, _mm_castsi128_pd(as_int), small
+        ));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                         mix64_sse42(key));
+
+        __m128d slow = _mm_or_pd(
+            _mm_cmpunord_pd(v, v), _mm_andnot_pd(small, integral)
+        );
+        int mask = _mm_movemask_pd(slow);
+        for (int j = 0; mask; j++, mask >>= 1) {
+            if (mask & 1) out[i + j] = h(x[i + j]);
+        }
+    }
+
+    for (; i < n; i++) {
+        out[i] = h(x[i]);
+    }
+}
+
+#endif // HASHMAP_BATCH_SSE42
+
+} // simd
+
+#if !defined(HASHMAP_NO_SPP) && (!defined(__sun) || !defined(__SVR4))
+
+template <>
+struct batch_hasher<int, spp::spp_hash<int> > {
+    enum { vectorized = 1 };
+
+    static void run(const int* x, std::size_t n, std::size_t* out)
+    {
+#ifdef HASHMAP_BATCH_AVX2
+        if (simd::has_avx2()) {
+            simd::hash_int_avx2(x, n, out);
+            return;
+        }
+#endif
+#ifdef HASHMAP_BATCH_SSE42
+        if (simd::has_sse42()) {
+            simd::hash_int_sse42(x, n, out);
+            return;
+        }
+#endif
+        spp::spp_hash<int> h;
+        for (std::size_t i = 0; i < n; i++) {
+            out[i] = h(x[i]);
+        }
+    }
+};
+
+#endif
+
+template <>
+struct batch_hasher<double, double_hash> {
+    enum { vectorized = 1 };
+
+    static void run(const double* x, std::size_t n, std::size_t* out)
+    {
+#ifdef HASHMAP_BATCH_AVX2
+        if (simd::has_avx2()) {
+            simd::hash_double_avx2(x, n, out);
+            return;
+        }
+#endif
+#ifdef HASHMAP_BATCH_SSE42
+        if (simd::has_sse42()) {
+            simd::hash_double_sse42(x, n, out);
+            return;
+        }
+#endif
+        double_hash h;
+        for (std::size_t i = 0; i < n; i++) {
+            out[i] = h(x[i]);
+        }
+    }
+};
+
+} // hashmap
+
+#endif // hashmap__batch_hash__hpp
@@ -0,0 +1,155 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// bloom_filter.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__bloom_filter__hpp
+#define hashmap__bloom_filter__hpp
+
+#include <boost/cstdint.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace hashmap {
+
+// Blocked Bloom filter over 64-bit hashes. Each key maps to a single
+// 64 byte block (one cache line) and sets one bit in each of its
+// eight words, so a query touches one cache line no matter how many
+// bits are tested. The filter cannot forget keys: the owner reports
+// erasures through note_erase() and rebuilds it once stale() or
+// overloaded().
+class bloom_filter {
+public:
+    typedef std::size_t size_type;
+    typedef boost::uint64_t hash_t;
+
+private:
+    typedef boost::uint64_t word_t;
+
+    enum { block_words = 8, block_bits = 512 };
+
+    struct block {
+        word_t w[block_words];
+    };
+
+    std::vector<block> blocks;
+
+    double bits_per_key_;
+    size_type capacity;
+    size_type added;
+    size_type erased;
+
+    static hash_t mix(hash_t x)
+    {
+        x ^= x >> 33;
+        x *= static_cast<hash_t>(0xff51afd7ed558ccdULL);
+        x ^= x >> 33;
+        x *= static_cast<hash_t>(0xc4ceb9fe1a85ec53ULL);
+        x ^= x >> 33;
+        return x;
+    }
+
+    size_type block_of(hash_t h) const
+    { return static_cast<size_type>((h >> 32) % blocks.size()); }
+
+    // bit index (0 - 63) for word i, from the low 32 bits of h
+    static unsigned bit_of(hash_t h, int i)
+    {
+        static const boost::uint32_t salt[block_words] = {
+            0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+            0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+        };
+        return (static_cast<boost::uint32_t>(h) * salt[i]) >> 26;
+    }
+
+public:
+    bloom_filter()
+        : bits_per_key_(0), capacity(0), added(0), erased(0)
+    {}
+
+    bool active() const
+    { return !blocks.empty(); }
+
+    double bits_per_key() const
+    { return bits_per_key_; }
+
+    // sizes the filter for n keys and clears it
+    void reset(size_type n, double bits_per_key)
+    {
+        if (n < 64) n = 64;
+        bits_per_key_ = bits_per_key;
+        capacity = n;
+        added = 0;
+        erased = 0;
+
+        size_type nb = static_cast<size_type>(n * bits_per_key / block_bits) + 1;
+        block e = { { 0, 0, 0, 0, 0, 0, 0, 0 } };
+        blocks.assign(nb, e);
+    }
+
+    void release()
+    {
+        std::vector<block>().swap(blocks);
+        bits_per_key_ = 0;
+        capacity = 0;
+        added = 0;
+        erased = 0;
+    }
+
+    // h is the table's hash of the key; it is remixed here so that
+    // weak (e.g. identity) hashers still spread over the blocks
+    void add(hash_t h)
+    {
+        h = mix(h);
+        block& b = blocks[block_of(h)];
+        for (int i = 0; i < block_words; i++) {
+            b.w[i] |= static_cast<word_t>(1) << bit_of(h, i);
+        }
+        ++added;
+    }
+
+    bool may_contain(hash_t h) const
+    {
+        h = mix(h);
+        const block& b = blocks[block_of(h)];
+        for (int i = 0; i < block_words; i++) {
+            if (!(b.w[i] & (static_cast<word_t>(1) << bit_of(h, i)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void note_erase(size_type n = 1)
+    { erased += n; }
+
+    // more than half of the keys added have since been erased
+    bool stale() const
+    { return erased > 64 && 2 * erased > added; }
+
+    // the false positive rate has drifted well past the target
+    bool overloaded() const
+    { return added - erased > 2 * capacity; }
+
+    size_type memory_usage() const
+    { return blocks.capacity() * sizeof(block); }
+};
+
+} // hashmap
+
+#endif // hashmap__bloom_filter__hpp
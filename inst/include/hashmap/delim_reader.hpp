@@ -0,0 +1,211 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// delim_reader.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__delim_reader__hpp
+#define hashmap__delim_reader__hpp
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hashmap {
+
+// Reads a delimited text file through a fixed-size buffer, handing
+// out one chunk of complete lines at a time, so that memory use does
+// not depend on the size of the file. A line which does not fit in
+// the buffer grows it. Fields may be enclosed in double quotes (with
+// "" as an escaped quote) to protect separators, but quoted fields
+// may not span lines. Nothing here uses the R API, so the lines of a
+// chunk can be split into fields concurrently.
+class delim_reader {
+public:
+    typedef std::pair<const char*, const char*> span;
+
+private:
+    std::FILE* file;
+    std::vector<char> buf;
+
+    // buf[0, used) holds data, of which the first consumed bytes
+    // were handed out by the previous call to next_chunk
+    std::size_t used;
+    std::size_t consumed;
+    bool eof;
+
+    delim_reader(const delim_reader&);
+    delim_reader& operator=(const delim_reader&);
+
+    void fill()
+    {
+        if (used == buf.size()) buf.resize(buf.size() * 2);
+
+        std::size_t n = std::fread(&buf[used], 1, buf.size() - used, file);
+        used += n;
+
+        if (n == 0) {
+            if (std::ferror(file)) {
+                throw std::runtime_error("error reading file");
+            }
+            eof = true;
+        }
+    }
+
+public:
+    delim_reader(const std::string& path, std::size_t buffer_size)
+        : file(std::fopen(path.c_str(), "rb")),
+          buf(buffer_size > 0 ? buffer_size : 1),
+          used(0),
+          consumed(0),
+          eof(false)
+    {
+        if (!file) {
+            throw std::runtime_error("cannot open file '" + path + "'");
+        }
+    }
+
+    ~delim_reader()
+    { std::fclose(file); }
+
+    // Replaces lines with the next chunk of lines (without their line
+    // terminators, and skipping empty ones); returns false once the
+    // file is exhausted. The spans are valid until the next call.
+    bool next_chunk(std::vector<span>& lines)
+    {
+        lines.clear();
+        discard();
+
+        while (lines.empty()) {
+            if (!eof) fill();
+            if (!used) return false;
+
+            const char* first = &buf[0];
+            const char* last = first + used;
+            const char* pos = first;
+
+            for (;;) {
+                const char* nl = static_cast<const char*>(
+                    std::memchr(pos, '\n', last - pos)
+                );
+                if (!nl) {
+                    // final line without a terminator
+                    if (eof && pos != last) {
+                        push(lines, pos, last);
+                        pos = last;
+                    }
+                    break;
+                }
+                push(lines, pos, nl);
+                pos = nl + 1;
+            }
+
+            consumed = pos - first;
+
+            // only blank lines so far
+            if (lines.empty()) discard();
+            if (lines.empty() && eof && !used) return false;
+        }
+
+        return true;
+    }
+
+    // Locates field col (0-based) of the line [first, last); returns
+    // false if the line has fewer fields.
+    static bool find_field(const char* first, const char* last,
+                           char sep, std::size_t col, span& out)
+    {
+        std::size_t k = 0;
+
+        for (;;) {
+            const char* end = field_end(first, last, sep);
+            if (k == col) {
+                out = span(first, end);
+                return true;
+            }
+            if (end == last) return false;
+            first = end + 1;
+            ++k;
+        }
+    }
+
+    // the contents of a field, without enclosing quotes and with ""
+    // unescaped
+    static std::string unquote(const span& x)
+    {
+        const char* first = x.first;
+        const char* last = x.second;
+
+        if (last - first < 2 || *first != '"' || *(last - 1) != '"') {
+            return std::string(first, last);
+        }
+
+        std::string res;
+        res.reserve(last - first - 2);
+
+        for (++first, --last; first != last; ++first) {
+            res.push_back(*first);
+            if (*first == '"' && first + 1 != last && *(first + 1) == '"') {
+                ++first;
+            }
+        }
+
+        return res;
+    }
+
+private:
+    void discard()
+    {
+        if (!consumed) return;
+        std::memmove(&buf[0], &buf[consumed], used - consumed);
+        used -= consumed;
+        consumed = 0;
+    }
+
+    static void push(std::vector<span>& lines,
+                     const char* first, const char* last)
+    {
+        if (last != first && *(last - 1) == '\r') --last;
+        if (last != first) lines.push_back(span(first, last));
+    }
+
+    static const char* field_end(const char* first, const char* last,
+                                 char sep)
+    {
+        if (first != last && *first == '"') {
+            for (++first; first != last; ++first) {
+                if (*first != '"') continue;
+                if (first + 1 != last && *(first + 1) == '"') {
+                    ++first;
+                    continue;
+                }
+                ++first;
+                break;
+            }
+        }
+
+        while (first != last && *first != sep) ++first;
+        return first;
+    }
+};
+
+} // hashmap
+
+#endif // hashmap__delim_reader__hpp
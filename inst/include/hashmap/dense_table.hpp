@@ -0,0 +1,345 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// dense_table.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__dense_table__hpp
+#define hashmap__dense_table__hpp
+
+#include <boost/container/vector.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace hashmap {
+
+// Insertion-ordered key / value storage (incremental / ordered
+// mode), laid out like a "compact dict": keys and values live in
+// two dense columns in insertion order, and a small open addressing
+// index maps hashes to column slots. Index buckets hold only a slot
+// number and 32 bits of the key's hash, so keys are not duplicated.
+//
+// New keys are appended, existing keys are overwritten in place, and
+// erased slots become tombstones which are removed by compact() once
+// they make up more than half of the columns; compaction preserves
+// insertion order.
+//
+// The columns are boost::container::vectors because the value
+// column holds bool for logical values, and value() hands out
+// references into it, which std::vector<bool> cannot provide.
+template <typename KeyType, typename ValueType,
+          typename Hasher, typename KeyEqual = std::equal_to<KeyType> >
+class dense_table {
+public:
+    typedef KeyType key_t;
+    typedef ValueType value_t;
+    typedef Hasher hasher;
+    typedef KeyEqual key_equal;
+    typedef std::size_t size_type;
+
+private:
+    typedef boost::uint32_t slot_t;
+
+    struct bucket {
+        slot_t slot;
+        slot_t tag;
+    };
+
+    enum { min_compact = 64, min_buckets = 16 };
+
+    static slot_t empty_slot()
+    { return static_cast<slot_t>(-1); }
+
+    boost::container::vector<key_t> kcol;
+    boost::container::vector<value_t> vcol;
+    boost::container::vector<unsigned char> live_;
+
+    std::vector<bucket> index;
+    size_type mask;
+    size_type dead;
+
+    hasher hash;
+    key_equal eq;
+
+    static slot_t tag_of(std::size_t h)
+    { return static_cast<slot_t>(h); }
+
+    // returns the bucket holding k, or the empty bucket where k
+    // would be placed
+    size_type probe(const key_t& k, slot_t tag) const
+    {
+        size_type i = tag & mask;
+        for (;;) {
+            const bucket& b = index[i];
+            if (b.slot == empty_slot()) return i;
+            if (b.tag == tag && eq(kcol[b.slot], k)) return i;
+            i = (i + 1) & mask;
+        }
+    }
+
+    void grow(size_type n)
+    {
+        size_type cap = min_buckets;
+        while (cap < 2 * n) cap *= 2;
+        if (cap <= index.size()) return;
+
+        std::vector<bucket> old;
+        old.swap(index);
+
+        bucket e = { empty_slot(), 0 };
+        index.assign(cap, e);
+        mask = cap - 1;
+
+        for (size_type j = 0; j < old.size(); j++) {
+            if (old[j].slot == empty_slot()) continue;
+            size_type i = old[j].tag & mask;
+            while (index[i].slot != empty_slot()) i = (i + 1) & mask;
+            index[i] = old[j];
+        }
+    }
+
+    // backward shift deletion, so that no index tombstones are needed
+    void unlink(size_type i)
+    {
+        size_type j = i;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (index[j].slot == empty_slot()) break;
+
+            size_type ideal = index[j].tag & mask;
+            bool stays = (i <= j) ?
+                (i < ideal && ideal <= j) :
+                (i < ideal || ideal <= j);
+
+            if (!stays) {
+                index[i] = index[j];
+                i = j;
+            }
+        }
+        index[i].slot = empty_slot();
+    }
+
+    void compact()
+    {
+        size_type i = 0, j = 0, n = kcol.size();
+        std::vector<slot_t> remap(n, empty_slot());
+
+        for (; i < n; i++) {
+            if (!live_[i]) continue;
+            if (i != j) {
+                kcol[j] = kcol[i];
+                vcol[j] = vcol[i];
+            }
+            remap[i] = static_cast<slot_t>(j++);
+        }
+
+        kcol.resize(j);
+        vcol.resize(j);
+        live_.assign(j, 1);
+        dead = 0;
+
+        for (i = 0; i < index.size(); i++) {
+            if (index[i].slot == empty_slot()) continue;
+            index[i].slot = remap[index[i].slot];
+        }
+    }
+
+public:
+    dense_table()
+        : mask(0), dead(0)
+    {}
+
+    size_type size() const
+    { return kcol.size() - dead; }
+
+    bool empty() const
+    { return size() == 0; }
+
+    size_type slots() const
+    { return kcol.size(); }
+
+    size_type tombstones() const
+    { return dead; }
+
+    bool live(size_type i) const
+    { return live_[i] != 0; }
+
+    const key_t& key(size_type i) const
+    { return kcol[i]; }
+
+    const value_t& value(size_type i) const
+    { return vcol[i]; }
+
+    value_t& value(size_type i)
+    { return vcol[i]; }
+
+    size_type bucket_count() const
+    { return index.size(); }
+
+    void rehash(size_type n)
+    { grow(n / 2 > size() ? n / 2 : size()); }
+
+    void reserve(size_type n)
+    {
+        kcol.reserve(n);
+        vcol.reserve(n);
+        live_.reserve(n);
+        grow(n);
+    }
+
+    void clear()
+    {
+        kcol.clear();
+        vcol.clear();
+        live_.clear();
+        std::vector<bucket>().swap(index);
+        mask = 0;
+        dead = 0;
+    }
+
+    void swap(dense_table& other)
+    {
+        kcol.swap(other.kcol);
+        vcol.swap(other.vcol);
+        live_.swap(other.live_);
+        index.swap(other.index);
+        std::swap(mask, other.mask);
+        std::swap(dead, other.dead);
+    }
+
+    const value_t* find(const key_t& k) const
+    { return find(k, hash(k)); }
+
+    // find() given h = hasher()(k), e.g. from batch_hasher
+    const value_t* find(const key_t& k, std::size_t h) const
+    {
+        if (index.empty()) return 0;
+
+        const bucket& b = index[probe(k, tag_of(h))];
+        if (b.slot == empty_slot()) return 0;
+        return &vcol[b.slot];
+    }
+
+    // returns true if k was not previously present
+    bool insert(const key_t& k, const value_t& v)
+    { return insert(k, v, hash(k)); }
+
+    // insert() given h = hasher()(k)
+    bool insert(const key_t& k, const value_t& v, std::size_t h)
+    {
+        if (2 * (size() + 1) > index.size()) grow(size() + 1);
+
+        slot_t tag = tag_of(h);
+        size_type i = probe(k, tag);
+
+        if (index[i].slot != empty_slot()) {
+            vcol[index[i].slot] = v;
+            return false;
+        }
+
+        if (kcol.size() >= (size_type)empty_slot()) {
+            if (dead) {
+                compact();
+                i = probe(k, tag);
+            } else {
+                throw std::length_error("dense_table: too many entries");
+            }
+        }
+
+        index[i].slot = static_cast<slot_t>(kcol.size());
+        index[i].tag = tag;
+
+        kcol.push_back(k);
+        vcol.push_back(v);
+        live_.push_back(1);
+
+        return true;
+    }
+
+    // returns true if k was present
+    bool erase(const key_t& k)
+    {
+        if (index.empty()) return false;
+
+        size_type i = probe(k, tag_of(hash(k)));
+        if (index[i].slot == empty_slot()) return false;
+
+        size_type slot = index[i].slot;
+        unlink(i);
+
+        if (slot + 1 == kcol.size()) {
+            kcol.pop_back();
+            vcol.pop_back();
+            live_.pop_back();
+            return true;
+        }
+
+        kcol[slot] = key_t();
+        vcol[slot] = value_t();
+        live_[slot] = 0;
+        ++dead;
+
+        if (dead > (size_type)min_compact && dead > kcol.size() / 2) {
+            compact();
+        }
+
+        return true;
+    }
+
+    // erases the entries for which f(key, value) is true in a single
+    // pass over the columns, compacting at most once; returns the
+    // number erased
+    template <typename F>
+    size_type erase_if(const F& f)
+    {
+        size_type i = 0, n = 0, ns = kcol.size();
+
+        for (; i < ns; i++) {
+            if (!live_[i] || !f(kcol[i], vcol[i])) continue;
+
+            unlink(probe(kcol[i], tag_of(hash(kcol[i]))));
+            kcol[i] = key_t();
+            vcol[i] = value_t();
+            live_[i] = 0;
+            ++dead;
+            ++n;
+        }
+
+        if (dead > (size_type)min_compact && dead > kcol.size() / 2) {
+            compact();
+        }
+
+        return n;
+    }
+
+    // approximate heap usage, in bytes
+    size_type memory_usage() const
+    {
+        return kcol.capacity() * sizeof(key_t) +
+            vcol.capacity() * sizeof(value_t) +
+            live_.capacity() +
+            index.capacity() * sizeof(bucket);
+    }
+};
+
+} // hashmap
+
+#endif // hashmap__dense_table__hpp
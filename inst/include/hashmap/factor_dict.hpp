@@ -0,0 +1,512 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// factor_dict.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__factor_dict__hpp
+#define hashmap__factor_dict__hpp
+
+#include <Rcpp.h>
+#include <boost/unordered_map.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace hashmap {
+
+// Level dictionary of a factor key or value column. The table stores
+// the integer codes, and the dictionary translates incoming factors
+// (whose levels may differ) and character vectors into those codes,
+// so that lookups hash integers rather than strings. Levels are only
+// ever appended, so existing codes remain valid.
+//
+// Character values with few distinct strings are stored the same way
+// (see encode()), in an encoded dictionary: the table then holds a
+// 32-bit code per entry instead of a std::string, and its values are
+// marked so that the HashMap layer returns them as character vectors
+// built from the level CHARSXPs (see decode()). As plain character
+// values store NA as the string "NA", an encoded dictionary stores it
+// as the level "NA", and other values are coerced to character.
+class factor_dict {
+public:
+    // encode() keeps character vectors shorter than min_encoded_size,
+    // or with more than one distinct string per max_encoded_ratio
+    // elements or more than max_encoded_levels in all, as they are
+    enum { min_encoded_size = 1024 };
+    enum { max_encoded_ratio = 8 };
+    enum { max_encoded_levels = 65536 };
+
+private:
+    Rcpp::RObject levels_;
+    boost::unordered_map<std::string, int> codes;
+    bool encoded_;
+    // code of the level "NA", or 0 if there is none
+    int na_code_;
+
+    static SEXP encoded_symbol()
+    {
+        static SEXP sym = Rf_install("hashmap.encoded");
+        return sym;
+    }
+
+    static bool is_encoded(SEXP x)
+    {
+        return TYPEOF(x) == INTSXP &&
+            Rf_getAttrib(x, encoded_symbol()) != R_NilValue;
+    }
+
+    // the CHARSXP "NA", which stands for NA in encoded values
+    static SEXP na_string()
+    {
+        static SEXP res = 0;
+        if (!res) {
+            res = Rf_mkChar("NA");
+            R_PreserveObject(res);
+        }
+        return res;
+    }
+
+    void index()
+    {
+        codes.clear();
+        na_code_ = 0;
+        if (levels_.isNULL()) return;
+
+        SEXP lv = levels_;
+        R_xlen_t i = 0, n = XLENGTH(lv);
+        for (; i < n; i++) {
+            codes[CHAR(STRING_ELT(lv, i))] = (int)(i + 1);
+        }
+
+        boost::unordered_map<std::string, int>::const_iterator pos =
+            codes.find("NA");
+        if (pos != codes.end()) na_code_ = pos->second;
+    }
+
+    // code of level x, or 0 if it is absent and !extend
+    int code(SEXP x, bool extend, std::vector<SEXP>& added)
+    {
+        if (x == NA_STRING) {
+            if (!encoded_) return NA_INTEGER;
+            x = na_string();
+        }
+
+        const char* s = CHAR(x);
+        boost::unordered_map<std::string, int>::const_iterator pos =
+            codes.find(s);
+        if (pos != codes.end()) return pos->second;
+        if (!extend) return 0;
+
+        int res = (int)(codes.size() + 1);
+        codes[s] = res;
+        if (!std::strcmp(s, "NA")) na_code_ = res;
+        added.push_back(x);
+        return res;
+    }
+
+    // (an absent "NA" level is NA in an encoded dictionary, so that
+    // an NA operand matches nothing, as for plain values)
+    int code(SEXP x) const
+    {
+        if (x == NA_STRING) {
+            if (!encoded_) return NA_INTEGER;
+            return na_code_ ? na_code_ : NA_INTEGER;
+        }
+
+        boost::unordered_map<std::string, int>::const_iterator pos =
+            codes.find(CHAR(x));
+        if (pos != codes.end()) return pos->second;
+        return encoded_ && !std::strcmp(CHAR(x), "NA") ? NA_INTEGER : 0;
+    }
+
+    // x as a character vector, for an encoded dictionary
+    static SEXP as_character(SEXP x)
+    {
+        if (Rf_isFactor(x)) return Rf_asCharacterFactor(x);
+        return Rf_coerceVector(x, STRSXP);
+    }
+
+    void append(const std::vector<SEXP>& added)
+    {
+        if (added.empty()) return;
+
+        SEXP lv = levels_;
+        R_xlen_t i = 0, n = XLENGTH(lv), m = added.size();
+        Rcpp::CharacterVector res(n + m);
+
+        for (; i < n; i++) {
+            res[i] = STRING_ELT(lv, i);
+        }
+        for (i = 0; i < m; i++) {
+            res[n + i] = added[i];
+        }
+
+        // a new vector, since copies of the table may share the old one
+        levels_ = res;
+    }
+
+    bool same_levels(SEXP lv) const
+    {
+        SEXP own = levels_;
+        if (lv == own) return true;
+
+        R_xlen_t i = 0, n = XLENGTH(own);
+        if (XLENGTH(lv) != n) return false;
+
+        // CHARSXPs are cached, so equal strings are the same pointer
+        for (; i < n; i++) {
+            if (STRING_ELT(lv, i) != STRING_ELT(own, i)) return false;
+        }
+        return true;
+    }
+
+public:
+    factor_dict()
+        : levels_(R_NilValue),
+          encoded_(false),
+          na_code_(0)
+    {}
+
+    // active iff x is a factor, and encoded if x came from encode()
+    explicit factor_dict(SEXP x)
+        : levels_(R_NilValue),
+          encoded_(false),
+          na_code_(0)
+    {
+        if (Rf_isFactor(x)) {
+            levels_ = Rf_getAttrib(x, R_LevelsSymbol);
+            encoded_ = is_encoded(x);
+        }
+        index();
+    }
+
+    bool active() const
+    { return !levels_.isNULL(); }
+
+    bool encoded() const
+    { return encoded_; }
+
+    // whether x is the code of NA (stored as "NA") in an encoded
+    // dictionary; codes of plain factors are NA when NA_INTEGER
+    bool is_na_code(int x) const
+    { return encoded_ && na_code_ && x == na_code_; }
+
+    template <typename T>
+    bool is_na_code(const T&) const
+    { return false; }
+
+    // The level of code x, or NULL if there is none; for the C API,
+    // which must not allocate.
+    const char* level_chars(int x) const
+    {
+        SEXP lv = levels_;
+        if (!active() || x < 1 || x > XLENGTH(lv)) return 0;
+        return CHAR(STRING_ELT(lv, x - 1));
+    }
+
+    template <typename T>
+    const char* level_chars(const T&) const
+    { return 0; }
+
+    // the level of code x as a string (for the journal, which records
+    // encoded values as plain character values); "NA" if there is none
+    template <typename T>
+    std::string level(const T& x) const
+    {
+        const char* res = level_chars(x);
+        return res ? res : "NA";
+    }
+
+    // The code of the level s (NULL being NA, i.e. "NA" if encoded),
+    // or 0 if it is absent; as level_chars, this does not allocate
+    // R objects.
+    int find_code(const char* s) const
+    {
+        if (!s) {
+            if (!encoded_) return NA_INTEGER;
+            s = "NA";
+        }
+
+        boost::unordered_map<std::string, int>::const_iterator pos =
+            codes.find(s);
+        return pos != codes.end() ? pos->second : 0;
+    }
+
+    // The code of the level s, which is appended to the dictionary if
+    // it is new. Such levels are only collected in added, and must be
+    // installed by append(added), so that many of them (as when a
+    // journal is replayed) are added in one step.
+    int code(const std::string& s, std::vector<std::string>& added)
+    {
+        boost::unordered_map<std::string, int>::const_iterator pos =
+            codes.find(s);
+        if (pos != codes.end()) return pos->second;
+
+        int res = (int)(codes.size() + 1);
+        codes[s] = res;
+        if (s == "NA") na_code_ = res;
+        added.push_back(s);
+        return res;
+    }
+
+    void append(const std::vector<std::string>& added)
+    {
+        if (added.empty()) return;
+
+        SEXP lv = levels_;
+        R_xlen_t i = 0, n = XLENGTH(lv), m = added.size();
+        Rcpp::CharacterVector res(n + m);
+
+        for (; i < n; i++) {
+            res[i] = STRING_ELT(lv, i);
+        }
+        for (i = 0; i < m; i++) {
+            res[n + i] = Rf_mkChar(added[i].c_str());
+        }
+
+        levels_ = res;
+    }
+
+    SEXP levels() const
+    { return levels_; }
+
+    bool same_levels(const factor_dict& other) const
+    {
+        if (!active() || !other.active()) return active() == other.active();
+        return same_levels(other.levels_);
+    }
+
+    // x as codes of this dictionary, if it is active and x is a
+    // factor or character vector (otherwise x itself, unless the
+    // dictionary is encoded, which reads anything as character);
+    // unknown levels become 0, which matches no key
+    SEXP recode(SEXP x) const
+    {
+        if (!active()) return x;
+
+        if (encoded_ && TYPEOF(x) != STRSXP) {
+            Rcpp::RObject tmp(as_character(x));
+            return recode(tmp);
+        }
+
+        if (Rf_isFactor(x)) {
+            SEXP lv = Rf_getAttrib(x, R_LevelsSymbol);
+            if (same_levels(lv)) return x;
+
+            R_xlen_t i = 0, m = XLENGTH(lv);
+            std::vector<int> tr(m + 1);
+            for (; i < m; i++) {
+                tr[i + 1] = code(STRING_ELT(lv, i));
+            }
+            return remap(x, tr);
+        }
+
+        if (TYPEOF(x) == STRSXP) {
+            R_xlen_t i = 0, n = XLENGTH(x);
+            Rcpp::IntegerVector res = Rcpp::no_init_vector(n);
+            for (; i < n; i++) {
+                res[i] = code(STRING_ELT(x, i));
+            }
+            return res;
+        }
+
+        return x;
+    }
+
+    // as recode, but appends unknown levels to the dictionary
+    SEXP recode_extend(SEXP x)
+    {
+        if (!active()) return x;
+        std::vector<SEXP> added;
+
+        if (encoded_ && TYPEOF(x) != STRSXP) {
+            Rcpp::RObject tmp(as_character(x));
+            return recode_extend(tmp);
+        }
+
+        if (Rf_isFactor(x)) {
+            SEXP lv = Rf_getAttrib(x, R_LevelsSymbol);
+            if (same_levels(lv)) return x;
+
+            R_xlen_t i = 0, m = XLENGTH(lv);
+            std::vector<int> tr(m + 1);
+            for (; i < m; i++) {
+                tr[i + 1] = code(STRING_ELT(lv, i), true, added);
+            }
+            append(added);
+            return remap(x, tr);
+        }
+
+        if (TYPEOF(x) == STRSXP) {
+            R_xlen_t i = 0, n = XLENGTH(x);
+            Rcpp::IntegerVector res = Rcpp::no_init_vector(n);
+            for (; i < n; i++) {
+                res[i] = code(STRING_ELT(x, i), true, added);
+            }
+            append(added);
+            return res;
+        }
+
+        return x;
+    }
+
+    // Appends the levels of other that this dictionary lacks, and
+    // returns the table translating other's codes into ours (indexed
+    // by code), or an empty table if none is needed
+    std::vector<int> merge(const factor_dict& other)
+    {
+        std::vector<int> tr;
+        if (!active() || !other.active() || same_levels(other)) return tr;
+
+        std::vector<SEXP> added;
+        SEXP lv = other.levels_;
+        R_xlen_t i = 0, m = XLENGTH(lv);
+
+        tr.resize(m + 1);
+        for (; i < m; i++) {
+            tr[i + 1] = code(STRING_ELT(lv, i), true, added);
+        }
+        append(added);
+
+        return tr;
+    }
+
+    // code x of another dictionary, through a table from merge()
+    static int translate(int x, const std::vector<int>& tr)
+    {
+        if (tr.empty() || x == NA_INTEGER) return x;
+        return x >= 1 && x < (int)tr.size() ? tr[x] : 0;
+    }
+
+    // marks x as a factor with these levels (and as encoded, if the
+    // dictionary is)
+    void set_attr(SEXP x) const
+    {
+        if (!active()) return;
+        Rf_setAttrib(x, R_LevelsSymbol, levels_);
+        Rf_setAttrib(x, R_ClassSymbol, Rf_mkString("factor"));
+        if (encoded_) {
+            Rf_setAttrib(x, encoded_symbol(), Rf_ScalarLogical(TRUE));
+        }
+    }
+
+    // A character vector x as codes into its distinct strings (in
+    // order of appearance, NA being "NA"), marked as encoded, if it
+    // has few enough distinct strings (see min_encoded_size above) or
+    // force is set; otherwise x itself, as is anything else. Strings
+    // are told apart by their CHARSXP, which R caches, so that each is
+    // hashed as a pointer.
+    static SEXP encode(SEXP x, bool force = false)
+    {
+        if (TYPEOF(x) != STRSXP) return x;
+
+        R_xlen_t i = 0, n = XLENGTH(x), limit = n;
+        if (!force) {
+            if (n < min_encoded_size) return x;
+            limit = n / max_encoded_ratio;
+            if (limit > max_encoded_levels) limit = max_encoded_levels;
+        }
+
+        boost::unordered_map<SEXP, int> seen;
+        std::vector<SEXP> lv;
+        Rcpp::IntegerVector res = Rcpp::no_init_vector(n);
+        int* pres = res.begin();
+
+        for (; i < n; i++) {
+            SEXP s = STRING_ELT(x, i);
+            if (s == NA_STRING) s = na_string();
+
+            std::pair<boost::unordered_map<SEXP, int>::iterator, bool> pos =
+                seen.insert(std::make_pair(s, (int)lv.size() + 1));
+            if (pos.second) {
+                if ((R_xlen_t)lv.size() == limit) return x;
+                lv.push_back(s);
+            }
+            pres[i] = pos.first->second;
+        }
+
+        Rcpp::CharacterVector levels(lv.size());
+        for (i = 0; i < (R_xlen_t)lv.size(); i++) {
+            SET_STRING_ELT(levels, i, lv[i]);
+        }
+
+        Rf_setAttrib(res, R_LevelsSymbol, levels);
+        Rf_setAttrib(res, R_ClassSymbol, Rf_mkString("factor"));
+        Rf_setAttrib(res, encoded_symbol(), Rf_ScalarLogical(TRUE));
+        return res;
+    }
+
+    // x with encoded codes expanded back into character, each element
+    // being the CHARSXP of its level: a vector marked by set_attr()
+    // (keeping its names), or a list, such as a data.frame, of
+    // columns which may be; anything else is returned as it is
+    static SEXP decode(SEXP x)
+    {
+        Rcpp::RObject guard(x);
+
+        if (TYPEOF(x) == VECSXP) {
+            R_xlen_t i = 0, n = XLENGTH(x);
+            for (; i < n; i++) {
+                SEXP col = VECTOR_ELT(x, i);
+                if (is_encoded(col)) SET_VECTOR_ELT(x, i, decode(col));
+            }
+            return x;
+        }
+
+        if (!is_encoded(x)) return x;
+
+        SEXP lv = Rf_getAttrib(x, R_LevelsSymbol);
+        R_xlen_t i = 0, n = XLENGTH(x), m = XLENGTH(lv);
+        const int* px = INTEGER(x);
+        Rcpp::CharacterVector res(n);
+
+        for (; i < n; i++) {
+            SET_STRING_ELT(
+                res, i,
+                px[i] >= 1 && px[i] <= m ? STRING_ELT(lv, px[i] - 1) :
+                    NA_STRING
+            );
+        }
+
+        Rf_setAttrib(res, R_NamesSymbol, Rf_getAttrib(x, R_NamesSymbol));
+        return res;
+    }
+
+private:
+    // codes of factor x through the level translation table tr
+    static SEXP remap(SEXP x, const std::vector<int>& tr)
+    {
+        R_xlen_t i = 0, n = XLENGTH(x);
+        int m = (int)tr.size() - 1;
+        const int* px = INTEGER(x);
+        Rcpp::IntegerVector res = Rcpp::no_init_vector(n);
+
+        for (; i < n; i++) {
+            if (px[i] == NA_INTEGER) {
+                res[i] = NA_INTEGER;
+            } else {
+                res[i] = px[i] >= 1 && px[i] <= m ? tr[px[i]] : 0;
+            }
+        }
+        return res;
+    }
+};
+
+} // hashmap
+
+#endif // hashmap__factor_dict__hpp
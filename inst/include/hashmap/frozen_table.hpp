@@ -0,0 +1,351 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// frozen_table.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__frozen_table__hpp
+#define hashmap__frozen_table__hpp
+
+#include <boost/container/vector.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace hashmap {
+
+// Immutable key / value storage addressed by a minimal perfect hash
+// function (see freeze()). The construction follows the "hash and
+// displace" / PTHash scheme: keys are split into buckets of ~4 keys,
+// and each bucket stores a small pilot value chosen so that all of
+// its keys land in distinct, unused slots of a table ~1% larger than
+// the number of keys. Slots past the end are then remapped into the
+// holes left at the front, so the entries occupy exactly size()
+// slots. A lookup costs one pilot read plus one entry read, and the
+// stored key is compared to reject keys that are not in the table.
+//
+// The hash function is built over keys with distinct hasher()
+// values; keys whose hasher() value equals that of another key (which
+// no seed can separate) go to a small overflow range after the hashed
+// one, sorted by hash, which a lookup searches only when the key in
+// its slot does not match.
+//
+// Keys which compare unequal to themselves under KeyEqual can never
+// be found, so they are kept past the overflow range purely for
+// iteration. The numeric tables compare with double_equal, under
+// which NA and NaN each equal themselves, so this only applies to
+// tables built with a plain operator== over such values.
+template <typename KeyType, typename ValueType,
+          typename Hasher, typename KeyEqual = std::equal_to<KeyType> >
+class frozen_table {
+public:
+    typedef KeyType key_t;
+    typedef ValueType value_t;
+    typedef Hasher hasher;
+    typedef KeyEqual key_equal;
+    typedef std::size_t size_type;
+
+private:
+    typedef boost::uint64_t hash_t;
+    typedef boost::uint32_t pilot_t;
+
+    struct entry {
+        key_t key;
+        value_t value;
+    };
+
+    enum { bucket_load = 4, max_attempts = 16 };
+
+    std::vector<entry> entries;
+    std::vector<pilot_t> pilots;
+    std::vector<pilot_t> remap;
+    // hasher() values of the overflow entries, which follow the
+    // nkeys hashed ones
+    std::vector<std::size_t> overflow;
+
+    hash_t seed;
+    size_type nkeys;
+    size_type nslots;
+
+    hasher hash;
+    key_equal eq;
+
+    static hash_t mix(hash_t x)
+    {
+        x ^= x >> 30;
+        x *= static_cast<hash_t>(0xbf58476d1ce4e5b9ULL);
+        x ^= x >> 27;
+        x *= static_cast<hash_t>(0x94d049bb133111ebULL);
+        x ^= x >> 31;
+        return x;
+    }
+
+    // h = hasher()(k), mixed with the seed of the current build
+    hash_t seeded(std::size_t h) const
+    { return mix(static_cast<hash_t>(h) ^ seed); }
+
+    hash_t hash_of(const key_t& k) const
+    { return seeded(hash(k)); }
+
+    size_type bucket_of(hash_t h) const
+    { return static_cast<size_type>((h >> 32) % pilots.size()); }
+
+    size_type position(hash_t h, pilot_t pilot) const
+    { return static_cast<size_type>(mix(h ^ mix(pilot + 1)) % nslots); }
+
+    size_type slot_of(hash_t h) const
+    {
+        size_type p = position(h, pilots[bucket_of(h)]);
+        return p < nkeys ? p : remap[p - nkeys];
+    }
+
+    // returns false if some bucket could not be placed with this seed
+    bool try_build(const std::vector<hash_t>& hashes,
+                   std::vector<size_type>& slot)
+    {
+        size_type n = hashes.size(), nb = pilots.size(), i, b;
+
+        // bucket the keys with a counting sort
+        std::vector<size_type> start(nb + 1, 0), order(n);
+        for (i = 0; i < n; i++) start[bucket_of(hashes[i]) + 1]++;
+        for (b = 0; b < nb; b++) start[b + 1] += start[b];
+
+        std::vector<size_type> fill(start.begin(), start.end() - 1);
+        for (i = 0; i < n; i++) order[fill[bucket_of(hashes[i])]++] = i;
+
+        // place larger buckets first
+        std::vector<size_type> by_size(nb);
+        for (b = 0; b < nb; b++) by_size[b] = b;
+        std::stable_sort(by_size.begin(), by_size.end(), larger(start));
+
+        std::vector<unsigned char> taken(nslots, 0);
+        std::vector<size_type> tmp;
+
+        for (size_type j = 0; j < nb; j++) {
+            b = by_size[j];
+            size_type first = start[b], last = start[b + 1];
+            if (first == last) break;
+
+            pilot_t pilot = 0;
+            for (;; pilot++) {
+                if (pilot == static_cast<pilot_t>(1) << 22) return false;
+
+                tmp.clear();
+                size_type k = first;
+                for (; k < last; k++) {
+                    size_type p = position(hashes[order[k]], pilot);
+                    if (taken[p] ||
+                            std::find(tmp.begin(), tmp.end(), p) != tmp.end()) {
+                        break;
+                    }
+                    tmp.push_back(p);
+                }
+                if (k == last) break;
+            }
+
+            pilots[b] = pilot;
+            for (size_type k = first; k < last; k++) {
+                taken[tmp[k - first]] = 1;
+                slot[order[k]] = tmp[k - first];
+            }
+        }
+
+        // move slots >= n into the free slots < n
+        remap.assign(nslots - n, 0);
+        size_type hole = 0;
+        for (size_type p = n; p < nslots; p++) {
+            if (!taken[p]) continue;
+            while (taken[hole]) hole++;
+            taken[hole] = 1;
+            remap[p - n] = static_cast<pilot_t>(hole);
+        }
+
+        for (i = 0; i < n; i++) {
+            if (slot[i] >= n) slot[i] = remap[slot[i] - n];
+        }
+
+        return true;
+    }
+
+    struct larger {
+        const std::vector<size_type>& start;
+
+        larger(const std::vector<size_type>& start_)
+            : start(start_)
+        {}
+
+        bool operator()(size_type a, size_type b) const
+        { return start[a + 1] - start[a] > start[b + 1] - start[b]; }
+    };
+
+    struct by_hash {
+        const std::vector<std::size_t>& h;
+
+        by_hash(const std::vector<std::size_t>& h_)
+            : h(h_)
+        {}
+
+        bool operator()(size_type a, size_type b) const
+        { return h[a] < h[b]; }
+    };
+
+    // the overflow entry for k, given h = hasher()(k), or NULL
+    const value_t* find_overflow(const key_t& k, std::size_t h) const
+    {
+        std::vector<std::size_t>::const_iterator first =
+            std::lower_bound(overflow.begin(), overflow.end(), h);
+        for (; first != overflow.end() && *first == h; ++first) {
+            const entry& e = entries[nkeys + (first - overflow.begin())];
+            if (eq(e.key, k)) return &e.value;
+        }
+        return 0;
+    }
+
+public:
+    frozen_table()
+        : seed(0), nkeys(0), nslots(0)
+    {}
+
+    size_type size() const
+    { return entries.size(); }
+
+    bool empty() const
+    { return entries.empty(); }
+
+    size_type bucket_count() const
+    { return entries.size(); }
+
+    const key_t& key(size_type i) const
+    { return entries[i].key; }
+
+    const value_t& value(size_type i) const
+    { return entries[i].value; }
+
+    void clear()
+    {
+        std::vector<entry>().swap(entries);
+        std::vector<pilot_t>().swap(pilots);
+        std::vector<pilot_t>().swap(remap);
+        std::vector<std::size_t>().swap(overflow);
+        nkeys = 0;
+        nslots = 0;
+    }
+
+    // keys must be unique; throws std::runtime_error if no perfect
+    // hash function is found for them
+    void build(const boost::container::vector<key_t>& keys,
+               const boost::container::vector<value_t>& values)
+    {
+        size_type ntotal = keys.size(), n, i;
+        clear();
+        if (!ntotal) return;
+
+        if (ntotal >= static_cast<size_type>(static_cast<pilot_t>(-1))) {
+            throw std::length_error("frozen_table: too many entries");
+        }
+
+        // findable keys ordered by hash, the first of each run of
+        // equal hashes (mix() is a bijection, so no seed can separate
+        // the others) being hashed and the rest going to the overflow
+        std::vector<std::size_t> h(ntotal);
+        std::vector<size_type> order;
+        order.reserve(ntotal);
+        for (i = 0; i < ntotal; i++) {
+            if (!eq(keys[i], keys[i])) continue;
+            h[i] = hash(keys[i]);
+            order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), by_hash(h));
+
+        std::vector<size_type> src, rest;
+        src.reserve(ntotal);
+        for (i = 0; i < order.size(); i++) {
+            if (i && h[order[i]] == h[order[i - 1]]) {
+                rest.push_back(order[i]);
+            } else {
+                src.push_back(order[i]);
+            }
+        }
+        n = src.size();
+
+        overflow.reserve(rest.size());
+        for (i = 0; i < rest.size(); i++) {
+            src.push_back(rest[i]);
+            overflow.push_back(h[rest[i]]);
+        }
+        for (i = 0; i < ntotal; i++) {
+            if (!eq(keys[i], keys[i])) src.push_back(i);
+        }
+
+        std::vector<hash_t> hashes(n);
+        nkeys = n;
+        nslots = n + n / 100 + 1;
+        pilots.assign(n / bucket_load + 1, 0);
+
+        std::vector<size_type> slot(n);
+
+        int attempt = 0;
+        for (; attempt < max_attempts; attempt++) {
+            seed = mix(static_cast<hash_t>(attempt) + 0x9e3779b97f4a7c15ULL);
+            for (i = 0; i < n; i++) hashes[i] = hash_of(keys[src[i]]);
+            if (try_build(hashes, slot)) break;
+        }
+
+        if (attempt == max_attempts) {
+            clear();
+            throw std::runtime_error(
+                "frozen_table: unable to build a perfect hash function"
+            );
+        }
+
+        entries.resize(ntotal);
+        for (i = 0; i < ntotal; i++) {
+            size_type pos = i < n ? slot[i] : i;
+            entries[pos].key = keys[src[i]];
+            entries[pos].value = values[src[i]];
+        }
+    }
+
+    const value_t* find(const key_t& k) const
+    { return find(k, hash(k)); }
+
+    // find() given h = hasher()(k), e.g. from batch_hasher
+    const value_t* find(const key_t& k, std::size_t h) const
+    {
+        if (!nkeys) return 0;
+
+        const entry& e = entries[slot_of(seeded(h))];
+        if (eq(e.key, k)) return &e.value;
+        return overflow.empty() ? 0 : find_overflow(k, h);
+    }
+
+    // approximate heap usage, in bytes
+    size_type memory_usage() const
+    {
+        return entries.capacity() * sizeof(entry) +
+            pilots.capacity() * sizeof(pilot_t) +
+            remap.capacity() * sizeof(pilot_t) +
+            overflow.capacity() * sizeof(std::size_t);
+    }
+};
+
+} // hashmap
+
+#endif // hashmap__frozen_table__hpp
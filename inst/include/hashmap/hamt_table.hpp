@@ -0,0 +1,602 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// hamt_table.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__hamt_table__hpp
+#define hashmap__hamt_table__hpp
+
+#include <boost/cstdint.hpp>
+#include <boost/move/utility_core.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <climits>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace hashmap {
+
+// Persistent key / value storage (persistent mode): a hash array
+// mapped trie in the compressed ("CHAMP") layout, where each node
+// consumes 5 bits of the key's hash and keeps two bitmaps, one for
+// entries stored inline and one for child nodes, followed by the
+// entries and child pointers themselves in a single allocation. Keys
+// whose hashes agree in every bit end up together in a collision
+// node at the bottom of the trie.
+//
+// Nodes are reference counted and shared between copies, so copying
+// a table (a snapshot) is O(1). A modification copies the shared
+// nodes on the path to the key and updates unshared ones in place
+// where their size does not change, so that after a snapshot each
+// write allocates at most one node per level. The reference counts
+// are not atomic: copies may be read concurrently, but only modified
+// (or destroyed) from one thread at a time.
+template <typename KeyType, typename ValueType,
+          typename Hasher, typename KeyEqual = std::equal_to<KeyType> >
+class hamt_table {
+public:
+    typedef KeyType key_t;
+    typedef ValueType value_t;
+    typedef Hasher hasher;
+    typedef KeyEqual key_equal;
+    typedef std::size_t size_type;
+    typedef std::pair<key_t, value_t> entry_t;
+
+private:
+    typedef boost::uint32_t bitmap_t;
+
+    enum { bits = 5, branch_mask = (1 << bits) - 1 };
+    enum { hash_bits = sizeof(std::size_t) * CHAR_BIT };
+
+    static size_type npos()
+    { return static_cast<size_type>(-1); }
+
+    // header of a node, followed by ndata entries and nnodes child
+    // pointers
+    struct node {
+        size_type refs;
+        bitmap_t datamap;
+        bitmap_t nodemap;
+        boost::uint32_t ndata;
+        boost::uint32_t nnodes;
+        bool collision;
+    };
+
+    node* root;
+    size_type count;
+
+    hasher hash;
+    key_equal eq;
+
+    static size_type align(size_type n, size_type a)
+    { return (n + a - 1) / a * a; }
+
+    static size_type data_offset()
+    { return align(sizeof(node), boost::alignment_of<entry_t>::value); }
+
+    static size_type nodes_offset(size_type nd)
+    {
+        return align(data_offset() + nd * sizeof(entry_t),
+                     boost::alignment_of<node*>::value);
+    }
+
+    static entry_t* data(const node* n)
+    {
+        return reinterpret_cast<entry_t*>(
+            reinterpret_cast<char*>(const_cast<node*>(n)) + data_offset()
+        );
+    }
+
+    static node** nodes(const node* n)
+    {
+        return reinterpret_cast<node**>(
+            reinterpret_cast<char*>(const_cast<node*>(n)) +
+                nodes_offset(n->ndata)
+        );
+    }
+
+    // a node with room for nd entries and nn children, which the
+    // caller must construct; the caller holds the only reference
+    static node* allocate(size_type nd, size_type nn, bool collision)
+    {
+        node* res = static_cast<node*>(
+            ::operator new(nodes_offset(nd) + nn * sizeof(node*))
+        );
+
+        res->refs = 1;
+        res->datamap = 0;
+        res->nodemap = 0;
+        res->ndata = static_cast<boost::uint32_t>(nd);
+        res->nnodes = static_cast<boost::uint32_t>(nn);
+        res->collision = collision;
+
+        return res;
+    }
+
+    static void retain(node* n)
+    { ++n->refs; }
+
+    static void release(node* n)
+    {
+        if (--n->refs) return;
+
+        entry_t* d = data(n);
+        node** c = nodes(n);
+        for (size_type i = 0; i < n->ndata; i++) d[i].~entry_t();
+        for (size_type i = 0; i < n->nnodes; i++) release(c[i]);
+
+        ::operator delete(n);
+    }
+
+    static bitmap_t bit_of(std::size_t h, int shift)
+    { return static_cast<bitmap_t>(1) << ((h >> shift) & branch_mask); }
+
+    static int popcount(bitmap_t x)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcount(x);
+#else
+        x = x - ((x >> 1) & 0x55555555);
+        x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+        return (((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#endif
+    }
+
+    // position of bit among the set bits of map
+    static size_type index(bitmap_t map, bitmap_t bit)
+    { return popcount(map & (bit - 1)); }
+
+    // Replaces p by a node like it, but without the entry at position
+    // drop_d (unless npos) and with *add_d inserted at position at_d
+    // (if add_d), and likewise for the children, with the given
+    // bitmaps. The entries and children of p are moved over if p was
+    // not shared, and copied otherwise.
+    static void reshape(node*& p, bitmap_t datamap, bitmap_t nodemap,
+                        size_type drop_d, const entry_t* add_d,
+                        size_type at_d, size_type drop_c, node* add_c,
+                        size_type at_c)
+    {
+        node* n = p;
+        bool steal = n->refs == 1;
+
+        size_type nd = n->ndata - (drop_d != npos()) + (add_d != 0);
+        size_type nn = n->nnodes - (drop_c != npos()) + (add_c != 0);
+
+        node* res = allocate(nd, nn, n->collision);
+        res->datamap = datamap;
+        res->nodemap = nodemap;
+
+        entry_t* src = data(n);
+        entry_t* dst = data(res);
+        for (size_type i = 0, o = 0; o < nd; o++) {
+            if (add_d && o == at_d) {
+                new (dst + o) entry_t(*add_d);
+                continue;
+            }
+            if (i == drop_d) ++i;
+            if (steal) {
+                new (dst + o) entry_t(boost::move(src[i]));
+            } else {
+                new (dst + o) entry_t(src[i]);
+            }
+            ++i;
+        }
+
+        node** csrc = nodes(n);
+        node** cdst = nodes(res);
+        for (size_type i = 0, o = 0; o < nn; o++) {
+            if (add_c && o == at_c) {
+                cdst[o] = add_c;
+                continue;
+            }
+            if (i == drop_c) ++i;
+            cdst[o] = csrc[i];
+            if (!steal) retain(cdst[o]);
+            ++i;
+        }
+
+        if (!steal) {
+            --n->refs;
+        } else {
+            // the children now belong to res; a dropped child is released
+            for (size_type i = 0; i < n->ndata; i++) src[i].~entry_t();
+            if (drop_c != npos()) release(csrc[drop_c]);
+            ::operator delete(n);
+        }
+
+        p = res;
+    }
+
+    // p itself, or a private copy of it if it is shared
+    static node* unique(node*& p)
+    {
+        if (p->refs > 1) {
+            reshape(p, p->datamap, p->nodemap,
+                    npos(), 0, 0, npos(), 0, 0);
+        }
+        return p;
+    }
+
+    // the smallest subtree holding the distinct keys of a and b,
+    // starting at shift
+    static node* merge(const entry_t& a, std::size_t ha,
+                       const entry_t& b, std::size_t hb, int shift)
+    {
+        if (shift >= (int)hash_bits) {
+            node* res = allocate(2, 0, true);
+            new (data(res)) entry_t(a);
+            new (data(res) + 1) entry_t(b);
+            return res;
+        }
+
+        bitmap_t ba = bit_of(ha, shift), bb = bit_of(hb, shift);
+
+        if (ba == bb) {
+            node* res = allocate(0, 1, false);
+            res->nodemap = ba;
+            nodes(res)[0] = merge(a, ha, b, hb, shift + bits);
+            return res;
+        }
+
+        node* res = allocate(2, 0, false);
+        res->datamap = ba | bb;
+        new (data(res)) entry_t(ba < bb ? a : b);
+        new (data(res) + 1) entry_t(ba < bb ? b : a);
+        return res;
+    }
+
+    // returns true if k was not previously present
+    bool insert(node*& p, const key_t& k, const value_t& v,
+                std::size_t h, int shift)
+    {
+        node* n = p;
+
+        if (n->collision) {
+            for (size_type i = 0; i < n->ndata; i++) {
+                if (eq(data(n)[i].first, k)) {
+                    data(unique(p))[i].second = v;
+                    return false;
+                }
+            }
+            entry_t e(k, v);
+            reshape(p, 0, 0, npos(), &e, n->ndata, npos(), 0, 0);
+            return true;
+        }
+
+        bitmap_t bit = bit_of(h, shift);
+
+        if (n->datamap & bit) {
+            size_type i = index(n->datamap, bit);
+            const entry_t& old = data(n)[i];
+            if (eq(old.first, k)) {
+                data(unique(p))[i].second = v;
+                return false;
+            }
+
+            node* child = merge(
+                old, hash(old.first), entry_t(k, v), h, shift + bits
+            );
+            reshape(p, n->datamap ^ bit, n->nodemap | bit,
+                    i, 0, 0,
+                    npos(), child, index(n->nodemap | bit, bit));
+            return true;
+        }
+
+        if (n->nodemap & bit) {
+            n = unique(p);
+            return insert(nodes(n)[index(n->nodemap, bit)],
+                          k, v, h, shift + bits);
+        }
+
+        entry_t e(k, v);
+        reshape(p, n->datamap | bit, n->nodemap,
+                npos(), &e, index(n->datamap | bit, bit),
+                npos(), 0, 0);
+        return true;
+    }
+
+    // k must be present below p; a child left with a single entry is
+    // folded back into its parent, keeping the trie canonical
+    void erase(node*& p, const key_t& k, std::size_t h, int shift)
+    {
+        node* n = p;
+
+        if (n->collision) {
+            for (size_type i = 0; i < n->ndata; i++) {
+                if (eq(data(n)[i].first, k)) {
+                    reshape(p, 0, 0, i, 0, 0, npos(), 0, 0);
+                    return;
+                }
+            }
+            return;
+        }
+
+        bitmap_t bit = bit_of(h, shift);
+
+        if (n->datamap & bit) {
+            reshape(p, n->datamap ^ bit, n->nodemap,
+                    index(n->datamap, bit), 0, 0, npos(), 0, 0);
+            return;
+        }
+
+        n = unique(p);
+        size_type i = index(n->nodemap, bit);
+        erase(nodes(n)[i], k, h, shift + bits);
+
+        const node* child = nodes(n)[i];
+        if (child->nnodes || child->ndata != 1) return;
+
+        entry_t e = data(child)[0];
+        reshape(p, n->datamap | bit, n->nodemap ^ bit,
+                npos(), &e, index(n->datamap | bit, bit),
+                i, 0, 0);
+    }
+
+    template <typename F>
+    static bool visit(const node* n, F& f)
+    {
+        const entry_t* d = data(n);
+        for (size_type i = 0; i < n->ndata; i++) {
+            if (!f(d[i].first, d[i].second)) return false;
+        }
+
+        node** c = nodes(n);
+        for (size_type i = 0; i < n->nnodes; i++) {
+            if (!visit(c[i], f)) return false;
+        }
+        return true;
+    }
+
+    template <typename F>
+    static void modify(node*& p, F& f)
+    {
+        node* n = unique(p);
+
+        entry_t* d = data(n);
+        for (size_type i = 0; i < n->ndata; i++) {
+            f(d[i].first, d[i].second);
+        }
+
+        node** c = nodes(n);
+        for (size_type i = 0; i < n->nnodes; i++) {
+            modify(c[i], f);
+        }
+    }
+
+    static size_type memory_usage(const node* n)
+    {
+        size_type res = nodes_offset(n->ndata) + n->nnodes * sizeof(node*);
+
+        node** c = nodes(n);
+        for (size_type i = 0; i < n->nnodes; i++) {
+            res += memory_usage(c[i]);
+        }
+        return res;
+    }
+
+public:
+    // Depth-first iteration in storage order (the order of visit),
+    // for resumable traversals; it is invalidated by any modification
+    // of the table.
+    class const_iterator {
+    private:
+        struct frame {
+            const node* n;
+            size_type i;
+        };
+
+        // each frame's i indexes its entries, then its children
+        std::vector<frame> stack;
+
+        void settle()
+        {
+            while (!stack.empty()) {
+                frame& f = stack.back();
+                if (f.i < f.n->ndata) return;
+
+                size_type j = f.i - f.n->ndata;
+                if (j < f.n->nnodes) {
+                    ++f.i;
+                    frame g = { nodes(f.n)[j], 0 };
+                    stack.push_back(g);
+                    continue;
+                }
+                stack.pop_back();
+            }
+        }
+
+    public:
+        const_iterator()
+        {}
+
+        explicit const_iterator(const node* root_)
+        {
+            if (!root_) return;
+            frame f = { root_, 0 };
+            stack.push_back(f);
+            settle();
+        }
+
+        bool done() const
+        { return stack.empty(); }
+
+        const entry_t& operator*() const
+        { return data(stack.back().n)[stack.back().i]; }
+
+        const entry_t* operator->() const
+        { return &**this; }
+
+        const_iterator& operator++()
+        {
+            ++stack.back().i;
+            settle();
+            return *this;
+        }
+    };
+
+    hamt_table()
+        : root(0), count(0)
+    {}
+
+    hamt_table(const hamt_table& other)
+        : root(other.root), count(other.count)
+    { if (root) retain(root); }
+
+    hamt_table& operator=(const hamt_table& other)
+    {
+        hamt_table tmp(other);
+        swap(tmp);
+        return *this;
+    }
+
+    ~hamt_table()
+    { if (root) release(root); }
+
+    size_type size() const
+    { return count; }
+
+    bool empty() const
+    { return count == 0; }
+
+    // whether the root is shared with a copy
+    bool shared() const
+    { return root && root->refs > 1; }
+
+    void clear()
+    {
+        if (root) release(root);
+        root = 0;
+        count = 0;
+    }
+
+    void swap(hamt_table& other)
+    {
+        std::swap(root, other.root);
+        std::swap(count, other.count);
+    }
+
+    const_iterator begin() const
+    { return const_iterator(root); }
+
+    const value_t* find(const key_t& k) const
+    { return find(k, hash(k)); }
+
+    // find() given h = hasher()(k), e.g. from batch_hasher
+    const value_t* find(const key_t& k, std::size_t h) const
+    {
+        const node* n = root;
+        if (!n) return 0;
+
+        for (int shift = 0; ; shift += bits) {
+            const entry_t* d = data(n);
+
+            if (n->collision) {
+                for (size_type i = 0; i < n->ndata; i++) {
+                    if (eq(d[i].first, k)) return &d[i].second;
+                }
+                return 0;
+            }
+
+            bitmap_t bit = bit_of(h, shift);
+
+            if (n->datamap & bit) {
+                const entry_t& e = d[index(n->datamap, bit)];
+                return eq(e.first, k) ? &e.second : 0;
+            }
+            if (!(n->nodemap & bit)) return 0;
+
+            n = nodes(n)[index(n->nodemap, bit)];
+        }
+    }
+
+    // find() for in-place updates: the nodes on the path to k are
+    // copied first if they are shared with a copy
+    value_t* find_mutable(const key_t& k)
+    {
+        if (!find(k)) return 0;
+
+        std::size_t h = hash(k);
+        node* n = unique(root);
+
+        for (int shift = 0; ; shift += bits) {
+            entry_t* d = data(n);
+
+            if (n->collision) {
+                for (size_type i = 0; i < n->ndata; i++) {
+                    if (eq(d[i].first, k)) return &d[i].second;
+                }
+                return 0;
+            }
+
+            bitmap_t bit = bit_of(h, shift);
+
+            if (n->datamap & bit) return &d[index(n->datamap, bit)].second;
+            n = unique(nodes(n)[index(n->nodemap, bit)]);
+        }
+    }
+
+    // returns true if k was not previously present
+    bool insert(const key_t& k, const value_t& v)
+    { return insert(k, v, hash(k)); }
+
+    // insert() given h = hasher()(k)
+    bool insert(const key_t& k, const value_t& v, std::size_t h)
+    {
+        if (!root) root = allocate(0, 0, false);
+
+        bool added = insert(root, k, v, h, 0);
+        if (added) ++count;
+        return added;
+    }
+
+    // returns true if k was present
+    bool erase(const key_t& k)
+    {
+        if (!find(k)) return false;
+
+        erase(root, k, hash(k), 0);
+        if (--count == 0) clear();
+        return true;
+    }
+
+    // calls f(key, value) for each entry until f returns false
+    template <typename F>
+    void visit(F& f) const
+    {
+        if (root) visit(root, f);
+    }
+
+    // calls f(key, value) for each entry, with a modifiable value;
+    // nodes shared with copies are copied first
+    template <typename F>
+    void modify(F& f)
+    {
+        if (root) modify(root, f);
+    }
+
+    // approximate heap usage, in bytes, counting nodes shared with
+    // copies in full
+    size_type memory_usage() const
+    { return root ? memory_usage(root) : 0; }
+};
+
+} // hashmap
+
+#endif // hashmap__hamt_table__hpp
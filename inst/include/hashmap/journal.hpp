@@ -0,0 +1,659 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// journal.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__journal__hpp
+#define hashmap__journal__hpp
+
+#include <boost/cstdint.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace hashmap {
+
+// Encoding of keys and values in journal records: fixed-width types
+// as they are (in native byte order), strings as a 32-bit length
+// followed by their bytes.
+template <typename T>
+struct journal_codec {
+    static void put(std::string& buf, const T& x)
+    { buf.append(reinterpret_cast<const char*>(&x), sizeof(T)); }
+
+    static bool get(const char*& p, const char* end, T& x)
+    {
+        if ((std::size_t)(end - p) < sizeof(T)) return false;
+        std::memcpy(&x, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+};
+
+template <>
+struct journal_codec<bool> {
+    static void put(std::string& buf, bool x)
+    { buf.push_back(x ? 1 : 0); }
+
+    static bool get(const char*& p, const char* end, bool& x)
+    {
+        if (p == end) return false;
+        x = *p++ != 0;
+        return true;
+    }
+};
+
+template <>
+struct journal_codec<std::string> {
+    static void put(std::string& buf, const std::string& x)
+    {
+        journal_codec<boost::uint32_t>::put(buf, (boost::uint32_t)x.size());
+        buf.append(x);
+    }
+
+    static bool get(const char*& p, const char* end, std::string& x)
+    {
+        boost::uint32_t n;
+        if (!journal_codec<boost::uint32_t>::get(p, end, n)) return false;
+        if ((std::size_t)(end - p) < n) return false;
+        x.assign(p, n);
+        p += n;
+        return true;
+    }
+};
+
+// What a journal records about its table besides the entries: the
+// key and value SEXPTYPEs, their classes ("", "Date" or "POSIXct")
+// and time zones, and the storage mode (including whether the table
+// is frozen, and whether its character values are encoded, which are
+// recorded as strings all the same).
+struct journal_schema {
+    enum { ordered = 1, persistent = 2, frozen = 4, encoded = 8 };
+
+    int key_type;
+    int value_type;
+    boost::uint32_t flags;
+    std::string key_class;
+    std::string key_tz;
+    std::string value_class;
+    std::string value_tz;
+
+    journal_schema()
+        : key_type(0), value_type(0), flags(0)
+    {}
+
+    bool same_types(const journal_schema& other) const
+    { return key_type == other.key_type && value_type == other.value_type; }
+};
+
+// A write-ahead log of the modifications of a table, and checkpoints
+// of its full contents.
+//
+// The checkpoint (at path) and the log (at path + ".log") share one
+// format: a header holding the schema, followed by frames, each a
+// 32-bit payload length, a 32-bit checksum of the payload, and the
+// payload, a sequence of records: 'P' key value (insert or overwrite),
+// 'E' key (erase) or 'C' (clear). Records hold the final state of an
+// entry rather than the operation that produced it, so replaying a
+// log onto a checkpoint that already includes some of it (after a
+// crash between writing a checkpoint and truncating the log) gives
+// the same table.
+//
+// The records of a modification are buffered and written as a frame
+// by commit(), which is called once per modifying method of the table
+// (and flushes to disk with fsync() if sync is set), so that a method
+// is either replayed in full or not at all. Reading stops at the first
+// frame that is incomplete or fails its checksum, i.e. one being
+// written during a crash.
+//
+// A checkpoint is written to path + ".tmp", flushed, and renamed over
+// path; the log is then truncated. Checkpoints are numbered, and each
+// log records the number of the checkpoint it follows, so that a log
+// left behind by a crash between the two steps is not replayed.
+class journal {
+public:
+    typedef boost::uint32_t u32;
+    typedef boost::uint64_t u64;
+
+    enum { format_version = 1 };
+    enum { kind_checkpoint = 0, kind_log = 1 };
+
+    // checkpoint records beyond this size are written out as a frame
+    // of their own
+    enum { frame_bytes = 4 << 20 };
+
+    // a checkpoint is due once the log is larger than both this and
+    // the last checkpoint
+    enum { min_log_bytes = 1 << 20 };
+
+private:
+    std::string path_;
+    journal_schema schema_;
+    bool sync_;
+
+    std::FILE* log;
+    u64 log_bytes;
+    u64 checkpoint_bytes;
+    std::string pending;
+    bool dirty;
+    bool failed;
+
+    u32 generation;
+
+    std::FILE* cp;
+    u64 cp_bytes;
+    std::string cp_buf;
+
+    journal(const journal&);
+    journal& operator=(const journal&);
+
+    static const char* magic()
+    { return "hashmapj"; }
+
+    static u32 checksum(const char* p, std::size_t n)
+    {
+        // FNV-1a
+        u32 h = 2166136261u;
+        for (std::size_t i = 0; i < n; i++) {
+            h ^= static_cast<unsigned char>(p[i]);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    void fail(const std::string& what, const std::string& file,
+              int err = 0) const
+    {
+        throw std::runtime_error(
+            what + " '" + file + "'" +
+                (err ? std::string(" (") + std::strerror(err) + ")" : "")
+        );
+    }
+
+    static std::string header(const journal_schema& s, u32 kind, u32 gen)
+    {
+        std::string res(magic(), 8);
+        journal_codec<u32>::put(res, format_version);
+        journal_codec<u32>::put(res, kind);
+        journal_codec<u32>::put(res, gen);
+        journal_codec<boost::int32_t>::put(res, s.key_type);
+        journal_codec<boost::int32_t>::put(res, s.value_type);
+        journal_codec<u32>::put(res, s.flags);
+        journal_codec<std::string>::put(res, s.key_class);
+        journal_codec<std::string>::put(res, s.key_tz);
+        journal_codec<std::string>::put(res, s.value_class);
+        journal_codec<std::string>::put(res, s.value_tz);
+        return res;
+    }
+
+    // reads the header of f, returning its kind (or -1 if f is not
+    // a journal)
+    static int read_header(std::FILE* f, journal_schema& s, u32& gen)
+    {
+        char buf[8 + 6 * 4];
+        if (std::fread(buf, 1, sizeof(buf), f) != sizeof(buf) ||
+            std::memcmp(buf, magic(), 8) != 0) {
+            return -1;
+        }
+
+        const char* p = buf + 8;
+        const char* end = buf + sizeof(buf);
+        u32 format, kind;
+        boost::int32_t kt, vt;
+        journal_codec<u32>::get(p, end, format);
+        journal_codec<u32>::get(p, end, kind);
+        journal_codec<u32>::get(p, end, gen);
+        journal_codec<boost::int32_t>::get(p, end, kt);
+        journal_codec<boost::int32_t>::get(p, end, vt);
+        journal_codec<u32>::get(p, end, s.flags);
+        if (format != format_version) return -1;
+
+        s.key_type = kt;
+        s.value_type = vt;
+
+        std::string* fields[] = {
+            &s.key_class, &s.key_tz, &s.value_class, &s.value_tz
+        };
+        for (int i = 0; i < 4; i++) {
+            u32 n;
+            if (std::fread(&n, sizeof(n), 1, f) != 1 || n > 1024) return -1;
+            fields[i]->resize(n);
+            if (n && std::fread(&(*fields[i])[0], 1, n, f) != n) return -1;
+        }
+
+        return (int)kind;
+    }
+
+    static void write_all(std::FILE* f, const std::string& x, bool& ok)
+    {
+        if (ok && !x.empty()) {
+            ok = std::fwrite(x.data(), 1, x.size(), f) == x.size();
+        }
+    }
+
+    static std::string frame_header(const std::string& payload)
+    {
+        std::string res;
+        journal_codec<u32>::put(res, (u32)payload.size());
+        journal_codec<u32>::put(res, checksum(payload.data(), payload.size()));
+        return res;
+    }
+
+    // flushes f to disk
+    static bool sync_file(std::FILE* f)
+    {
+        if (std::fflush(f) != 0) return false;
+#ifdef _WIN32
+        return ::_commit(::_fileno(f)) == 0;
+#else
+        return ::fsync(::fileno(f)) == 0;
+#endif
+    }
+
+    // makes a rename within the directory of path durable
+    static void sync_dir(const std::string& path)
+    {
+#ifndef _WIN32
+        std::string::size_type pos = path.find_last_of('/');
+        std::string dir = pos == std::string::npos ? "." :
+            (pos == 0 ? "/" : path.substr(0, pos));
+
+        int fd = ::open(dir.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+#endif
+    }
+
+    static u64 file_size(const std::string& file)
+    {
+        std::FILE* f = std::fopen(file.c_str(), "rb");
+        if (!f) return 0;
+        std::fseek(f, 0, SEEK_END);
+        long n = std::ftell(f);
+        std::fclose(f);
+        return n > 0 ? (u64)n : 0;
+    }
+
+    // writes the pending records to the log as a frame
+    void write_frame()
+    {
+        // (frame lengths are 32-bit)
+        if (pending.size() > (std::size_t)0xffffffffu) {
+            failed = true;
+            fail("modification too large to journal in", log_path());
+        }
+
+        bool ok = true;
+        write_all(log, frame_header(pending), ok);
+        write_all(log, pending, ok);
+        if (!ok) {
+            failed = true;
+            fail("cannot write to journal", log_path(), errno);
+        }
+
+        log_bytes += 8 + pending.size();
+        pending.clear();
+        dirty = true;
+    }
+
+    void write_checkpoint_frame()
+    {
+        bool ok = true;
+        write_all(cp, frame_header(cp_buf), ok);
+        write_all(cp, cp_buf, ok);
+        if (!ok) fail("cannot write checkpoint", tmp_path(), errno);
+
+        cp_bytes += 8 + cp_buf.size();
+        cp_buf.clear();
+    }
+
+    template <typename F>
+    static bool apply(const char* p, const char* end, F& f)
+    {
+        typedef typename F::key_t key_t;
+        typedef typename F::value_t value_t;
+
+        while (p != end) {
+            char op = *p++;
+            key_t k;
+            value_t v;
+
+            switch (op) {
+                case 'P': {
+                    if (!journal_codec<key_t>::get(p, end, k) ||
+                        !journal_codec<value_t>::get(p, end, v)) {
+                        return false;
+                    }
+                    f.put(k, v);
+                    break;
+                }
+                case 'E': {
+                    if (!journal_codec<key_t>::get(p, end, k)) return false;
+                    f.erase(k);
+                    break;
+                }
+                case 'C': {
+                    f.clear();
+                    break;
+                }
+                default: return false;
+            }
+        }
+
+        return true;
+    }
+
+public:
+    journal(const std::string& path, const journal_schema& schema, bool sync)
+        : path_(path), schema_(schema), sync_(sync),
+          log(0), log_bytes(0), checkpoint_bytes(0),
+          dirty(false), failed(false), generation(0),
+          cp(0), cp_bytes(0)
+    {}
+
+    ~journal()
+    {
+        // a modification interrupted before its commit(): write it
+        // out (as commit() would) on a best-effort basis
+        if (log && !failed && !pending.empty()) {
+            bool ok = true;
+            write_all(log, frame_header(pending), ok);
+            write_all(log, pending, ok);
+        }
+        if (log) std::fclose(log);
+        abort_checkpoint();
+    }
+
+    const std::string& path() const
+    { return path_; }
+
+    std::string log_path() const
+    { return path_ + ".log"; }
+
+    std::string tmp_path() const
+    { return path_ + ".tmp"; }
+
+    bool sync() const
+    { return sync_; }
+
+    const journal_schema& schema() const
+    { return schema_; }
+
+    // the schema of an existing checkpoint
+    static journal_schema read_schema(const std::string& path)
+    {
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) {
+            throw std::runtime_error(
+                "cannot open journal checkpoint '" + path + "' (" +
+                    std::strerror(errno) + ")"
+            );
+        }
+
+        journal_schema res;
+        u32 gen;
+        int kind = read_header(f, res, gen);
+        std::fclose(f);
+
+        if (kind != kind_checkpoint) {
+            throw std::runtime_error(
+                "'" + path + "' is not a Hashmap journal checkpoint"
+            );
+        }
+        return res;
+    }
+
+    // Applies the records of file (a checkpoint, or a log) to f,
+    // which has members put(key_t, value_t), erase(key_t) and clear();
+    // returns false if the file is missing, does not follow the last
+    // checkpoint replayed, or ends with a torn or corrupt frame (whose
+    // records are not applied).
+    template <typename F>
+    bool replay(const std::string& file, int kind, F& f)
+    {
+        std::FILE* in = std::fopen(file.c_str(), "rb");
+        if (!in) {
+            if (kind == kind_log && errno == ENOENT) return false;
+            fail("cannot open journal", file, errno);
+        }
+
+        journal_schema s;
+        u32 gen;
+        if (read_header(in, s, gen) != kind) {
+            std::fclose(in);
+            fail("not a Hashmap journal file:", file);
+        }
+        if (!s.same_types(schema_)) {
+            std::fclose(in);
+            fail("journal holds different key or value types:", file);
+        }
+
+        if (kind == kind_checkpoint) {
+            generation = gen;
+            schema_.flags = s.flags;
+        } else if (gen != generation) {
+            std::fclose(in);
+            return false;
+        }
+
+        std::vector<char> buf;
+        bool clean = true;
+        for (;;) {
+            u32 hdr[2];
+            std::size_t got = std::fread(hdr, sizeof(u32), 2, in);
+            if (got == 0 && std::feof(in)) break;
+            if (got != 2) {
+                clean = false;
+                break;
+            }
+
+            buf.resize(hdr[0] ? hdr[0] : 1);
+            if (std::fread(&buf[0], 1, hdr[0], in) != hdr[0] ||
+                checksum(&buf[0], hdr[0]) != hdr[1]) {
+                clean = false;
+                break;
+            }
+
+            // a frame that passed its checksum but does not parse was
+            // not written by this version
+            if (!apply(&buf[0], &buf[0] + hdr[0], f)) {
+                std::fclose(in);
+                fail("corrupt journal", file);
+            }
+        }
+
+        std::fclose(in);
+        return clean;
+    }
+
+    // Continues the existing log, after replaying it cleanly.
+    void open_log()
+    {
+        checkpoint_bytes = file_size(path_);
+        log = std::fopen(log_path().c_str(), "ab");
+        if (!log) fail("cannot open journal", log_path(), errno);
+        log_bytes = file_size(log_path());
+    }
+
+    template <typename K, typename V>
+    void put(const K& k, const V& v)
+    {
+        pending.push_back('P');
+        journal_codec<K>::put(pending, k);
+        journal_codec<V>::put(pending, v);
+    }
+
+    template <typename K>
+    void erase(const K& k)
+    {
+        pending.push_back('E');
+        journal_codec<K>::put(pending, k);
+    }
+
+    // (supersedes the pending records)
+    void clear()
+    {
+        pending.clear();
+        pending.push_back('C');
+    }
+
+    // Writes the pending records as a frame, and flushes the log (to
+    // disk, if sync is set).
+    void commit()
+    {
+        if (failed) {
+            throw std::runtime_error(
+                "journal '" + log_path() + "' could not be written; " +
+                    "call checkpoint() to recover"
+            );
+        }
+        if (!log) return;
+
+        if (!pending.empty()) write_frame();
+        if (!dirty) return;
+
+        bool ok = sync_ ? sync_file(log) : std::fflush(log) == 0;
+        if (!ok) {
+            failed = true;
+            fail("cannot flush journal", log_path(), errno);
+        }
+        dirty = false;
+    }
+
+    bool checkpoint_due() const
+    {
+        return log_bytes > (u64)min_log_bytes &&
+            log_bytes > checkpoint_bytes;
+    }
+
+    u64 log_size() const
+    { return log_bytes; }
+
+    u64 checkpoint_size() const
+    { return checkpoint_bytes; }
+
+    // A checkpoint is written by begin_checkpoint(), add() for each
+    // entry, and end_checkpoint(); abort_checkpoint() discards it.
+    // The schema may record a new storage mode, but not new types.
+    void begin_checkpoint(const journal_schema& schema)
+    {
+        abort_checkpoint();
+        if (!schema.same_types(schema_)) {
+            fail("journal holds different key or value types:", path_);
+        }
+        schema_ = schema;
+
+        // number it after the checkpoint it replaces, if any
+        if (!generation) {
+            std::FILE* f = std::fopen(path_.c_str(), "rb");
+            if (f) {
+                journal_schema s;
+                if (read_header(f, s, generation) < 0) generation = 0;
+                std::fclose(f);
+            }
+        }
+
+        cp = std::fopen(tmp_path().c_str(), "wb");
+        if (!cp) fail("cannot create checkpoint", tmp_path(), errno);
+
+        std::string h = header(schema_, kind_checkpoint, generation + 1);
+        bool ok = true;
+        write_all(cp, h, ok);
+        if (!ok) fail("cannot write checkpoint", tmp_path(), errno);
+        cp_bytes = h.size();
+    }
+
+    template <typename K, typename V>
+    void add(const K& k, const V& v)
+    {
+        cp_buf.push_back('P');
+        journal_codec<K>::put(cp_buf, k);
+        journal_codec<V>::put(cp_buf, v);
+        if (cp_buf.size() >= (std::size_t)frame_bytes) {
+            write_checkpoint_frame();
+        }
+    }
+
+    // Installs the checkpoint, and starts a new (empty) log.
+    void end_checkpoint()
+    {
+        if (!cp_buf.empty()) write_checkpoint_frame();
+
+        bool ok = sync_file(cp);
+        ok = std::fclose(cp) == 0 && ok;
+        cp = 0;
+        if (!ok) fail("cannot write checkpoint", tmp_path(), errno);
+
+#ifdef _WIN32
+        // rename() does not replace existing files on Windows
+        std::remove(path_.c_str());
+#endif
+        if (std::rename(tmp_path().c_str(), path_.c_str()) != 0) {
+            fail("cannot install checkpoint", path_, errno);
+        }
+        sync_dir(path_);
+        checkpoint_bytes = cp_bytes;
+        ++generation;
+
+        if (log) std::fclose(log);
+        log = std::fopen(log_path().c_str(), "wb");
+        if (!log) {
+            failed = true;
+            fail("cannot create journal", log_path(), errno);
+        }
+
+        std::string h = header(schema_, kind_log, generation);
+        ok = true;
+        write_all(log, h, ok);
+        if (!ok || !sync_file(log)) {
+            failed = true;
+            fail("cannot write to journal", log_path(), errno);
+        }
+        sync_dir(log_path());
+
+        log_bytes = h.size();
+        pending.clear();
+        dirty = false;
+        failed = false;
+    }
+
+    void abort_checkpoint()
+    {
+        if (!cp) return;
+        std::fclose(cp);
+        cp = 0;
+        cp_buf.clear();
+        std::remove(tmp_path().c_str());
+    }
+};
+
+} // hashmap
+
+#endif // hashmap__journal__hpp
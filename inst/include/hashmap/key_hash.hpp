@@ -0,0 +1,118 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// key_hash.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__key_hash__hpp
+#define hashmap__key_hash__hpp
+
+#include <boost/functional/hash.hpp>
+#include <stdint.h>
+#include <cstring>
+#include <functional>
+
+#if !defined(HASHMAP_NO_SPP) && (!defined(__sun) || !defined(__SVR4))
+#include "sparsepp/spp.h"
+#endif
+
+namespace hashmap {
+
+// The hasher and equality predicate used for keys of type T by every
+// table (HashTemplate, SetTemplate, IndexTemplate), including the
+// dense, frozen and Bloom filter layers, which take them from map_t.
+template <typename T>
+struct key_hash {
+#if defined(HASHMAP_NO_SPP) || (defined(__sun) && defined(__SVR4))  // solaris
+    typedef boost::hash<T> hasher;
+#else
+    typedef spp::spp_hash<T> hasher;
+#endif
+    typedef std::equal_to<T> key_equal;
+};
+
+namespace detail {
+
+inline uint64_t double_bits(double x)
+{
+    uint64_t res;
+    std::memcpy(&res, &x, sizeof(res));
+    return res;
+}
+
+// R's NA_real_ is the NaN whose low word is 1954 (see R_IsNA); this
+// reads the bits directly so that it can be used off the main thread
+inline bool is_na_real(double x)
+{ return x != x && (double_bits(x) & 0xFFFFFFFFu) == 1954; }
+
+// the 64-bit finalizer of MurmurHash3
+inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb93fe53ec26dULL;
+    x ^= x >> 33;
+    return x;
+}
+
+} // detail
+
+// double keys compare like match() does: NA matches only NA, any other
+// NaN matches only non-NA NaNs, and -0 matches 0. The hash agrees with
+// that, and values which are integers in the int64 range (Date keys,
+// whole-second POSIXct keys, numeric ids) are hashed as integers,
+// which skips the bit pattern of the fraction entirely.
+struct double_hash {
+    std::size_t operator()(double x) const
+    {
+        // also maps -0 to 0; false for NaN
+        if (x > -9.2e18 && x < 9.2e18) {
+            int64_t i = static_cast<int64_t>(x);
+            if (static_cast<double>(i) == x) {
+                return static_cast<std::size_t>(
+                    detail::mix64(static_cast<uint64_t>(i))
+                );
+            }
+        }
+
+        if (x != x) return detail::is_na_real(x) ? 1954 : 1955;
+
+        return static_cast<std::size_t>(
+            detail::mix64(detail::double_bits(x))
+        );
+    }
+};
+
+struct double_equal {
+    bool operator()(double x, double y) const
+    {
+        if (x == y) return true;
+        return x != x && y != y &&
+            detail::is_na_real(x) == detail::is_na_real(y);
+    }
+};
+
+template <>
+struct key_hash<double> {
+    typedef double_hash hasher;
+    typedef double_equal key_equal;
+};
+
+} // hashmap
+
+#endif // hashmap__key_hash__hpp
@@ -0,0 +1,268 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// profile.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+
+#ifndef hashmap__profile__hpp
+#define hashmap__profile__hpp
+
+#include <cstddef>
+
+#ifdef HASHMAP_PROFILE
+#include "sparsepp/spp_timer.h"
+#endif
+
+namespace hashmap {
+namespace profile {
+
+// Optional instrumentation of the HashTemplate hot paths, compiled in
+// only when HASHMAP_PROFILE is defined (e.g. by installing with
+// HASHMAP_CPPFLAGS=-DHASHMAP_PROFILE in the environment); otherwise
+// the HASHMAP_PROFILE_* macros expand to nothing. Each instrumented
+// operation counts its calls and elements and splits its time into
+// phases; the phase timers run per element, so profiled builds are
+// noticeably slower, but the split between phases is what matters.
+// The counters are process-wide and not thread-safe, like the tables
+// themselves. Read from R with profile_stats() (src/profile.cpp).
+
+enum operation {
+    op_insert = 0,
+    op_find,
+    op_has_keys,
+    op_erase,
+    op_keys,
+    op_values,
+    op_get_scalar,
+    op_set_scalar,
+    op_clone,
+    n_operations
+};
+
+enum phase {
+    phase_convert = 0,  // R vectors and scalars to C++ keys / values
+    phase_hash,         // hashing the key
+    phase_probe,        // the table lookup, insertion or erasure
+    phase_alloc,        // allocating result vectors
+    phase_build,        // filling result vectors, attributes
+    n_phases
+};
+
+inline const char* operation_name(int op)
+{
+    static const char* names[n_operations] = {
+        "insert", "find", "has_keys", "erase", "keys", "values",
+        "get_scalar", "set_scalar", "clone"
+    };
+    return names[op];
+}
+
+inline const char* phase_name(int p)
+{
+    static const char* names[n_phases] = {
+        "convert", "hash", "probe", "alloc", "build"
+    };
+    return names[p];
+}
+
+struct operation_stats {
+    double calls;
+    double elements;
+    double total_ns;
+    double phase_ns[n_phases];
+};
+
+struct rehash_stats {
+    double events;
+    double total_ns;
+    double max_ns;
+};
+
+class op_scope;
+
+struct state {
+    operation_stats ops[n_operations];
+    rehash_stats rehash;
+    op_scope* current;
+
+    void reset()
+    {
+        for (int i = 0; i < n_operations; i++) {
+            ops[i].calls = ops[i].elements = ops[i].total_ns = 0;
+            for (int p = 0; p < n_phases; p++) ops[i].phase_ns[p] = 0;
+        }
+        rehash.events = rehash.total_ns = rehash.max_ns = 0;
+    }
+
+    state()
+        : current(0)
+    { reset(); }
+};
+
+inline state& get()
+{
+    static state instance;
+    return instance;
+}
+
+inline bool enabled()
+{
+#ifdef HASHMAP_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef HASHMAP_PROFILE
+
+typedef spp::Timer<std::nano> timer;
+
+// Attributes time to the operation it is created in. Operations
+// nest (e.g. find(SEXP) calling find(key_vec)); only the outermost
+// one counts, and phases are charged to it.
+class op_scope {
+private:
+    operation op;
+    bool owner;
+    timer clock;
+    double pending_hash;
+
+    op_scope(const op_scope&);
+    op_scope& operator=(const op_scope&);
+
+public:
+    op_scope(operation op_, double n)
+        : op(op_), owner(get().current == 0), pending_hash(0)
+    {
+        if (!owner) return;
+
+        state& s = get();
+        s.current = this;
+        s.ops[op].calls += 1;
+        s.ops[op].elements += n;
+    }
+
+    ~op_scope()
+    {
+        if (!owner) return;
+
+        state& s = get();
+        s.ops[op].total_ns += clock.get_total();
+        s.current = 0;
+    }
+
+    void mark()
+    { clock.snap(); }
+
+    // charges the time since the last mark to phase p; a probe
+    // re-hashes the key, so the time of the preceding hash() is
+    // deducted from it
+    void charge(phase p)
+    {
+        double d = clock.get_delta();
+        if (p == phase_probe) {
+            d = d > pending_hash ? d - pending_hash : 0;
+            pending_hash = 0;
+        }
+
+        get().ops[op].phase_ns[p] += d;
+        clock.snap();
+    }
+
+    template <typename Hasher, typename Key>
+    void hash(const Hasher& h, const Key& k)
+    {
+        clock.snap();
+        volatile std::size_t res = h(k);
+        (void)res;
+
+        pending_hash = clock.get_delta();
+        get().ops[op].phase_ns[phase_hash] += pending_hash;
+        clock.snap();
+    }
+};
+
+inline void mark()
+{ if (get().current) get().current->mark(); }
+
+inline void charge(phase p)
+{ if (get().current) get().current->charge(p); }
+
+template <typename Hasher, typename Key>
+inline void hash(const Hasher& h, const Key& k)
+{ if (get().current) get().current->hash(h, k); }
+
+// Records a rehash event if the bucket count changed between
+// construction and end().
+class rehash_watch {
+private:
+    std::size_t buckets;
+    timer clock;
+
+public:
+    explicit rehash_watch(std::size_t buckets_)
+        : buckets(buckets_)
+    {}
+
+    void end(std::size_t buckets_)
+    {
+        if (buckets_ == buckets) return;
+
+        double d = clock.get_total();
+        rehash_stats& r = get().rehash;
+        r.events += 1;
+        r.total_ns += d;
+        if (d > r.max_ns) r.max_ns = d;
+    }
+};
+
+#define HASHMAP_PROFILE_OP(op_, n_)                                     \
+    ::hashmap::profile::op_scope hashmap_profile_scope_(                \
+        ::hashmap::profile::op_, (double)(n_))
+
+#define HASHMAP_PROFILE_MARK()                                          \
+    ::hashmap::profile::mark()
+
+#define HASHMAP_PROFILE_PHASE(phase_)                                   \
+    ::hashmap::profile::charge(::hashmap::profile::phase_)
+
+#define HASHMAP_PROFILE_HASH(hasher_, key_)                             \
+    ::hashmap::profile::hash(hasher_, key_)
+
+#define HASHMAP_PROFILE_REHASH_BEGIN(buckets_)                          \
+    ::hashmap::profile::rehash_watch hashmap_profile_rehash_(buckets_)
+
+#define HASHMAP_PROFILE_REHASH_END(buckets_)                            \
+    hashmap_profile_rehash_.end(buckets_)
+
+#else
+
+#define HASHMAP_PROFILE_OP(op_, n_)
+#define HASHMAP_PROFILE_MARK() ((void)0)
+#define HASHMAP_PROFILE_PHASE(phase_) ((void)0)
+#define HASHMAP_PROFILE_HASH(hasher_, key_) ((void)0)
+#define HASHMAP_PROFILE_REHASH_BEGIN(buckets_)
+#define HASHMAP_PROFILE_REHASH_END(buckets_) ((void)0)
+
+#endif // HASHMAP_PROFILE
+
+} // profile
+} // hashmap
+
+#endif // hashmap__profile__hpp
@@ -0,0 +1,902 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// shm_table.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__shm_table__hpp
+#define hashmap__shm_table__hpp
+
+#include "key_hash.hpp"
+#include <boost/cstdint.hpp>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace hashmap {
+
+// A string stored in the arena of a shared segment
+struct shm_string {
+    boost::uint64_t offset;
+    boost::uint64_t length;
+};
+
+// Fixed-width representation ("cell") of keys and values in a shared
+// segment. Fixed-width types are stored as they are; strings are
+// stored in the segment's arena and referenced by offset, so that the
+// segment can be mapped at any address. Cells read by a reader may be
+// torn by a concurrent write (the seqlock read is retried afterwards),
+// so load() and equal() validate offsets against the arena first.
+template <typename T>
+struct shm_codec {
+    typedef T cell_t;
+
+    static std::size_t hash(const T& x)
+    {
+        return static_cast<std::size_t>(detail::mix64(
+            static_cast<boost::uint64_t>(static_cast<boost::uint32_t>(x))
+        ));
+    }
+
+    static bool equal(const char*, boost::uint64_t, const cell_t& c,
+                      const T& x)
+    { return c == x; }
+
+    static std::size_t bytes(const T&)
+    { return 0; }
+
+    static std::size_t bytes(const cell_t&, int)
+    { return 0; }
+
+    static cell_t store(char*, boost::uint64_t&, const T& x)
+    { return x; }
+
+    static bool load(const char*, boost::uint64_t, const cell_t& c, T& res)
+    {
+        res = c;
+        return true;
+    }
+
+    static cell_t copy(const char*, char*, boost::uint64_t&, const cell_t& c)
+    { return c; }
+};
+
+template <>
+struct shm_codec<double> {
+    typedef double cell_t;
+
+    static std::size_t hash(double x)
+    { return double_hash()(x); }
+
+    static bool equal(const char*, boost::uint64_t, double c, double x)
+    { return double_equal()(c, x); }
+
+    static std::size_t bytes(double)
+    { return 0; }
+
+    static std::size_t bytes(double, int)
+    { return 0; }
+
+    static double store(char*, boost::uint64_t&, double x)
+    { return x; }
+
+    static bool load(const char*, boost::uint64_t, double c, double& res)
+    {
+        res = c;
+        return true;
+    }
+
+    static double copy(const char*, char*, boost::uint64_t&, double c)
+    { return c; }
+};
+
+template <>
+struct shm_codec<std::string> {
+    typedef shm_string cell_t;
+
+    // FNV-1a, with the MurmurHash3 finalizer
+    static std::size_t hash(const std::string& x)
+    {
+        boost::uint64_t h = 14695981039346656037ULL;
+        for (std::size_t i = 0; i < x.size(); i++) {
+            h ^= static_cast<unsigned char>(x[i]);
+            h *= 1099511628211ULL;
+        }
+        return static_cast<std::size_t>(detail::mix64(h));
+    }
+
+    static bool valid(boost::uint64_t arena_size, const cell_t& c)
+    { return c.offset <= arena_size && c.length <= arena_size - c.offset; }
+
+    static bool equal(const char* arena, boost::uint64_t arena_size,
+                      const cell_t& c, const std::string& x)
+    {
+        return c.length == x.size() && valid(arena_size, c) &&
+            std::memcmp(arena + c.offset, x.data(), x.size()) == 0;
+    }
+
+    static std::size_t bytes(const std::string& x)
+    { return x.size(); }
+
+    static std::size_t bytes(const cell_t& c, int)
+    { return c.length; }
+
+    static cell_t store(char* arena, boost::uint64_t& used,
+                        const std::string& x)
+    {
+        cell_t res = { used, x.size() };
+        if (!x.empty()) std::memcpy(arena + used, x.data(), x.size());
+        used += x.size();
+        return res;
+    }
+
+    static bool load(const char* arena, boost::uint64_t arena_size,
+                     const cell_t& c, std::string& res)
+    {
+        if (!valid(arena_size, c)) return false;
+        res.assign(arena + c.offset, c.length);
+        return true;
+    }
+
+    static cell_t copy(const char* from, char* to, boost::uint64_t& used,
+                       const cell_t& c)
+    {
+        cell_t res = { used, c.length };
+        if (c.length) std::memcpy(to + used, from + c.offset, c.length);
+        used += c.length;
+        return res;
+    }
+};
+
+// A named POSIX shared memory segment holding a hash table: a header,
+// followed (somewhere in the segment) by an open-addressing array of
+// slots and an arena for string bytes, both located by offsets in the
+// header.
+//
+// Any number of processes may map the segment and read it
+// concurrently with a single writer. Readers never lock: the writer
+// brackets each modification with increments of a sequence counter
+// (seqlock), and readers retry any read during which the counter was
+// odd or changed. The writer is the handle that opened the segment for
+// writing, and holds an exclusive flock() on it for its lifetime; it is
+// not available to processes forked from its owner, which can read
+// through the inherited handle.
+//
+// The slot array and the arena are never resized in place: when either
+// is full, the writer builds a larger copy (dropping erased entries and
+// unreferenced string bytes) in unused space, or at the end of the
+// segment, and then switches the header over to it. Readers remap the
+// segment when the header reports that it has grown. The segment never
+// shrinks while it exists, and persists until removed.
+class shm_segment {
+public:
+    typedef boost::uint64_t u64;
+
+    struct header {
+        char magic[8];
+        boost::uint32_t format;
+        boost::int32_t key_type;
+        boost::int32_t value_type;
+        boost::uint32_t slot_size;
+        u64 seq;
+        u64 total_size;
+        u64 slots_offset;
+        u64 capacity;
+        u64 size;
+        u64 tombstones;
+        u64 arena_offset;
+        u64 arena_size;
+        u64 arena_used;
+        u64 arena_dead;
+    };
+
+    // the slot array and arena as seen by a reader: offsets checked
+    // against the mapping, so that a torn header cannot lead a reader
+    // outside of it
+    struct layout {
+        const char* slots;
+        u64 capacity;
+        const char* arena;
+        u64 arena_size;
+    };
+
+    enum { format_version = 1, alignment = 64 };
+
+private:
+    std::string name_;
+    int fd;
+    char* base;
+    std::size_t mapped;
+    bool writable_;
+    long owner;
+
+    shm_segment(const shm_segment&);
+    shm_segment& operator=(const shm_segment&);
+
+    static const char* magic()
+    { return "hashmap"; }
+
+    static u64 align(u64 n)
+    { return (n + alignment - 1) / alignment * alignment; }
+
+    // throws, with the system error err (if nonzero) appended
+    void fail(const std::string& what, int err = 0) const
+    {
+        throw std::runtime_error(
+            "shared Hashmap '" + name_ + "': " + what +
+                (err ? std::string(" (") + std::strerror(err) + ")" : "")
+        );
+    }
+
+    // fail(), releasing the segment first (from the constructor)
+    void abort_open(const std::string& what, int err = 0)
+    {
+#ifndef _WIN32
+        if (base) ::munmap(base, mapped);
+        if (fd >= 0) ::close(fd);
+#endif
+        base = 0;
+        fd = -1;
+        fail(what, err);
+    }
+
+#ifndef _WIN32
+    // shm_open() is open() under /dev/shm on Linux; calling open()
+    // directly avoids linking librt with older versions of glibc
+    static int open_segment(const std::string& name, int flags)
+    {
+#if defined(__linux__)
+        return ::open(("/dev/shm" + name).c_str(), flags, 0600);
+#else
+        return ::shm_open(name.c_str(), flags, 0600);
+#endif
+    }
+
+    static int unlink_segment(const std::string& name)
+    {
+#if defined(__linux__)
+        return ::unlink(("/dev/shm" + name).c_str());
+#else
+        return ::shm_unlink(name.c_str());
+#endif
+    }
+
+    void map(std::size_t n)
+    {
+        if (base) ::munmap(base, mapped);
+        base = 0;
+        mapped = 0;
+
+        void* p = ::mmap(0, n, PROT_READ | (writable_ ? PROT_WRITE : 0),
+                         MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) fail("cannot map segment", errno);
+
+        base = static_cast<char*>(p);
+        mapped = n;
+    }
+#endif
+
+    u64 load(const u64& x) const
+    { return __atomic_load_n(&x, __ATOMIC_RELAXED); }
+
+public:
+    // "/name" (a leading slash is added if missing)
+    static std::string segment_name(const std::string& name)
+    {
+        std::string res = name.size() && name[0] == '/' ? name : "/" + name;
+        if (res.size() < 2 || res.size() > 250 ||
+            res.find('/', 1) != std::string::npos) {
+            throw std::invalid_argument(
+                "Invalid shared Hashmap name '" + name + "'"
+            );
+        }
+        return res;
+    }
+
+    // true if no process holds the writer's lock on the segment (false
+    // if the name no longer refers to it, as then it cannot be told)
+    bool writer_gone() const
+    {
+        int probe = open_segment(name_, O_RDONLY);
+        if (probe < 0) return false;
+        struct stat a, b;
+        bool gone = ::fstat(fd, &a) == 0 && ::fstat(probe, &b) == 0 &&
+            a.st_dev == b.st_dev && a.st_ino == b.st_ino &&
+            ::flock(probe, LOCK_EX | LOCK_NB) == 0;
+        ::close(probe);
+        return gone;
+    }
+
+    // Creates the segment (which must not exist) for a table of the
+    // given types, capacity (a power of two) and arena size, or opens
+    // an existing one.
+    shm_segment(const std::string& name, bool create, bool writable,
+                int key_type, int value_type, std::size_t slot_size,
+                u64 capacity, u64 arena_size)
+        : name_(segment_name(name)), fd(-1), base(0), mapped(0),
+          writable_(writable || create), owner(0)
+    {
+#ifdef _WIN32
+        throw std::runtime_error(
+            "Shared Hashmaps require POSIX shared memory"
+        );
+#else
+        fd = open_segment(
+            name_, create ? O_RDWR | O_CREAT | O_EXCL :
+                (writable_ ? O_RDWR : O_RDONLY)
+        );
+        if (fd < 0) {
+            fail(create ? "cannot create segment" : "cannot open segment",
+                 errno);
+        }
+
+        if (writable_) {
+            owner = (long)::getpid();
+            // (flock() may be unsupported, e.g. on macOS)
+            if (::flock(fd, LOCK_EX | LOCK_NB) != 0 && errno == EWOULDBLOCK) {
+                abort_open("already open for writing in another process");
+            }
+        }
+
+        if (create) {
+            u64 slots_offset = align(sizeof(header));
+            u64 arena_offset = slots_offset + capacity * slot_size;
+            u64 total = align(arena_offset + arena_size);
+
+            if (::ftruncate(fd, (off_t)total) != 0) {
+                int err = errno;
+                unlink_segment(name_);
+                abort_open("cannot size segment", err);
+            }
+            try {
+                map(total);
+            } catch (...) {
+                unlink_segment(name_);
+                abort_open("cannot map segment");
+            }
+
+            header* h = hdr();
+            h->format = format_version;
+            h->key_type = key_type;
+            h->value_type = value_type;
+            h->slot_size = (boost::uint32_t)slot_size;
+            h->seq = 0;
+            h->total_size = total;
+            h->slots_offset = slots_offset;
+            h->capacity = capacity;
+            h->size = 0;
+            h->tombstones = 0;
+            h->arena_offset = arena_offset;
+            h->arena_size = arena_size;
+            h->arena_used = 0;
+            h->arena_dead = 0;
+
+            // marks the segment as initialized
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            std::memcpy(h->magic, magic(), sizeof(h->magic));
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) abort_open("cannot stat segment", errno);
+        if ((u64)st.st_size < sizeof(header)) {
+            abort_open("not a Hashmap segment");
+        }
+        try {
+            map((std::size_t)st.st_size);
+        } catch (...) {
+            abort_open("cannot map segment");
+        }
+
+        const header* h = hdr();
+        if (std::memcmp(h->magic, magic(), sizeof(h->magic)) != 0 ||
+            h->format != format_version) {
+            abort_open("not a Hashmap segment, or one from another version");
+        }
+        if ((key_type && h->key_type != key_type) ||
+            (value_type && h->value_type != value_type) ||
+            (slot_size && h->slot_size != slot_size)) {
+            abort_open("segment holds a table of different types");
+        }
+#endif
+    }
+
+    ~shm_segment()
+    {
+#ifndef _WIN32
+        if (base) ::munmap(base, mapped);
+        if (fd >= 0) ::close(fd);
+#endif
+    }
+
+    // the key and value type codes recorded in an existing segment
+    static void types(const std::string& name, int& key_type,
+                      int& value_type)
+    {
+        shm_segment tmp(name, false, false, 0, 0, 0, 0, 0);
+        key_type = tmp.hdr()->key_type;
+        value_type = tmp.hdr()->value_type;
+    }
+
+    // removes the name; existing mappings stay valid
+    static void remove(const std::string& name)
+    {
+#ifndef _WIN32
+        std::string nm = segment_name(name);
+        if (unlink_segment(nm) != 0) {
+            throw std::runtime_error(
+                "cannot remove shared Hashmap '" + nm + "' (" +
+                    std::strerror(errno) + ")"
+            );
+        }
+#endif
+    }
+
+    const std::string& name() const
+    { return name_; }
+
+    // whether this handle may modify the segment (in this process)
+    bool writable() const
+    {
+#ifdef _WIN32
+        return false;
+#else
+        return writable_ && owner == (long)::getpid();
+#endif
+    }
+
+    void check_writable() const
+    {
+        if (!writable()) fail("read-only in this process");
+    }
+
+    header* hdr()
+    { return reinterpret_cast<header*>(base); }
+
+    const header* hdr() const
+    { return reinterpret_cast<const header*>(base); }
+
+    char* at(u64 offset)
+    { return base + offset; }
+
+    u64 total_size() const
+    { return mapped; }
+
+    // Starts a read, returning the sequence number to pass to
+    // read_retry(); waits while the writer is updating the segment.
+    u64 read_begin() const
+    {
+        for (unsigned long spins = 0; ; spins++) {
+            u64 s = __atomic_load_n(&hdr()->seq, __ATOMIC_ACQUIRE);
+            if (!(s & 1)) return s;
+#ifndef _WIN32
+            if (spins > 1000) ::sched_yield();
+            // the writer holds its flock() until it exits; if it is
+            // gone, it was interrupted during an update. The lock is
+            // probed through a new descriptor: locks belong to the open
+            // file description, which a reader forked from the writer
+            // shares through fd, so probing fd would take over (and
+            // then drop) the writer's own lock.
+            if (spins % 100000 == 99999 && writer_gone()) {
+                fail("left inconsistent by a writer that exited during an update");
+            }
+#endif
+        }
+    }
+
+    // true if a read started at seq s must be retried
+    bool read_retry(u64 s) const
+    {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&hdr()->seq, __ATOMIC_RELAXED) != s;
+    }
+
+    // Reads the current layout within a read started by read_begin();
+    // returns false (after remapping, if the segment grew) if the
+    // header is inconsistent, in which case the read must be retried.
+    bool read_layout(layout& res, std::size_t slot_size)
+    {
+        const header* h = hdr();
+        u64 total = load(h->total_size);
+        if (total > mapped) {
+#ifndef _WIN32
+            map((std::size_t)total);
+#endif
+            return false;
+        }
+
+        u64 so = load(h->slots_offset), cap = load(h->capacity);
+        u64 ao = load(h->arena_offset), as = load(h->arena_size);
+
+        if (!cap || (cap & (cap - 1)) || so > mapped ||
+            cap > (mapped - so) / slot_size ||
+            ao > mapped || as > mapped - ao) {
+            return false;
+        }
+
+        res.slots = base + so;
+        res.capacity = cap;
+        res.arena = base + ao;
+        res.arena_size = as;
+        return true;
+    }
+
+    // bracket each modification (by the writer)
+    void write_begin()
+    {
+        u64 s = hdr()->seq;
+        __atomic_store_n(&hdr()->seq, s + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    void write_end()
+    { __atomic_store_n(&hdr()->seq, hdr()->seq + 1, __ATOMIC_RELEASE); }
+
+    // Offset of a new region of n bytes that does not overlap the
+    // live slot array or arena, growing the segment if need be (by
+    // the writer; the header is not changed).
+    u64 allocate(u64 n)
+    {
+        const header* h = hdr();
+        u64 first = align(sizeof(header));
+        u64 lo = h->slots_offset < h->arena_offset ?
+            h->slots_offset : h->arena_offset;
+        u64 hi = h->slots_offset < h->arena_offset ?
+            h->arena_offset + h->arena_size :
+            h->slots_offset + h->capacity * h->slot_size;
+
+        u64 res = first + n <= lo ? first : align(hi);
+        u64 total = align(res + n);
+
+#ifndef _WIN32
+        if (total > mapped) {
+            // grow geometrically, to bound the number of remaps
+            if (total < mapped + mapped / 2) total = align(mapped + mapped / 2);
+            if (::ftruncate(fd, (off_t)total) != 0) {
+                fail("cannot grow segment", errno);
+            }
+            map((std::size_t)total);
+        }
+#endif
+        return res;
+    }
+};
+
+// Hash table over a shm_segment, for keys of type K and values of
+// type V (see shm_codec). The slot hash is 0 for empty slots and 1
+// for erased ones; probing is linear, with a maximum load (including
+// erased slots) of 70%.
+template <typename K, typename V>
+class shm_table {
+public:
+    typedef K key_t;
+    typedef V value_t;
+    typedef shm_codec<K> kcodec;
+    typedef shm_codec<V> vcodec;
+    typedef shm_segment::u64 u64;
+    typedef std::size_t size_type;
+
+private:
+    struct slot {
+        u64 hash;
+        typename kcodec::cell_t key;
+        typename vcodec::cell_t value;
+    };
+
+    enum { empty_hash = 0, erased_hash = 1 };
+
+    shm_segment seg;
+
+    static u64 slot_hash(const key_t& k)
+    {
+        u64 h = (u64)kcodec::hash(k);
+        return h > erased_hash ? h : h + 2;
+    }
+
+    static u64 capacity_for(u64 n)
+    {
+        u64 res = 16;
+        while (n * 10 > res * 7) res *= 2;
+        return res;
+    }
+
+    slot* slots()
+    { return reinterpret_cast<slot*>(seg.at(seg.hdr()->slots_offset)); }
+
+    char* arena()
+    { return seg.at(seg.hdr()->arena_offset); }
+
+    // the writer's probe: the slot holding k, or else (with found
+    // false) the first free slot of its sequence
+    slot* locate(const key_t& k, u64 h, bool& found)
+    {
+        const shm_segment::header* hd = seg.hdr();
+        slot* s = slots();
+        u64 mask = hd->capacity - 1, i = h & mask;
+        slot* avail = 0;
+
+        for (u64 n = 0; n < hd->capacity; n++, i = (i + 1) & mask) {
+            if (s[i].hash == empty_hash) {
+                found = false;
+                return avail ? avail : s + i;
+            }
+            if (s[i].hash == erased_hash) {
+                if (!avail) avail = s + i;
+                continue;
+            }
+            if (s[i].hash == h &&
+                kcodec::equal(arena(), hd->arena_size, s[i].key, k)) {
+                found = true;
+                return s + i;
+            }
+        }
+
+        found = false;
+        return avail;
+    }
+
+    // the reader's probe, within a read section
+    static bool probe(const shm_segment::layout& l, const key_t& k, u64 h,
+                      value_t* res)
+    {
+        const slot* s = reinterpret_cast<const slot*>(l.slots);
+        u64 mask = l.capacity - 1, i = h & mask;
+
+        for (u64 n = 0; n < l.capacity; n++, i = (i + 1) & mask) {
+            slot tmp;
+            std::memcpy(&tmp, s + i, sizeof(slot));
+
+            if (tmp.hash == empty_hash) return false;
+            if (tmp.hash != h ||
+                !kcodec::equal(l.arena, l.arena_size, tmp.key, k)) {
+                continue;
+            }
+            return !res || vcodec::load(l.arena, l.arena_size, tmp.value, *res);
+        }
+        return false;
+    }
+
+    // Moves the live entries to a new slot array of the given capacity
+    // and a new arena of the given size, then publishes them.
+    void relocate(u64 capacity, u64 arena_size)
+    {
+        u64 slots_bytes = capacity * sizeof(slot);
+        u64 offset = seg.allocate(slots_bytes + arena_size);
+
+        const shm_segment::header* hd = seg.hdr();
+        const slot* from = slots();
+        const char* from_arena = arena();
+
+        slot* to = reinterpret_cast<slot*>(seg.at(offset));
+        char* to_arena = seg.at(offset + slots_bytes);
+        std::memset(to, 0, slots_bytes);
+
+        u64 used = 0, mask = capacity - 1;
+        for (u64 i = 0; i < hd->capacity; i++) {
+            if (from[i].hash <= erased_hash) continue;
+
+            u64 j = from[i].hash & mask;
+            while (to[j].hash != empty_hash) j = (j + 1) & mask;
+
+            to[j].hash = from[i].hash;
+            to[j].key = kcodec::copy(from_arena, to_arena, used, from[i].key);
+            to[j].value = vcodec::copy(from_arena, to_arena, used, from[i].value);
+        }
+
+        seg.write_begin();
+        shm_segment::header* h = seg.hdr();
+        h->total_size = seg.total_size();
+        h->slots_offset = offset;
+        h->capacity = capacity;
+        h->tombstones = 0;
+        h->arena_offset = offset + slots_bytes;
+        h->arena_size = arena_size;
+        h->arena_used = used;
+        h->arena_dead = 0;
+        seg.write_end();
+    }
+
+public:
+    // creates a segment for about n entries and arena_bytes of strings
+    shm_table(const std::string& name, int key_type, int value_type,
+              u64 n, u64 arena_bytes)
+        : seg(name, true, true, key_type, value_type, sizeof(slot),
+              capacity_for(n), arena_bytes + arena_bytes / 4 + 4096)
+    {}
+
+    // opens an existing segment
+    shm_table(const std::string& name, int key_type, int value_type,
+              bool writable)
+        : seg(name, false, writable, key_type, value_type, sizeof(slot), 0, 0)
+    {}
+
+    const std::string& name() const
+    { return seg.name(); }
+
+    bool writable() const
+    { return seg.writable(); }
+
+    // The modifiers below (reserve, insert, erase, clear) may only be
+    // used by the writer: call this first, once per batch (it costs a
+    // system call).
+    void check_writable() const
+    { seg.check_writable(); }
+
+    size_type size() const
+    {
+        for (;;) {
+            u64 s = seg.read_begin();
+            u64 res = __atomic_load_n(&seg.hdr()->size, __ATOMIC_RELAXED);
+            if (!seg.read_retry(s)) return (size_type)res;
+        }
+    }
+
+    // Looks up ks[0], ..., ks[n - 1] within a single read; found[i]
+    // tells whether res[i] was set.
+    void find(const key_t* ks, size_type n, value_t* res, bool* found)
+    {
+        std::vector<u64> hs(n);
+        for (size_type i = 0; i < n; i++) hs[i] = slot_hash(ks[i]);
+
+        for (;;) {
+            u64 s = seg.read_begin();
+            shm_segment::layout l;
+            if (!seg.read_layout(l, sizeof(slot))) continue;
+
+            for (size_type i = 0; i < n; i++) {
+                found[i] = probe(l, ks[i], hs[i], res ? res + i : 0);
+            }
+            if (!seg.read_retry(s)) return;
+        }
+    }
+
+    // Copies all entries, within a single read.
+    void entries(std::vector<key_t>& ks, std::vector<value_t>& vs)
+    {
+        for (;;) {
+            ks.clear();
+            vs.clear();
+
+            u64 s = seg.read_begin();
+            shm_segment::layout l;
+            if (!seg.read_layout(l, sizeof(slot))) continue;
+
+            const slot* sl = reinterpret_cast<const slot*>(l.slots);
+            bool ok = true;
+            for (u64 i = 0; ok && i < l.capacity; i++) {
+                slot tmp;
+                std::memcpy(&tmp, sl + i, sizeof(slot));
+                if (tmp.hash <= erased_hash) continue;
+
+                // (std::vector<bool>::back() is not an lvalue)
+                key_t k;
+                value_t v;
+                ok = kcodec::load(l.arena, l.arena_size, tmp.key, k) &&
+                    vcodec::load(l.arena, l.arena_size, tmp.value, v);
+                ks.push_back(k);
+                vs.push_back(v);
+            }
+            if (seg.read_retry(s)) continue;
+            if (!ok) throw std::runtime_error(
+                "shared Hashmap '" + name() + "' is corrupt"
+            );
+            return;
+        }
+    }
+
+    // Makes room for n more entries holding the given number of
+    // string bytes, so that inserting them does not relocate.
+    void reserve(u64 n, u64 bytes = 0)
+    {
+        const shm_segment::header* h = seg.hdr();
+
+        bool slots_full = (h->size + h->tombstones + n) * 10 > h->capacity * 7;
+        bool arena_full = h->arena_used + bytes > h->arena_size;
+        if (!slots_full && !arena_full) return;
+
+        u64 capacity = h->capacity;
+        if (slots_full) {
+            // erased slots are dropped by relocating
+            u64 need = capacity_for(h->size + n);
+            if (need > capacity) capacity = need;
+        }
+
+        u64 live = h->arena_used - h->arena_dead + bytes;
+        u64 arena_size = h->arena_size;
+        if (arena_full || live * 2 > arena_size) {
+            arena_size = live * 2 > 4096 ? live * 2 : 4096;
+        }
+
+        relocate(capacity, arena_size);
+    }
+
+    // returns true if k was not previously present
+    bool insert(const key_t& k, const value_t& v)
+    {
+        reserve(1, kcodec::bytes(k) + vcodec::bytes(v));
+
+        u64 h = slot_hash(k);
+        bool found;
+        slot* s = locate(k, h, found);
+
+        shm_segment::header* hd = seg.hdr();
+        char* a = arena();
+
+        seg.write_begin();
+        if (found) {
+            hd->arena_dead += vcodec::bytes(s->value, 0);
+        } else {
+            if (s->hash == erased_hash) --hd->tombstones;
+            s->key = kcodec::store(a, hd->arena_used, k);
+            s->hash = h;
+            ++hd->size;
+        }
+        s->value = vcodec::store(a, hd->arena_used, v);
+        seg.write_end();
+
+        return !found;
+    }
+
+    // returns true if k was present
+    bool erase(const key_t& k)
+    {
+        bool found;
+        slot* s = locate(k, slot_hash(k), found);
+        if (!found) return false;
+
+        shm_segment::header* hd = seg.hdr();
+        u64 dead = kcodec::bytes(s->key, 0) + vcodec::bytes(s->value, 0);
+
+        seg.write_begin();
+        s->hash = erased_hash;
+        --hd->size;
+        ++hd->tombstones;
+        hd->arena_dead += dead;
+        seg.write_end();
+
+        return true;
+    }
+
+    void clear()
+    {
+        shm_segment::header* hd = seg.hdr();
+
+        seg.write_begin();
+        std::memset(slots(), 0, hd->capacity * sizeof(slot));
+        hd->size = 0;
+        hd->tombstones = 0;
+        hd->arena_used = 0;
+        hd->arena_dead = 0;
+        seg.write_end();
+    }
+};
+
+} // hashmap
+
+#endif // hashmap__shm_table__hpp
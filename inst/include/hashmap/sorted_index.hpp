@@ -0,0 +1,235 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// sorted_index.hpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#ifndef hashmap__sorted_index__hpp
+#define hashmap__sorted_index__hpp
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+namespace hashmap {
+
+// Ordered view of a table's keys used for range / nearest key
+// queries: a sorted array plus a small buffer of recently added
+// keys. The buffer is sorted on demand and merged into the main
+// array once it grows beyond ~1/16th of it, so that a stream of
+// small inserts between queries does not cost a full merge each
+// time. Queries consult both arrays.
+//
+// Erased keys are only noted, and taken out of both arrays in one
+// pass by the next flush(), so that erasing keys one at a time does
+// not move the array each time; the index is dropped (to be built
+// again on demand) once the erased keys pending outnumber half of
+// those indexed.
+//
+// The index is built lazily on the first query (see build()) and
+// is only maintained while active(); the owner is expected to call
+// add() / remove() for keys entering / leaving the table, and
+// invalidate() on bulk changes.
+template <typename KeyType>
+class sorted_index {
+public:
+    typedef KeyType key_t;
+    typedef std::size_t size_type;
+    typedef typename std::vector<key_t>::const_iterator const_iterator;
+
+private:
+    std::vector<key_t> main_;
+    std::vector<key_t> buffer;
+    // keys erased since the last flush(); a key may be added again
+    // after being erased, so main_ and buffer hold it as many times
+    // as it was added, and it is present iff that is more often
+    // than it appears here
+    std::vector<key_t> erased;
+
+    bool active_;
+    bool buffer_sorted;
+
+    enum { min_merge = 64, max_erased_ratio = 2 };
+
+    // main_ and buffer merged, less the erased keys
+    void apply_erased()
+    {
+        std::sort(erased.begin(), erased.end());
+
+        std::vector<key_t> tmp, res;
+        tmp.reserve(main_.size() + buffer.size());
+        std::merge(
+            main_.begin(), main_.end(),
+            buffer.begin(), buffer.end(),
+            std::back_inserter(tmp)
+        );
+
+        res.reserve(tmp.size() - erased.size());
+        std::set_difference(
+            tmp.begin(), tmp.end(),
+            erased.begin(), erased.end(),
+            std::back_inserter(res)
+        );
+
+        main_.swap(res);
+        buffer.clear();
+        std::vector<key_t>().swap(erased);
+    }
+
+    void merge_buffer()
+    {
+        std::vector<key_t> tmp;
+        tmp.reserve(main_.size() + buffer.size());
+        std::merge(
+            main_.begin(), main_.end(),
+            buffer.begin(), buffer.end(),
+            std::back_inserter(tmp)
+        );
+        main_.swap(tmp);
+        buffer.clear();
+    }
+
+    // largest element <= k in v, or NULL
+    static const key_t* floor_in(const std::vector<key_t>& v, const key_t& k)
+    {
+        const_iterator pos = std::upper_bound(v.begin(), v.end(), k);
+        return pos == v.begin() ? 0 : &*(pos - 1);
+    }
+
+    // smallest element >= k in v, or NULL
+    static const key_t* ceiling_in(const std::vector<key_t>& v, const key_t& k)
+    {
+        const_iterator pos = std::lower_bound(v.begin(), v.end(), k);
+        return pos == v.end() ? 0 : &*pos;
+    }
+
+public:
+    sorted_index()
+        : active_(false), buffer_sorted(true)
+    {}
+
+    bool active() const
+    { return active_; }
+
+    size_type size() const
+    { return main_.size() + buffer.size() - erased.size(); }
+
+    void invalidate()
+    {
+        std::vector<key_t>().swap(main_);
+        std::vector<key_t>().swap(buffer);
+        std::vector<key_t>().swap(erased);
+        active_ = false;
+        buffer_sorted = true;
+    }
+
+    // keys must be unique
+    template <typename InputIterator>
+    void build(InputIterator first, InputIterator last)
+    {
+        invalidate();
+        main_.assign(first, last);
+        std::sort(main_.begin(), main_.end());
+        active_ = true;
+    }
+
+    // k must not already be present
+    void add(const key_t& k)
+    {
+        if (!active_) return;
+        buffer.push_back(k);
+        buffer_sorted = false;
+    }
+
+    // k must be present
+    void remove(const key_t& k)
+    {
+        if (!active_) return;
+        erased.push_back(k);
+
+        if (erased.size() > min_merge &&
+                erased.size() > size() / max_erased_ratio) {
+            invalidate();
+        }
+    }
+
+    // readies the index for queries
+    void flush()
+    {
+        if (buffer_sorted && erased.empty()) return;
+
+        std::sort(buffer.begin(), buffer.end());
+        buffer_sorted = true;
+
+        if (!erased.empty()) {
+            apply_erased();
+            return;
+        }
+
+        if (buffer.size() > min_merge &&
+                buffer.size() > main_.size() / 16) {
+            merge_buffer();
+        }
+    }
+
+    const key_t* floor(const key_t& k) const
+    {
+        const key_t* a = floor_in(main_, k);
+        const key_t* b = floor_in(buffer, k);
+        if (!a) return b;
+        if (!b) return a;
+        return *a < *b ? b : a;
+    }
+
+    const key_t* ceiling(const key_t& k) const
+    {
+        const key_t* a = ceiling_in(main_, k);
+        const key_t* b = ceiling_in(buffer, k);
+        if (!a) return b;
+        if (!b) return a;
+        return *b < *a ? b : a;
+    }
+
+    // number of keys <= k
+    size_type rank(const key_t& k) const
+    {
+        return (std::upper_bound(main_.begin(), main_.end(), k) -
+            main_.begin()) +
+            (std::upper_bound(buffer.begin(), buffer.end(), k) -
+            buffer.begin());
+    }
+
+    // appends all keys in [lo, hi], in increasing order, to out
+    void range(const key_t& lo, const key_t& hi,
+               std::vector<key_t>& out) const
+    {
+        if (hi < lo) return;
+
+        std::merge(
+            std::lower_bound(main_.begin(), main_.end(), lo),
+            std::upper_bound(main_.begin(), main_.end(), hi),
+            std::lower_bound(buffer.begin(), buffer.end(), lo),
+            std::upper_bound(buffer.begin(), buffer.end(), hi),
+            std::back_inserter(out)
+        );
+    }
+};
+
+} // hashmap
+
+#endif // hashmap__sorted_index__hpp
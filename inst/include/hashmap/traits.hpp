@@ -22,6 +22,7 @@
 #define hashmap__traits__hpp
 
 #include "utils.hpp"
+#include <climits>
 
 namespace hashmap {
 namespace traits {
@@ -49,6 +50,260 @@ template <>
 inline std::string get_na<std::string>()
 { return "NA"; }
 
+inline bool is_na_key(int x)
+{ return x == NA_INTEGER; }
+
+inline bool is_na_key(double x)
+{ return ISNAN(x); }
+
+inline bool is_na_key(const std::string&)
+{ return false; }
+
+// first element of x, whose SEXPTYPE must already be that of T
+template <typename T>
+inline T scalar_value(SEXP x);
+
+template <>
+inline int scalar_value<int>(SEXP x)
+{ return INTEGER(x)[0]; }
+
+template <>
+inline double scalar_value<double>(SEXP x)
+{ return REAL(x)[0]; }
+
+template <>
+inline bool scalar_value<bool>(SEXP x)
+{ return LOGICAL(x)[0]; }
+
+template <>
+inline Rcomplex scalar_value<Rcomplex>(SEXP x)
+{ return COMPLEX(x)[0]; }
+
+template <>
+inline std::string scalar_value<std::string>(SEXP x)
+{ return CHAR(STRING_ELT(x, 0)); }
+
+// length-one R vector holding x
+inline SEXP scalar_sexp(int x)
+{ return Rf_ScalarInteger(x); }
+
+inline SEXP scalar_sexp(double x)
+{ return Rf_ScalarReal(x); }
+
+inline SEXP scalar_sexp(bool x)
+{ return Rf_ScalarLogical(x); }
+
+inline SEXP scalar_sexp(const Rcomplex& x)
+{ return Rf_ScalarComplex(x); }
+
+inline SEXP scalar_sexp(const std::string& x)
+{ return Rf_mkString(x.c_str()); }
+
+// element types of the raw arrays exchanged through the C API
+// (hashmap_api.h): logical values travel as int, strings as
+// const char* (NULL meaning NA)
+template <typename T>
+struct api_traits {
+    typedef T type;
+
+    static T from(const type& x)
+    { return x; }
+
+    static type to(const T& x)
+    { return x; }
+
+    static type na()
+    { return get_na<T>(); }
+};
+
+template <>
+struct api_traits<bool> {
+    typedef int type;
+
+    static bool from(type x)
+    { return x; }
+
+    static type to(bool x)
+    { return x; }
+
+    static type na()
+    { return NA_LOGICAL; }
+};
+
+template <>
+struct api_traits<std::string> {
+    typedef const char* type;
+
+    static std::string from(type x)
+    { return x ? x : "NA"; }
+
+    static type to(const std::string& x)
+    { return x.c_str(); }
+
+    static type na()
+    { return 0; }
+};
+
+// value equality as seen by HashMap::update(policy = "error"): NA
+// equals NA, and NaN equals NaN
+template <typename T>
+inline bool values_equal(const T& x, const T& y)
+{ return x == y; }
+
+template <>
+inline bool values_equal<double>(const double& x, const double& y)
+{
+    if (R_IsNA(x) || R_IsNA(y)) return R_IsNA(x) && R_IsNA(y);
+    if (ISNAN(x) || ISNAN(y)) return ISNAN(x) && ISNAN(y);
+    return x == y;
+}
+
+template <>
+inline bool values_equal<Rcomplex>(const Rcomplex& x, const Rcomplex& y)
+{ return values_equal(x.r, y.r) && values_equal(x.i, y.i); }
+
+// NA values, as stored: character NA is kept as the string "NA",
+// and logical values cannot hold NA
+inline bool is_na_value(int x)
+{ return x == NA_INTEGER; }
+
+inline bool is_na_value(double x)
+{ return ISNAN(x); }
+
+inline bool is_na_value(bool)
+{ return false; }
+
+inline bool is_na_value(const Rcomplex& x)
+{ return ISNAN(x.r) || ISNAN(x.i); }
+
+inline bool is_na_value(const std::string& x)
+{ return x == "NA"; }
+
+// Value arithmetic for HashMap::update ("sum", "min", "max") and
+// HashMap::transform. Only integer and numeric values are arithmetic,
+// and only numeric values are fractional (support / and ^); the
+// remaining operations of other types are never called. As in R, NA
+// is contagious and integer overflow gives NA (and sets overflow).
+template <typename T>
+struct no_combine {
+    enum { arithmetic = 0, fractional = 0 };
+
+    static T sum(const T& x, const T&, bool&)
+    { return x; }
+
+    static T diff(const T& x, const T&, bool&)
+    { return x; }
+
+    static T prod(const T& x, const T&, bool&)
+    { return x; }
+
+    static T quot(const T& x, const T&)
+    { return x; }
+
+    static T power(const T& x, const T&)
+    { return x; }
+
+    static T min(const T& x, const T&)
+    { return x; }
+
+    static T max(const T& x, const T&)
+    { return x; }
+
+    static bool less(const T&, const T&)
+    { return false; }
+};
+
+template <typename T>
+struct value_combine
+    : public no_combine<T>
+{};
+
+template <>
+struct value_combine<int>
+    : public no_combine<int>
+{
+    enum { arithmetic = 1, fractional = 0 };
+
+    static int checked(double x, bool& overflow)
+    {
+        if (x > INT_MAX || x <= INT_MIN) {
+            overflow = true;
+            return NA_INTEGER;
+        }
+        return (int)x;
+    }
+
+    static int sum(int x, int y, bool& overflow)
+    {
+        if (x == NA_INTEGER || y == NA_INTEGER) return NA_INTEGER;
+        return checked((double)x + (double)y, overflow);
+    }
+
+    static int diff(int x, int y, bool& overflow)
+    {
+        if (x == NA_INTEGER || y == NA_INTEGER) return NA_INTEGER;
+        return checked((double)x - (double)y, overflow);
+    }
+
+    static int prod(int x, int y, bool& overflow)
+    {
+        if (x == NA_INTEGER || y == NA_INTEGER) return NA_INTEGER;
+        return checked((double)x * (double)y, overflow);
+    }
+
+    static int min(int x, int y)
+    {
+        if (x == NA_INTEGER || y == NA_INTEGER) return NA_INTEGER;
+        return x < y ? x : y;
+    }
+
+    static int max(int x, int y)
+    {
+        if (x == NA_INTEGER || y == NA_INTEGER) return NA_INTEGER;
+        return x < y ? y : x;
+    }
+
+    static bool less(int x, int y)
+    { return x < y; }
+};
+
+template <>
+struct value_combine<double>
+    : public no_combine<double>
+{
+    enum { arithmetic = 1, fractional = 1 };
+
+    static double sum(double x, double y, bool&)
+    { return x + y; }
+
+    static double diff(double x, double y, bool&)
+    { return x - y; }
+
+    static double prod(double x, double y, bool&)
+    { return x * y; }
+
+    static double quot(double x, double y)
+    { return x / y; }
+
+    static double power(double x, double y)
+    { return R_pow(x, y); }
+
+    static double min(double x, double y)
+    {
+        if (ISNAN(x) || ISNAN(y)) return x + y;
+        return x < y ? x : y;
+    }
+
+    static double max(double x, double y)
+    {
+        if (ISNAN(x) || ISNAN(y)) return x + y;
+        return x < y ? y : x;
+    }
+
+    static bool less(double x, double y)
+    { return x < y; }
+};
+
 // fix me
 template <int RTYPE>
 inline Rcpp::Vector<RTYPE>
@@ -86,6 +86,22 @@ inline std::string sexptype_name(SEXP x) {
     return std::string("");
 }
 
+// Returns the C++ object behind an Rcpp module object of class
+// cls (e.g. "Rcpp_Hashset"), or NULL if x is not one.
+template <typename T>
+inline T* module_object(SEXP x, const char* cls) {
+    if (!Rf_isS4(x) || !Rf_inherits(x, cls)) return 0;
+
+    Rcpp::Environment env(x);
+    SEXP xp = env.get(".pointer");
+
+    if (TYPEOF(xp) != EXTPTRSXP || !R_ExternalPtrAddr(xp)) {
+        Rcpp::stop("Invalid (NULL) %s object pointer", cls);
+    }
+
+    return static_cast<T*>(R_ExternalPtrAddr(xp));
+}
+
 } // utils
 } // hashmap
 
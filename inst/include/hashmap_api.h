@@ -0,0 +1,178 @@
+/* vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+ *
+ * hashmap_api.h
+ *
+ * Copyright (C) 2016 - 2017 Nathan Russell
+ *
+ * This file is part of hashmap.
+ *
+ * hashmap is free software: you can redistribute it and/or
+ * modify it under the terms of the MIT License.
+ *
+ * hashmap is provided "as is", without warranty of any kind,
+ * express or implied, including but not limited to the
+ * warranties of merchantability, fitness for a particular
+ * purpose and noninfringement.
+ *
+ * You should have received a copy of the MIT License
+ * along with hashmap. If not, see
+ * <https://opensource.org/licenses/MIT>.
+ */
+
+/*
+ * C interface to Hashmap objects created in R, for use by other
+ * packages (LinkingTo: hashmap) without compiling the hashmap
+ * templates. The functions are resolved at run time through
+ * R_GetCCallable, so the calling package must ensure that hashmap
+ * is loaded (e.g. Imports: hashmap plus an import in its NAMESPACE).
+ *
+ * Keys and values are exchanged as plain C arrays whose element
+ * types depend on the SEXPTYPE of the map's keys / values:
+ *
+ *      INTSXP      int
+ *      REALSXP     double
+ *      LGLSXP      int (values only)
+ *      CPLXSXP     Rcomplex (values only)
+ *      STRSXP      const char* (NULL for NA)
+ *
+ * Strings returned by hashmap_find and hashmap_iterate point into
+ * the map and remain valid until the map is next modified. Maps
+ * whose character values are dictionary-encoded ($encoded()) are
+ * used in the same way, except that hashmap_insert refuses (with
+ * HASHMAP_ERR_TYPE, inserting nothing) values which are not among
+ * the map's distinct strings yet, as these are created through R;
+ * call $set_encoded(FALSE) first to insert them. Maps with factor
+ * keys or values, which are stored as codes into their levels, are
+ * refused with HASHMAP_ERR_TYPE by all but hashmap_types and
+ * hashmap_size.
+ *
+ * A handle borrows the Hashmap it was obtained from; the caller
+ * must keep that R object alive (protected) while using it. Apart
+ * from hashmap_handle_from, the functions do not call the R API or
+ * raise R errors, but a map must not be modified while another
+ * thread is reading it.
+ */
+
+#ifndef hashmap_api__h
+#define hashmap_api__h
+
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/Rdynload.h>
+
+#define HASHMAP_API_VERSION 1
+
+/* status codes */
+#define HASHMAP_OK              0
+#define HASHMAP_ERR_INVALID     1   /* not a Hashmap, or NULL handle */
+#define HASHMAP_ERR_TYPE        2   /* key / value type mismatch */
+#define HASHMAP_ERR_FROZEN      3   /* modification of a frozen map */
+#define HASHMAP_ERR_INTERNAL    4   /* any other failure */
+
+typedef struct hashmap_handle_ *hashmap_handle;
+
+/* called for each entry; return 0 to stop the iteration */
+typedef int (*hashmap_visit_fn)(const void* key, const void* value,
+                                void* data);
+
+/* signatures of the registered routines */
+typedef int (*hashmap_api_version_t)(void);
+typedef int (*hashmap_handle_from_t)(SEXP, hashmap_handle*);
+typedef int (*hashmap_types_t)(hashmap_handle, int*, int*);
+typedef int (*hashmap_size_t)(hashmap_handle, R_xlen_t*);
+typedef int (*hashmap_find_t)(hashmap_handle, int, const void*, R_xlen_t,
+                              int, void*, int*);
+typedef int (*hashmap_insert_t)(hashmap_handle, int, const void*,
+                                int, const void*, R_xlen_t);
+typedef int (*hashmap_erase_t)(hashmap_handle, int, const void*, R_xlen_t);
+typedef int (*hashmap_iterate_t)(hashmap_handle, hashmap_visit_fn, void*);
+
+#ifndef HASHMAP_API_IMPLEMENTATION
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HASHMAP_API_FUN(name_)                                      \
+    static name_##_t fun = NULL;                                    \
+    if (!fun) fun = (name_##_t)R_GetCCallable("hashmap", #name_)
+
+/* version of the API implemented by the installed hashmap; compare
+   with HASHMAP_API_VERSION before relying on newer functions */
+static R_INLINE int hashmap_api_version(void)
+{
+    HASHMAP_API_FUN(hashmap_api_version);
+    return fun();
+}
+
+/* x is a Hashmap object or its external pointer (x$.pointer) */
+static R_INLINE int hashmap_handle_from(SEXP x, hashmap_handle* out)
+{
+    HASHMAP_API_FUN(hashmap_handle_from);
+    return fun(x, out);
+}
+
+/* SEXPTYPEs of the keys and values */
+static R_INLINE int hashmap_types(hashmap_handle h,
+                                  int* key_type, int* value_type)
+{
+    HASHMAP_API_FUN(hashmap_types);
+    return fun(h, key_type, value_type);
+}
+
+static R_INLINE int hashmap_size(hashmap_handle h, R_xlen_t* out)
+{
+    HASHMAP_API_FUN(hashmap_size);
+    return fun(h, out);
+}
+
+/* looks up keys[0 .. n - 1]; values (if not NULL) receive the
+   associated values, or NA, and found (if not NULL) receives 1 or 0.
+   key_type and value_type must match hashmap_types */
+static R_INLINE int hashmap_find(hashmap_handle h,
+                                 int key_type, const void* keys,
+                                 R_xlen_t n,
+                                 int value_type, void* values,
+                                 int* found)
+{
+    HASHMAP_API_FUN(hashmap_find);
+    return fun(h, key_type, keys, n, value_type, values, found);
+}
+
+/* inserts or overwrites keys[i] => values[i], i = 0 .. n - 1 */
+static R_INLINE int hashmap_insert(hashmap_handle h,
+                                   int key_type, const void* keys,
+                                   int value_type, const void* values,
+                                   R_xlen_t n)
+{
+    HASHMAP_API_FUN(hashmap_insert);
+    return fun(h, key_type, keys, value_type, values, n);
+}
+
+/* erases keys[0 .. n - 1], ignoring those that are absent; key_type
+   must match hashmap_types */
+static R_INLINE int hashmap_erase(hashmap_handle h,
+                                  int key_type, const void* keys,
+                                  R_xlen_t n)
+{
+    HASHMAP_API_FUN(hashmap_erase);
+    return fun(h, key_type, keys, n);
+}
+
+/* calls fn(&key, &value, data) for each entry, in storage order */
+static R_INLINE int hashmap_iterate(hashmap_handle h,
+                                    hashmap_visit_fn fn, void* data)
+{
+    HASHMAP_API_FUN(hashmap_iterate);
+    return fun(h, fn, data);
+}
+
+#undef HASHMAP_API_FUN
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HASHMAP_API_IMPLEMENTATION */
+
+#endif /* hashmap_api__h */
@@ -0,0 +1,42 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// HashCursorClass.cpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#include "../inst/include/hashmap/HashCursorClass.h"
+#include "../inst/include/hashmap/factor_dict.hpp"
+
+namespace hashmap {
+
+HashCursor::HashCursor(const cursor_ptr& impl_)
+    : impl(impl_)
+{}
+
+SEXP HashCursor::next_chunk(int n)
+{ return factor_dict::decode(impl->next_chunk(n)); }
+
+bool HashCursor::has_next() const
+{ return impl->has_next(); }
+
+double HashCursor::position() const
+{ return impl->position(); }
+
+void HashCursor::reset()
+{ impl->reset(); }
+
+} // hashmap
@@ -0,0 +1,142 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// HashIndexClass.cpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#include "../inst/include/hashmap/IndexTemplate.hpp"
+#include <boost/make_shared.hpp>
+
+namespace hashmap {
+
+template <typename T>
+variant_index HashIndex::clone_visitor::operator()(const T& t) const
+{
+    typedef typename T::element_type index_t;
+    return variant_index(boost::make_shared<index_t>(t->clone()));
+}
+
+template <typename T>
+std::size_t HashIndex::size_visitor::operator()(const T& t) const
+{ return t->size(); }
+
+template <typename T>
+double HashIndex::length_visitor::operator()(const T& t) const
+{ return (double)t->length(); }
+
+template <typename T>
+int HashIndex::key_sexptype_visitor::operator()(const T& t) const
+{ return t->key_sexptype(); }
+
+HashIndex::match_visitor::match_visitor(SEXP keys_, int nomatch_)
+    : keys(keys_), nomatch(nomatch_)
+{}
+
+template <typename T>
+SEXP HashIndex::match_visitor::operator()(const T& t) const
+{ return Rcpp::wrap(t->match(keys, nomatch)); }
+
+HashIndex::contains_visitor::contains_visitor(SEXP keys_)
+    : keys(keys_)
+{}
+
+template <typename T>
+SEXP HashIndex::contains_visitor::operator()(const T& t) const
+{ return Rcpp::wrap(t->contains(keys)); }
+
+HashIndex::any_duplicated_visitor::any_duplicated_visitor(SEXP keys_)
+    : keys(keys_)
+{}
+
+template <typename T>
+double HashIndex::any_duplicated_visitor::operator()(const T& t) const
+{
+    if (Rf_isNull(keys)) return t->any_duplicated();
+    return t->any_duplicated(keys);
+}
+
+HashIndex::tabulate_visitor::tabulate_visitor(SEXP keys_)
+    : keys(keys_)
+{}
+
+template <typename T>
+SEXP HashIndex::tabulate_visitor::operator()(const T& t) const
+{ return Rcpp::wrap(t->tabulate(keys)); }
+
+HashIndex::HashIndex(SEXP x)
+{
+    switch (TYPEOF(x)) {
+        case STRSXP: {
+            variant = boost::make_shared<s_index>(
+                Rcpp::as<Rcpp::CharacterVector>(x)
+            );
+            break;
+        }
+        case REALSXP: {
+            variant = boost::make_shared<d_index>(
+                Rcpp::as<Rcpp::NumericVector>(x)
+            );
+            break;
+        }
+        case INTSXP: {
+            variant = boost::make_shared<i_index>(
+                Rcpp::as<Rcpp::IntegerVector>(x)
+            );
+            break;
+        }
+        default: {
+            Rcpp::stop("Invalid key type!");
+            break;
+        }
+    }
+}
+
+HashIndex::HashIndex(const HashIndex& other)
+    : variant(boost::apply_visitor(clone_visitor(), other.variant))
+{}
+
+int HashIndex::size() const
+{ return boost::apply_visitor(size_visitor(), variant); }
+
+double HashIndex::length() const
+{ return boost::apply_visitor(length_visitor(), variant); }
+
+int HashIndex::key_sexptype() const
+{ return boost::apply_visitor(key_sexptype_visitor(), variant); }
+
+SEXP HashIndex::match(SEXP x) const
+{ return match_nomatch(x, NA_INTEGER); }
+
+SEXP HashIndex::match_nomatch(SEXP x, int nomatch) const
+{ return boost::apply_visitor(match_visitor(x, nomatch), variant); }
+
+SEXP HashIndex::contains(SEXP x) const
+{ return boost::apply_visitor(contains_visitor(x), variant); }
+
+double HashIndex::any_duplicated() const
+{ return boost::apply_visitor(any_duplicated_visitor(R_NilValue), variant); }
+
+double HashIndex::any_duplicated_in(SEXP x) const
+{
+    if (Rf_isNull(x)) return any_duplicated();
+    return boost::apply_visitor(any_duplicated_visitor(x), variant);
+}
+
+SEXP HashIndex::tabulate(SEXP x) const
+{ return boost::apply_visitor(tabulate_visitor(x), variant); }
+
+} // hashmap
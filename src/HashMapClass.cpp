@@ -19,580 +19,394 @@
 // <https://opensource.org/licenses/MIT>.
 
 #include "../inst/include/hashmap/HashTemplate.hpp"
-#include <boost/make_shared.hpp>
+#include "../inst/include/hashmap/EngineTemplate.hpp"
 
 namespace hashmap {
+namespace {
 
-template <typename T>
-variant_hash HashMap::clone_visitor::operator()(const T& t) const
-{ return variant_hash(t->clone()); }
-
-template <typename T>
-std::size_t HashMap::size_visitor::operator()(const T& t) const
-{ return t->size(); }
-
-template <typename T>
-bool HashMap::empty_visitor::operator()(const T& t) const
-{ return t->empty(); }
-
-template <typename T>
-bool HashMap::keys_cached_visitor::operator()(const T& t) const
-{ return t->keys_cached(); }
-
-template <typename T>
-bool HashMap::values_cached_visitor::operator()(const T& t) const
-{ return t->values_cached(); }
-
-template <typename T>
-int HashMap::key_sexptype_visitor::operator()(const T& t) const
-{ return t->key_sexptype(); }
-
-template <typename T>
-int HashMap::value_sexptype_visitor::operator()(const T& t) const
-{ return t->value_sexptype(); }
-
-HashMap::key_vector_visitor::key_vector_visitor(int n_)
-    : n(n_)
-{}
-
-template <typename T>
-SEXP HashMap::key_vector_visitor::operator()(const T& t) const
-{ return t->key_vector(n); }
-
-HashMap::value_vector_visitor::value_vector_visitor(int n_)
-    : n(n_)
-{}
-
-template <typename T>
-SEXP HashMap::value_vector_visitor::operator()(const T& t) const
-{ return t->value_vector(n); }
-
-HashMap::na_value_vector_visitor::na_value_vector_visitor(int n_)
-    : n(n_)
-{}
-
-template <typename T>
-SEXP HashMap::na_value_vector_visitor::operator()(const T& t) const
-{ return t->na_value_vector(n); }
-
-template <typename T>
-void HashMap::clear_visitor::operator()(T& t)
-{ t->clear(); }
+value_cmp parse_cmp(const std::string& op)
+{
+    if (op == "==") return cmp_eq;
+    if (op == "!=") return cmp_ne;
+    if (op == "<") return cmp_lt;
+    if (op == "<=") return cmp_le;
+    if (op == ">") return cmp_gt;
+    if (op == ">=") return cmp_ge;
+
+    Rcpp::stop(
+        "Invalid comparison '%s'; expected one of "
+        "'==', '!=', '<', '<=', '>' or '>='",
+        op.c_str()
+    );
+    return cmp_eq;
+}
 
-template <typename T>
-std::size_t HashMap::bucket_count_visitor::operator()(const T& t) const
-{ return t->bucket_count(); }
+value_arith parse_arith(const std::string& op)
+{
+    if (op == "+") return arith_add;
+    if (op == "-") return arith_sub;
+    if (op == "*") return arith_mul;
+    if (op == "/") return arith_div;
+    if (op == "^") return arith_pow;
+
+    Rcpp::stop(
+        "Invalid operator '%s'; expected one of '+', '-', '*', '/' or '^'",
+        op.c_str()
+    );
+    return arith_add;
+}
 
-HashMap::rehash_visitor::rehash_visitor(std::size_t n_)
-    : n(n_)
-{}
+} // anonymous
 
-template <typename T>
-void HashMap::rehash_visitor::operator()(T& t)
-{ t->rehash(n); }
+// Character values with few distinct strings are stored encoded
+// (see factor_dict::encode); everything else as given.
+void HashMap::init(SEXP x, SEXP y, bool ordered)
+{
+    Rcpp::RObject values(factor_dict::encode(y));
+    impl = engine_registry::instance().create(x, values, ordered);
+}
 
-HashMap::reserve_visitor::reserve_visitor(std::size_t n_)
-    : n(n_)
-{}
+void HashMap::replace(HashMap& tmp)
+{
+    if (persistent()) tmp.set_persistent(true);
+
+    // the journal moves to the new table, starting from a checkpoint
+    // of its contents
+    if (durable()) {
+        std::string path = journal_path();
+        bool sync = journal_sync();
+        close_journal();
+        tmp.set_journal_sync(path, sync);
+    }
 
-template <typename T>
-void HashMap::reserve_visitor::operator()(T& t)
-{ t->reserve(n); }
+    // invalidates any cursors over the old table
+    clear();
+    impl = tmp.impl;
+}
 
-HashMap::hash_value_visitor::hash_value_visitor(SEXP keys_)
-    : keys(keys_)
-{}
+HashMap::HashMap(SEXP x, SEXP y)
+{ init(x, y, false); }
 
-template <typename T>
-SEXP HashMap::hash_value_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->hash_value(keys)); }
+HashMap::HashMap(SEXP x, SEXP y, bool ordered)
+{ init(x, y, ordered); }
 
-HashMap::insert_visitor::insert_visitor(SEXP keys_, SEXP values_)
-    : keys(keys_), values(values_)
+HashMap::HashMap(const engine_ptr& x)
+    : impl(x)
 {}
 
-template <typename T>
-void HashMap::insert_visitor::operator()(T& t)
-{ t->insert(keys, values); }
-
-template <typename T>
-SEXP HashMap::keys_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->keys()); }
-
-HashMap::keys_n_visitor::keys_n_visitor(int n_)
-    : n(n_)
+HashMap::HashMap(const Rcpp::XPtr<HashMap>& ptr)
+    : impl(ptr->impl->clone())
 {}
 
-template <typename T>
-SEXP HashMap::keys_n_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->keys_n(n)); }
-
-template <typename T>
-SEXP HashMap::values_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->values()); }
-
-HashMap::values_n_visitor::values_n_visitor(int n_)
-    : n(n_)
+HashMap::HashMap(const HashMap& other)
+    : impl(other.impl->clone())
 {}
 
-template <typename T>
-SEXP HashMap::values_n_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->values_n(n)); }
+HashMap HashMap::clone() const
+{ return HashMap(*this); }
 
-template <typename T>
-void HashMap::cache_keys_visitor::operator()(T& t)
-{ t->cache_keys(); }
+void HashMap::renew(SEXP x, SEXP y)
+{
+    if (frozen()) Rcpp::stop("Attempt to modify a frozen Hashmap");
 
-template <typename T>
-void HashMap::cache_values_visitor::operator()(T& t)
-{ t->cache_values(); }
+    // (encoded character values stay encoded, whatever their number
+    // of distinct strings)
+    Rcpp::RObject values(factor_dict::encode(y, encoded()));
+    HashMap tmp(engine_registry::instance().create(x, values, incremental()));
+    replace(tmp);
+}
 
-HashMap::erase_visitor::erase_visitor(SEXP keys_)
-    : keys(keys_)
-{}
+int HashMap::size() const
+{ return impl->size(); }
 
-template <typename T>
-void HashMap::erase_visitor::operator()(T& t)
-{ t->erase(keys); }
+bool HashMap::empty() const
+{ return impl->size() == 0; }
 
-HashMap::find_visitor::find_visitor(SEXP keys_)
-    : keys(keys_)
-{}
+bool HashMap::keys_cached() const
+{ return impl->keys_cached(); }
 
-template <typename T>
-SEXP HashMap::find_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->find(keys)); }
+bool HashMap::values_cached() const
+{ return impl->values_cached(); }
 
-HashMap::has_key_visitor::has_key_visitor(SEXP keys_)
-    : keys(keys_)
-{}
+bool HashMap::incremental() const
+{ return impl->incremental(); }
 
-template <typename T>
-bool HashMap::has_key_visitor::operator()(const T& t) const
-{ return t->has_key(keys); }
+void HashMap::set_incremental(bool flag)
+{ impl->set_incremental(flag); }
 
-HashMap::has_keys_visitor::has_keys_visitor(SEXP keys_)
-    : keys(keys_)
-{}
+bool HashMap::frozen() const
+{ return impl->frozen(); }
 
-template <typename T>
-SEXP HashMap::has_keys_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->has_keys(keys)); }
+void HashMap::freeze()
+{ impl->freeze(); }
 
-template <typename T>
-SEXP HashMap::data_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->data()); }
+bool HashMap::persistent() const
+{ return impl->persistent(); }
 
-HashMap::data_n_visitor::data_n_visitor(int n_)
-    : n(n_)
-{}
+void HashMap::set_persistent(bool flag)
+{ impl->set_persistent(flag); }
 
-template <typename T>
-SEXP HashMap::data_n_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->data_n(n)); }
+SEXP HashMap::snapshot()
+{ return Rcpp::internal::make_new_object(new HashMap(impl->snapshot())); }
 
-template <typename T>
-SEXP HashMap::data_frame_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->data_frame()); }
+bool HashMap::bloom() const
+{ return impl->bloom(); }
 
-template <typename T>
-std::string HashMap::key_class_name_visitor::operator()(const T& t) const
-{ return t->key_class_name(); }
+void HashMap::set_bloom(bool flag)
+{ set_bloom_bits(flag, 10.0); }
 
-template <typename T>
-std::string HashMap::value_class_name_visitor::operator()(const T& t) const
-{ return t->value_class_name(); }
+void HashMap::set_bloom_bits(bool flag, double bits_per_key)
+{ impl->set_bloom(flag, bits_per_key); }
 
-HashMap::left_outer_join_visitor::left_outer_join_visitor(const HashMap& other_)
-    : other(other_)
-{}
+void HashMap::set_journal(const std::string& path)
+{ set_journal_sync(path, true); }
 
-template <typename T>
-SEXP HashMap::left_outer_join_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->left_outer_join(other)); }
+void HashMap::set_journal_sync(const std::string& path, bool sync)
+{ impl->set_journal(path, sync); }
 
-HashMap::right_outer_join_visitor::right_outer_join_visitor(const HashMap& other_)
-    : other(other_)
-{}
+void HashMap::close_journal()
+{ impl->close_journal(); }
 
-template <typename T>
-SEXP HashMap::right_outer_join_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->right_outer_join(other)); }
+void HashMap::checkpoint()
+{ impl->checkpoint(); }
 
-HashMap::inner_join_visitor::inner_join_visitor(const HashMap& other_)
-    : other(other_)
-{}
+bool HashMap::durable() const
+{ return !journal_path().empty(); }
 
-template <typename T>
-SEXP HashMap::inner_join_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->inner_join(other)); }
+std::string HashMap::journal_path() const
+{ return impl->journal_path(); }
 
-HashMap::full_outer_join_visitor::full_outer_join_visitor(const HashMap& other_)
-    : other(other_)
-{}
+bool HashMap::journal_sync() const
+{ return impl->journal_sync(); }
 
-template <typename T>
-SEXP HashMap::full_outer_join_visitor::operator()(const T& t) const
-{ return Rcpp::wrap(t->full_outer_join(other)); }
+bool HashMap::encoded() const
+{ return impl->encoded(); }
 
-void HashMap::init(SEXP x, SEXP y)
+// Rebuilds the table with its values encoded (whatever their number
+// of distinct strings) or as plain strings.
+void HashMap::set_encoded(bool flag)
 {
-    switch (TYPEOF(x)) {
-        case INTSXP: {
-            switch (TYPEOF(y)) {
-                case INTSXP: {
-                    variant = boost::make_shared<ii_hash>(
-                        Rcpp::as<Rcpp::IntegerVector>(x),
-                        Rcpp::as<Rcpp::IntegerVector>(y)
-                    );
-                    break;
-                }
-                case REALSXP: {
-                    variant = boost::make_shared<id_hash>(
-                        Rcpp::as<Rcpp::IntegerVector>(x),
-                        Rcpp::as<Rcpp::NumericVector>(y)
-                    );
-                    break;
-                }
-                case STRSXP: {
-                    variant = boost::make_shared<is_hash>(
-                        Rcpp::as<Rcpp::IntegerVector>(x),
-                        Rcpp::as<Rcpp::CharacterVector>(y)
-                    );
-                    break;
-                }
-                case LGLSXP: {
-                    variant = boost::make_shared<ib_hash>(
-                        Rcpp::as<Rcpp::IntegerVector>(x),
-                        Rcpp::as<Rcpp::LogicalVector>(y)
-                    );
-                    break;
-                }
-                case CPLXSXP: {
-                    variant = boost::make_shared<ix_hash>(
-                        Rcpp::as<Rcpp::IntegerVector>(x),
-                        Rcpp::as<Rcpp::ComplexVector>(y)
-                    );
-                    break;
-                }
-                default: {
-                    Rcpp::stop("Invalid value type!");
-                    break;
-                }
-            }
-            break;
-        }
-
-        case REALSXP: {
-            switch (TYPEOF(y)) {
-                case INTSXP: {
-                    variant = boost::make_shared<di_hash>(
-                        Rcpp::as<Rcpp::NumericVector>(x),
-                        Rcpp::as<Rcpp::IntegerVector>(y)
-                    );
-                    break;
-                }
-                case REALSXP: {
-                    variant = boost::make_shared<dd_hash>(
-                        Rcpp::as<Rcpp::NumericVector>(x),
-                        Rcpp::as<Rcpp::NumericVector>(y)
-                    );
-                    break;
-                }
-                case STRSXP: {
-                    variant = boost::make_shared<ds_hash>(
-                        Rcpp::as<Rcpp::NumericVector>(x),
-                        Rcpp::as<Rcpp::CharacterVector>(y)
-                    );
-                    break;
-                }
-                case LGLSXP: {
-                    variant = boost::make_shared<db_hash>(
-                        Rcpp::as<Rcpp::NumericVector>(x),
-                        Rcpp::as<Rcpp::LogicalVector>(y)
-                    );
-                    break;
-                }
-                case CPLXSXP: {
-                    variant = boost::make_shared<dx_hash>(
-                        Rcpp::as<Rcpp::NumericVector>(x),
-                        Rcpp::as<Rcpp::ComplexVector>(y)
-                    );
-                    break;
-                }
-                default: {
-                    Rcpp::stop("Invalid value type!");
-                    break;
-                }
-            }
-            break;
-        }
-
-        case STRSXP: {
-            switch (TYPEOF(y)) {
-                case INTSXP: {
-                    variant = boost::make_shared<si_hash>(
-                        Rcpp::as<Rcpp::CharacterVector>(x),
-                        Rcpp::as<Rcpp::IntegerVector>(y)
-                    );
-                    break;
-                }
-                case REALSXP: {
-                    variant = boost::make_shared<sd_hash>(
-                        Rcpp::as<Rcpp::CharacterVector>(x),
-                        Rcpp::as<Rcpp::NumericVector>(y)
-                    );
-                    break;
-                }
-                case STRSXP: {
-                    variant = boost::make_shared<ss_hash>(
-                        Rcpp::as<Rcpp::CharacterVector>(x),
-                        Rcpp::as<Rcpp::CharacterVector>(y)
-                    );
-                    break;
-                }
-                case LGLSXP: {
-                    variant = boost::make_shared<sb_hash>(
-                        Rcpp::as<Rcpp::CharacterVector>(x),
-                        Rcpp::as<Rcpp::LogicalVector>(y)
-                    );
-                    break;
-                }
-                case CPLXSXP: {
-                    variant = boost::make_shared<sx_hash>(
-                        Rcpp::as<Rcpp::CharacterVector>(x),
-                        Rcpp::as<Rcpp::ComplexVector>(y)
-                    );
-                    break;
-                }
-                default: {
-                    Rcpp::stop("Invalid value type!");
-                    break;
-                }
-            }
-            break;
-        }
-        default: {
-            Rcpp::stop("Invalid key type!");
-            break;
-        }
+    if (frozen()) Rcpp::stop("Attempt to modify a frozen Hashmap");
+    if (flag == encoded()) return;
+    if (value_sexptype() != STRSXP) {
+        Rcpp::stop(
+            "Only character values can be encoded, not %s",
+            value_class_name().c_str()
+        );
     }
-}
 
-HashMap::HashMap(SEXP x, SEXP y)
-{ init(x, y); }
-
-HashMap::HashMap(const Rcpp::XPtr<HashMap>& ptr)
-{ init(Rcpp::clone(ptr->keys()), Rcpp::clone(ptr->values())); }
+    Rcpp::RObject k(keys());
+    Rcpp::RObject v(values());
+    if (flag) v = factor_dict::encode(v, true);
 
-HashMap HashMap::clone() const
-{ return HashMap(Rcpp::clone(keys()), Rcpp::clone(values())); }
-
-void HashMap::renew(SEXP x, SEXP y)
-{
-    HashMap tmp(x, y);
-    variant = tmp.variant;
+    HashMap tmp(engine_registry::instance().create(k, v, incremental()));
+    replace(tmp);
 }
 
-int HashMap::size() const
-{ return boost::apply_visitor(size_visitor(), variant); }
-
-bool HashMap::empty() const
-{ return boost::apply_visitor(empty_visitor(), variant); }
-
-bool HashMap::keys_cached() const
-{ return boost::apply_visitor(keys_cached_visitor(), variant); }
-
-bool HashMap::values_cached() const
-{ return boost::apply_visitor(values_cached_visitor(), variant); }
+SEXP HashMap::memory_stats() const
+{ return impl->memory_stats(); }
 
 int HashMap::key_sexptype() const
-{ return boost::apply_visitor(key_sexptype_visitor(), variant); }
+{ return impl->key_sexptype(); }
 
 int HashMap::value_sexptype() const
-{ return boost::apply_visitor(value_sexptype_visitor(), variant); }
+{ return encoded() ? STRSXP : impl->value_sexptype(); }
 
 SEXP HashMap::key_vector(int n) const
-{
-    key_vector_visitor v(n);
-    return boost::apply_visitor(v, variant);
-}
+{ return impl->key_vector(n); }
 
 SEXP HashMap::value_vector(int n) const
-{
-    value_vector_visitor v(n);
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->value_vector(n)); }
 
 SEXP HashMap::na_value_vector(int n) const
-{
-    na_value_vector_visitor v(n);
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->na_value_vector(n)); }
 
 void HashMap::clear()
-{
-    clear_visitor v;
-    boost::apply_visitor(v, variant);
-}
+{ impl->clear(); }
 
 int HashMap::bucket_count() const
-{ return boost::apply_visitor(bucket_count_visitor(), variant); }
+{ return impl->bucket_count(); }
 
 void HashMap::rehash(int n)
-{
-    rehash_visitor v(n);
-    boost::apply_visitor(v, variant);
-}
+{ impl->rehash(n); }
 
 void HashMap::reserve(int n)
-{
-    reserve_visitor v(n);
-    boost::apply_visitor(v, variant);
-}
+{ impl->reserve(n); }
 
 SEXP HashMap::hash_value(SEXP x) const
-{
-    hash_value_visitor v(x);
-    return boost::apply_visitor(v, variant);
-}
+{ return impl->hash_value(x); }
 
 void HashMap::insert(SEXP x, SEXP y)
+{ impl->insert(x, y); }
+
+void HashMap::update(SEXP other)
+{ update_policy(other, "overwrite"); }
+
+void HashMap::update_policy(SEXP other, const std::string& policy)
 {
-    insert_visitor v(x, y);
-    boost::apply_visitor(v, variant);
+    merge_policy p;
+
+    if (policy == "overwrite") {
+        p = merge_overwrite;
+    } else if (policy == "keep") {
+        p = merge_keep;
+    } else if (policy == "sum") {
+        p = merge_sum;
+    } else if (policy == "min") {
+        p = merge_min;
+    } else if (policy == "max") {
+        p = merge_max;
+    } else if (policy == "error") {
+        p = merge_error;
+    } else {
+        Rcpp::stop(
+            "Invalid policy '%s'; expected one of 'overwrite', 'keep', "
+            "'sum', 'min', 'max' or 'error'",
+            policy.c_str()
+        );
+    }
+
+    HashMap* rhs = hashmap_pointer(other);
+
+    // an encoded and a plain table of character values are merged
+    // through a copy of the right hand side in the same representation
+    if (rhs->encoded() != encoded() && rhs->value_sexptype() == STRSXP &&
+        value_sexptype() == STRSXP) {
+        Rcpp::RObject k(rhs->keys());
+        Rcpp::RObject v(rhs->values());
+        if (encoded()) v = factor_dict::encode(v, true);
+
+        engine_ptr tmp = engine_registry::instance().create(k, v, false);
+        impl->update(*tmp, p);
+        return;
+    }
+
+    impl->update(*rhs->impl, p);
 }
 
-SEXP HashMap::keys() const
+double HashMap::erase_if(const std::string& op, SEXP operand)
+{ return impl->erase_if(parse_cmp(op), operand); }
+
+SEXP HashMap::filter(const std::string& op, SEXP operand) const
 {
-    keys_visitor v;
-    return boost::apply_visitor(v, variant);
+    return Rcpp::internal::make_new_object(
+        new HashMap(impl->filter(parse_cmp(op), operand))
+    );
 }
 
+void HashMap::transform(const std::string& op, SEXP operand)
+{ impl->transform(parse_arith(op), operand); }
+
+double HashMap::na_omit()
+{ return impl->na_omit(); }
+
+SEXP HashMap::keys() const
+{ return impl->keys(); }
+
 SEXP HashMap::keys_n(int n) const
-{
-    keys_n_visitor v(n);
-    return boost::apply_visitor(v, variant);
-}
+{ return impl->keys_n(n); }
 
 SEXP HashMap::values() const
-{
-    values_visitor v;
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->values()); }
 
 SEXP HashMap::values_n(int n) const
-{
-    values_n_visitor v(n);
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->values_n(n)); }
 
 void HashMap::cache_keys()
-{
-    cache_keys_visitor v;
-    boost::apply_visitor(v, variant);
-}
+{ impl->cache_keys(); }
 
 void HashMap::cache_values()
-{
-    cache_values_visitor v;
-    boost::apply_visitor(v, variant);
-}
+{ impl->cache_values(); }
 
 void HashMap::erase(SEXP x)
-{
-    erase_visitor v(x);
-    boost::apply_visitor(v, variant);
-}
+{ impl->erase(x); }
 
 SEXP HashMap::find(SEXP x) const
-{
-    find_visitor v(x);
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->find(x)); }
 
 bool HashMap::has_key(SEXP x) const
-{
-    has_key_visitor v(x);
-    return boost::apply_visitor(v, variant);
-}
+{ return impl->has_key(x); }
 
 SEXP HashMap::has_keys(SEXP x) const
-{
-    has_keys_visitor v(x);
-    return boost::apply_visitor(v, variant);
-}
+{ return impl->has_keys(x); }
+
+void HashMap::find_raw(const void* keys, R_xlen_t n,
+                       void* values, int* found) const
+{ impl->find_raw(keys, n, values, found); }
+
+bool HashMap::insert_raw(const void* keys, const void* values, R_xlen_t n)
+{ return impl->insert_raw(keys, values, n); }
+
+void HashMap::erase_raw(const void* keys, R_xlen_t n)
+{ impl->erase_raw(keys, n); }
+
+void HashMap::iterate_raw(raw_visit_fn fn, void* data) const
+{ impl->iterate_raw(fn, data); }
+
+SEXP HashMap::get_scalar(SEXP x) const
+{ return factor_dict::decode(impl->get_scalar(x)); }
+
+void HashMap::set_scalar(SEXP x, SEXP y)
+{ impl->set_scalar(x, y); }
+
+bool HashMap::has_scalar(SEXP x) const
+{ return impl->has_scalar(x); }
+
+bool HashMap::erase_scalar(SEXP x)
+{ return impl->erase_scalar(x); }
+
+SEXP HashMap::floor(SEXP x) const
+{ return impl->floor(x); }
+
+SEXP HashMap::ceiling(SEXP x) const
+{ return impl->ceiling(x); }
+
+SEXP HashMap::rank(SEXP x) const
+{ return impl->rank(x); }
+
+SEXP HashMap::range(SEXP lo, SEXP hi) const
+{ return impl->range(lo, hi); }
 
 SEXP HashMap::data() const
-{
-    data_visitor v;
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->data()); }
 
 SEXP HashMap::data_n(int n) const
-{
-    data_n_visitor v(n);
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->data_n(n)); }
 
 SEXP HashMap::data_frame() const
-{
-    data_frame_visitor v;
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->data_frame()); }
+
+SEXP HashMap::cursor() const
+{ return impl->cursor(); }
 
 std::string HashMap::key_class_name() const
-{ return boost::apply_visitor(key_class_name_visitor(), variant); }
+{ return impl->key_class_name(); }
 
 std::string HashMap::value_class_name() const
-{ return boost::apply_visitor(value_class_name_visitor(), variant); }
+{ return impl->value_class_name(); }
 
 SEXP HashMap::left_outer_join(const HashMap& other) const
-{
-    left_outer_join_visitor v(other);
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->left_outer_join(other)); }
 
 SEXP HashMap::left_outer_join(const Rcpp::XPtr<HashMap>& other) const
-{
-    left_outer_join_visitor v(*other);
-    return boost::apply_visitor(v, variant);
-}
+{ return left_outer_join(*other); }
 
 SEXP HashMap::right_outer_join(const HashMap& other) const
-{
-    right_outer_join_visitor v(other);
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->right_outer_join(other)); }
 
 SEXP HashMap::right_outer_join(const Rcpp::XPtr<HashMap>& other) const
-{
-    right_outer_join_visitor v(*other);
-    return boost::apply_visitor(v, variant);
-}
+{ return right_outer_join(*other); }
 
 SEXP HashMap::inner_join(const HashMap& other) const
-{
-    inner_join_visitor v(other);
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->inner_join(other)); }
 
 SEXP HashMap::inner_join(const Rcpp::XPtr<HashMap>& other) const
-{
-    inner_join_visitor v(*other);
-    return boost::apply_visitor(v, variant);
-}
+{ return inner_join(*other); }
 
 SEXP HashMap::full_outer_join(const HashMap& other) const
-{
-    full_outer_join_visitor v(other);
-    return boost::apply_visitor(v, variant);
-}
+{ return factor_dict::decode(impl->full_outer_join(other)); }
 
 SEXP HashMap::full_outer_join(const Rcpp::XPtr<HashMap>& other) const
-{
-    full_outer_join_visitor v(*other);
-    return boost::apply_visitor(v, variant);
-}
+{ return full_outer_join(*other); }
 
 } // hashmap
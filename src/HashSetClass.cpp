@@ -0,0 +1,302 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// HashSetClass.cpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#include "../inst/include/hashmap/SetTemplate.hpp"
+#include <boost/make_shared.hpp>
+
+namespace hashmap {
+
+template <typename T>
+variant_set HashSet::clone_visitor::operator()(const T& t) const
+{
+    typedef typename T::element_type set_t;
+    return variant_set(boost::make_shared<set_t>(t->clone()));
+}
+
+template <typename T>
+std::size_t HashSet::size_visitor::operator()(const T& t) const
+{ return t->size(); }
+
+template <typename T>
+bool HashSet::empty_visitor::operator()(const T& t) const
+{ return t->empty(); }
+
+template <typename T>
+int HashSet::key_sexptype_visitor::operator()(const T& t) const
+{ return t->key_sexptype(); }
+
+template <typename T>
+std::string HashSet::key_class_name_visitor::operator()(const T& t) const
+{ return t->key_class_name(); }
+
+template <typename T>
+void HashSet::clear_visitor::operator()(T& t)
+{ t->clear(); }
+
+template <typename T>
+std::size_t HashSet::bucket_count_visitor::operator()(const T& t) const
+{ return t->bucket_count(); }
+
+HashSet::rehash_visitor::rehash_visitor(std::size_t n_)
+    : n(n_)
+{}
+
+template <typename T>
+void HashSet::rehash_visitor::operator()(T& t)
+{ t->rehash(n); }
+
+HashSet::reserve_visitor::reserve_visitor(std::size_t n_)
+    : n(n_)
+{}
+
+template <typename T>
+void HashSet::reserve_visitor::operator()(T& t)
+{ t->reserve(n); }
+
+HashSet::hash_value_visitor::hash_value_visitor(SEXP keys_)
+    : keys(keys_)
+{}
+
+template <typename T>
+SEXP HashSet::hash_value_visitor::operator()(const T& t) const
+{
+    typedef typename T::element_type set_t;
+    return Rcpp::wrap(
+        t->hash_value(Rcpp::as<typename set_t::key_vec>(keys))
+    );
+}
+
+HashSet::insert_visitor::insert_visitor(SEXP keys_)
+    : keys(keys_)
+{}
+
+template <typename T>
+void HashSet::insert_visitor::operator()(T& t)
+{ t->insert(keys); }
+
+HashSet::erase_visitor::erase_visitor(SEXP keys_)
+    : keys(keys_)
+{}
+
+template <typename T>
+void HashSet::erase_visitor::operator()(T& t)
+{ t->erase(keys); }
+
+HashSet::contains_visitor::contains_visitor(SEXP keys_)
+    : keys(keys_)
+{}
+
+template <typename T>
+SEXP HashSet::contains_visitor::operator()(const T& t) const
+{ return Rcpp::wrap(t->contains(keys)); }
+
+template <typename T>
+SEXP HashSet::keys_visitor::operator()(const T& t) const
+{ return Rcpp::wrap(t->keys()); }
+
+HashSet::keys_n_visitor::keys_n_visitor(int n_)
+    : n(n_)
+{}
+
+template <typename T>
+SEXP HashSet::keys_n_visitor::operator()(const T& t) const
+{ return Rcpp::wrap(t->keys_n(n)); }
+
+HashSet::set_op_visitor::set_op_visitor(SEXP other_, set_op op_)
+    : other(other_), op(op_)
+{}
+
+template <typename T>
+SEXP HashSet::set_op_visitor::operator()(const T& t) const
+{
+    typedef typename T::element_type set_t;
+
+    const T* rhs = HashSet::operand<T>(other);
+    if (rhs) return apply(*t, **rhs);
+
+    if (!Rf_isVectorAtomic(other)) {
+        Rcpp::stop("'other' must be a Hashset or an atomic vector");
+    }
+
+    // vectors are probed element by element, not made into a set
+    typename set_t::key_vec keys = Rcpp::as<typename set_t::key_vec>(other);
+    return apply(*t, keys);
+}
+
+template <typename S, typename R>
+SEXP HashSet::set_op_visitor::apply(const S& lhs, const R& rhs) const
+{
+    boost::shared_ptr<S> res = boost::make_shared<S>();
+
+    switch (op) {
+        case op_union: {
+            lhs.set_union(rhs, *res);
+            break;
+        }
+        case op_intersect: {
+            lhs.set_intersect(rhs, *res);
+            break;
+        }
+        case op_diff: {
+            lhs.set_diff(rhs, *res);
+            break;
+        }
+        case op_symdiff: {
+            lhs.set_symdiff(rhs, *res);
+            break;
+        }
+    }
+
+    return Rcpp::internal::make_new_object(new HashSet(variant_set(res)));
+}
+
+template <typename T>
+const T* HashSet::operand(SEXP x)
+{
+    typedef typename T::element_type set_t;
+
+    HashSet* ptr = utils::module_object<HashSet>(x, "Rcpp_Hashset");
+    if (!ptr) return 0;
+
+    const T* res = boost::get<T>(&ptr->variant);
+    if (!res) {
+        Rcpp::stop(
+            "Attempt to combine different key types: %s and %s\n",
+            set_t().key_class_name().c_str(),
+            ptr->key_class_name().c_str()
+        );
+    }
+    return res;
+}
+
+HashSet::HashSet()
+    : variant(boost::make_shared<s_set>())
+{}
+
+HashSet::HashSet(const variant_set& x)
+    : variant(x)
+{}
+
+HashSet::HashSet(SEXP x)
+{
+    switch (TYPEOF(x)) {
+        case STRSXP: {
+            variant = boost::make_shared<s_set>(
+                Rcpp::as<Rcpp::CharacterVector>(x)
+            );
+            break;
+        }
+        case REALSXP: {
+            variant = boost::make_shared<d_set>(
+                Rcpp::as<Rcpp::NumericVector>(x)
+            );
+            break;
+        }
+        case INTSXP: {
+            variant = boost::make_shared<i_set>(
+                Rcpp::as<Rcpp::IntegerVector>(x)
+            );
+            break;
+        }
+        default: {
+            Rcpp::stop("Invalid key type!");
+            break;
+        }
+    }
+}
+
+HashSet::HashSet(const Rcpp::XPtr<HashSet>& ptr)
+    : variant(boost::apply_visitor(clone_visitor(), ptr->variant))
+{}
+
+HashSet::HashSet(const HashSet& other)
+    : variant(boost::apply_visitor(clone_visitor(), other.variant))
+{}
+
+int HashSet::size() const
+{ return boost::apply_visitor(size_visitor(), variant); }
+
+bool HashSet::empty() const
+{ return boost::apply_visitor(empty_visitor(), variant); }
+
+int HashSet::key_sexptype() const
+{ return boost::apply_visitor(key_sexptype_visitor(), variant); }
+
+std::string HashSet::key_class_name() const
+{ return boost::apply_visitor(key_class_name_visitor(), variant); }
+
+void HashSet::clear()
+{
+    clear_visitor v;
+    boost::apply_visitor(v, variant);
+}
+
+int HashSet::bucket_count() const
+{ return boost::apply_visitor(bucket_count_visitor(), variant); }
+
+void HashSet::rehash(int n)
+{
+    rehash_visitor v(n);
+    boost::apply_visitor(v, variant);
+}
+
+void HashSet::reserve(int n)
+{
+    reserve_visitor v(n);
+    boost::apply_visitor(v, variant);
+}
+
+SEXP HashSet::hash_value(SEXP x) const
+{ return boost::apply_visitor(hash_value_visitor(x), variant); }
+
+void HashSet::insert(SEXP x)
+{
+    insert_visitor v(x);
+    boost::apply_visitor(v, variant);
+}
+
+void HashSet::erase(SEXP x)
+{
+    erase_visitor v(x);
+    boost::apply_visitor(v, variant);
+}
+
+SEXP HashSet::contains(SEXP x) const
+{ return boost::apply_visitor(contains_visitor(x), variant); }
+
+SEXP HashSet::keys() const
+{ return boost::apply_visitor(keys_visitor(), variant); }
+
+SEXP HashSet::keys_n(int n) const
+{ return boost::apply_visitor(keys_n_visitor(n), variant); }
+
+SEXP HashSet::set_union(SEXP other) const
+{ return boost::apply_visitor(set_op_visitor(other, op_union), variant); }
+
+SEXP HashSet::set_intersect(SEXP other) const
+{ return boost::apply_visitor(set_op_visitor(other, op_intersect), variant); }
+
+SEXP HashSet::set_diff(SEXP other) const
+{ return boost::apply_visitor(set_op_visitor(other, op_diff), variant); }
+
+SEXP HashSet::set_symdiff(SEXP other) const
+{ return boost::apply_visitor(set_op_visitor(other, op_symdiff), variant); }
+
+} // hashmap
@@ -0,0 +1,244 @@
+// vim: set softtabstop=4:expandtab:number:syntax on:wildmenu:showmatch
+//
+// SharedMapClass.cpp
+//
+// Copyright (C) 2016 - 2017 Nathan Russell
+//
+// This file is part of hashmap.
+//
+// hashmap is free software: you can redistribute it and/or
+// modify it under the terms of the MIT License.
+//
+// hashmap is provided "as is", without warranty of any kind,
+// express or implied, including but not limited to the
+// warranties of merchantability, fitness for a particular
+// purpose and noninfringement.
+//
+// You should have received a copy of the MIT License
+// along with hashmap. If not, see
+// <https://opensource.org/licenses/MIT>.
+
+#include "../inst/include/hashmap/SharedTemplate.hpp"
+#include <boost/make_shared.hpp>
+
+namespace hashmap {
+
+template <typename T>
+std::size_t SharedMap::size_visitor::operator()(const T& t) const
+{ return t->size(); }
+
+template <typename T>
+std::string SharedMap::name_visitor::operator()(const T& t) const
+{ return t->name(); }
+
+template <typename T>
+bool SharedMap::writable_visitor::operator()(const T& t) const
+{ return t->writable(); }
+
+template <typename T>
+int SharedMap::key_sexptype_visitor::operator()(const T& t) const
+{ return t->key_sexptype(); }
+
+template <typename T>
+int SharedMap::value_sexptype_visitor::operator()(const T& t) const
+{ return t->value_sexptype(); }
+
+template <typename T>
+void SharedMap::clear_visitor::operator()(T& t) const
+{ t->clear(); }
+
+SharedMap::reserve_visitor::reserve_visitor(int n_)
+    : n(n_)
+{}
+
+template <typename T>
+void SharedMap::reserve_visitor::operator()(T& t) const
+{ t->reserve(n); }
+
+SharedMap::insert_visitor::insert_visitor(SEXP keys_, SEXP values_)
+    : keys(keys_), values(values_)
+{}
+
+template <typename T>
+void SharedMap::insert_visitor::operator()(T& t) const
+{ t->insert(keys, values); }
+
+SharedMap::erase_visitor::erase_visitor(SEXP keys_)
+    : keys(keys_)
+{}
+
+template <typename T>
+void SharedMap::erase_visitor::operator()(T& t) const
+{ t->erase(keys); }
+
+SharedMap::find_visitor::find_visitor(SEXP keys_)
+    : keys(keys_)
+{}
+
+template <typename T>
+SEXP SharedMap::find_visitor::operator()(const T& t) const
+{ return Rcpp::wrap(t->find(keys)); }
+
+SharedMap::has_key_visitor::has_key_visitor(SEXP keys_)
+    : keys(keys_)
+{}
+
+template <typename T>
+bool SharedMap::has_key_visitor::operator()(const T& t) const
+{ return t->has_key(keys); }
+
+SharedMap::has_keys_visitor::has_keys_visitor(SEXP keys_)
+    : keys(keys_)
+{}
+
+template <typename T>
+SEXP SharedMap::has_keys_visitor::operator()(const T& t) const
+{ return Rcpp::wrap(t->has_keys(keys)); }
+
+template <typename T>
+SEXP SharedMap::keys_visitor::operator()(const T& t) const
+{ return Rcpp::wrap(t->keys()); }
+
+template <typename T>
+SEXP SharedMap::values_visitor::operator()(const T& t) const
+{ return Rcpp::wrap(t->values()); }
+
+template <typename T>
+SEXP SharedMap::data_visitor::operator()(const T& t) const
+{ return Rcpp::wrap(t->data()); }
+
+// a SharedTemplate<KeyType, ValueType>, creating the segment from
+// keys and values, or opening it if keys is NULL
+template <typename KeyType, typename ValueType>
+static variant_shared make_shared_map(const std::string& name, SEXP keys,
+                                      SEXP values, bool writable)
+{
+    typedef SharedTemplate<KeyType, ValueType> map_t;
+
+    if (Rf_isNull(keys)) {
+        return boost::make_shared<map_t>(name, writable);
+    }
+    return boost::make_shared<map_t>(
+        name,
+        Rcpp::as<typename map_t::key_vec>(keys),
+        Rcpp::as<typename map_t::value_vec>(values)
+    );
+}
+
+template <typename KeyType>
+static variant_shared make_shared_map(const std::string& name, SEXP keys,
+                                      SEXP values, int vtype, bool writable)
+{
+    switch (vtype) {
+        case STRSXP:
+            return make_shared_map<KeyType, std::string>(
+                name, keys, values, writable
+            );
+        case REALSXP:
+            return make_shared_map<KeyType, double>(
+                name, keys, values, writable
+            );
+        case INTSXP:
+            return make_shared_map<KeyType, int>(
+                name, keys, values, writable
+            );
+        case LGLSXP:
+            return make_shared_map<KeyType, bool>(
+                name, keys, values, writable
+            );
+        case CPLXSXP:
+            return make_shared_map<KeyType, Rcomplex>(
+                name, keys, values, writable
+            );
+        default:
+            Rcpp::stop("Invalid value type!");
+    }
+
+    return variant_shared();
+}
+
+SharedMap::SharedMap(std::string name, SEXP keys, SEXP values, bool writable)
+{
+    int ktype = TYPEOF(keys), vtype = TYPEOF(values);
+    if (Rf_isNull(keys)) {
+        shm_segment::types(name, ktype, vtype);
+    }
+
+    switch (ktype) {
+        case STRSXP: {
+            variant = make_shared_map<std::string>(
+                name, keys, values, vtype, writable
+            );
+            break;
+        }
+        case REALSXP: {
+            variant = make_shared_map<double>(
+                name, keys, values, vtype, writable
+            );
+            break;
+        }
+        case INTSXP: {
+            variant = make_shared_map<int>(
+                name, keys, values, vtype, writable
+            );
+            break;
+        }
+        default: {
+            Rcpp::stop("Invalid key type!");
+            break;
+        }
+    }
+}
+
+int SharedMap::size() const
+{ return boost::apply_visitor(size_visitor(), variant); }
+
+bool SharedMap::empty() const
+{ return size() == 0; }
+
+std::string SharedMap::name() const
+{ return boost::apply_visitor(name_visitor(), variant); }
+
+bool SharedMap::writable() const
+{ return boost::apply_visitor(writable_visitor(), variant); }
+
+int SharedMap::key_sexptype() const
+{ return boost::apply_visitor(key_sexptype_visitor(), variant); }
+
+int SharedMap::value_sexptype() const
+{ return boost::apply_visitor(value_sexptype_visitor(), variant); }
+
+void SharedMap::clear()
+{ boost::apply_visitor(clear_visitor(), variant); }
+
+void SharedMap::reserve(int n)
+{ boost::apply_visitor(reserve_visitor(n), variant); }
+
+void SharedMap::insert(SEXP x, SEXP y)
+{ boost::apply_visitor(insert_visitor(x, y), variant); }
+
+void SharedMap::erase(SEXP x)
+{ boost::apply_visitor(erase_visitor(x), variant); }
+
+SEXP SharedMap::find(SEXP x) const
+{ return boost::apply_visitor(find_visitor(x), variant); }
+
+bool SharedMap::has_key(SEXP x) const
+{ return boost::apply_visitor(has_key_visitor(x), variant); }
+
+SEXP SharedMap::has_keys(SEXP x) const
+{ return boost::apply_visitor(has_keys_visitor(x), variant); }
+
+SEXP SharedMap::keys() const
+{ return boost::apply_visitor(keys_visitor(), variant); }
+
+SEXP SharedMap::values() const
+{ return boost::apply_visitor(values_visitor(), variant); }
+
+SEXP SharedMap::data() const
+{ return boost::apply_visitor(data_visitor(), variant); }
+
+void SharedMap::unlink() const
+{ shm_segment::remove(name()); }
+
+} // hashmap
@@ -0,0 +1,171 @@
+// [[Rcpp::depends(BH)]]
+#include "../inst/include/hashmap/HashMapClass.h"
+
+#define HASHMAP_API_IMPLEMENTATION
+#include "../inst/include/hashmap_api.h"
+
+// Implementation of the C API declared in hashmap_api.h. Every
+// entry point converts C++ exceptions into status codes, since the
+// callers are C code.
+
+namespace {
+
+hashmap::HashMap* handle_map(hashmap_handle h)
+{ return reinterpret_cast<hashmap::HashMap*>(h); }
+
+// Factor keys and values are stored as codes into levels which the
+// C API does not expose, so that integers passed as such would be
+// taken as arbitrary codes; maps holding them are refused.
+bool has_factors(const hashmap::HashMap* ptr)
+{
+    return ptr->key_class_name() == "factor" ||
+        ptr->value_class_name() == "factor";
+}
+
+int check_types(hashmap_handle h, int key_type, int value_type)
+{
+    if (!h) return HASHMAP_ERR_INVALID;
+
+    hashmap::HashMap* ptr = handle_map(h);
+    if (has_factors(ptr)) return HASHMAP_ERR_TYPE;
+    if (ptr->key_sexptype() != key_type ||
+        ptr->value_sexptype() != value_type) {
+        return HASHMAP_ERR_TYPE;
+    }
+
+    return HASHMAP_OK;
+}
+
+} // anonymous
+
+extern "C" {
+
+static int api_version(void)
+{ return HASHMAP_API_VERSION; }
+
+static int api_handle_from(SEXP x, hashmap_handle* out)
+{
+    static SEXP pointer_sym = NULL;
+    if (!out) return HASHMAP_ERR_INVALID;
+    *out = NULL;
+
+    if (Rf_isS4(x) && Rf_inherits(x, "Rcpp_Hashmap")) {
+        SEXP env = TYPEOF(x) == ENVSXP ? x : R_getS4DataSlot(x, ENVSXP);
+        if (!pointer_sym) pointer_sym = Rf_install(".pointer");
+        x = TYPEOF(env) == ENVSXP ?
+            Rf_findVarInFrame(env, pointer_sym) : R_NilValue;
+    }
+
+    if (TYPEOF(x) != EXTPTRSXP || !R_ExternalPtrAddr(x)) {
+        return HASHMAP_ERR_INVALID;
+    }
+
+    *out = reinterpret_cast<hashmap_handle>(R_ExternalPtrAddr(x));
+    return HASHMAP_OK;
+}
+
+static int api_types(hashmap_handle h, int* key_type, int* value_type)
+{
+    if (!h) return HASHMAP_ERR_INVALID;
+    if (key_type) *key_type = handle_map(h)->key_sexptype();
+    if (value_type) *value_type = handle_map(h)->value_sexptype();
+    return HASHMAP_OK;
+}
+
+static int api_size(hashmap_handle h, R_xlen_t* out)
+{
+    if (!h || !out) return HASHMAP_ERR_INVALID;
+    *out = handle_map(h)->size();
+    return HASHMAP_OK;
+}
+
+static int api_find(hashmap_handle h, int key_type, const void* keys,
+                    R_xlen_t n, int value_type, void* values, int* found)
+{
+    int status = check_types(h, key_type, value_type);
+    if (status != HASHMAP_OK) return status;
+
+    try {
+        handle_map(h)->find_raw(keys, n, values, found);
+    } catch (...) {
+        return HASHMAP_ERR_INTERNAL;
+    }
+
+    return HASHMAP_OK;
+}
+
+static int api_insert(hashmap_handle h, int key_type, const void* keys,
+                      int value_type, const void* values, R_xlen_t n)
+{
+    int status = check_types(h, key_type, value_type);
+    if (status != HASHMAP_OK) return status;
+
+    if (handle_map(h)->frozen()) return HASHMAP_ERR_FROZEN;
+
+    try {
+        if (!handle_map(h)->insert_raw(keys, values, n)) {
+            return HASHMAP_ERR_TYPE;
+        }
+    } catch (...) {
+        return HASHMAP_ERR_INTERNAL;
+    }
+
+    return HASHMAP_OK;
+}
+
+static int api_erase(hashmap_handle h, int key_type, const void* keys,
+                     R_xlen_t n)
+{
+    if (!h) return HASHMAP_ERR_INVALID;
+    if (has_factors(handle_map(h)) ||
+        handle_map(h)->key_sexptype() != key_type) {
+        return HASHMAP_ERR_TYPE;
+    }
+
+    if (handle_map(h)->frozen()) return HASHMAP_ERR_FROZEN;
+
+    try {
+        handle_map(h)->erase_raw(keys, n);
+    } catch (...) {
+        return HASHMAP_ERR_INTERNAL;
+    }
+
+    return HASHMAP_OK;
+}
+
+static int api_iterate(hashmap_handle h, hashmap_visit_fn fn, void* data)
+{
+    if (!h || !fn) return HASHMAP_ERR_INVALID;
+    if (has_factors(handle_map(h))) return HASHMAP_ERR_TYPE;
+
+    try {
+        handle_map(h)->iterate_raw(fn, data);
+    } catch (...) {
+        return HASHMAP_ERR_INTERNAL;
+    }
+
+    return HASHMAP_OK;
+}
+
+// called from R_init_hashmap
+void hashmap_register_api(void)
+{
+    R_RegisterCCallable("hashmap", "hashmap_api_version",
+                        (DL_FUNC) &api_version);
+    R_RegisterCCallable("hashmap", "hashmap_handle_from",
+                        (DL_FUNC) &api_handle_from);
+    R_RegisterCCallable("hashmap", "hashmap_types",
+                        (DL_FUNC) &api_types);
+    R_RegisterCCallable("hashmap", "hashmap_size",
+                        (DL_FUNC) &api_size);
+    R_RegisterCCallable("hashmap", "hashmap_find",
+                        (DL_FUNC) &api_find);
+    R_RegisterCCallable("hashmap", "hashmap_insert",
+                        (DL_FUNC) &api_insert);
+    R_RegisterCCallable("hashmap", "hashmap_erase",
+                        (DL_FUNC) &api_erase);
+    R_RegisterCCallable("hashmap", "hashmap_iterate",
+                        (DL_FUNC) &api_iterate);
+}
+
+} // extern "C"
@@ -0,0 +1,200 @@
+// [[Rcpp::depends(BH)]]
+#include "../inst/include/hashmap/HashTemplate.hpp"
+#include "../inst/include/hashmap/EngineTemplate.hpp"
+#include "../inst/include/hashmap/arrow_bridge.hpp"
+#include <boost/make_shared.hpp>
+
+namespace hashmap {
+namespace {
+
+// the HashTemplate key / value type corresponding to an Arrow format
+// string: 'i' (int32) -> int, 'g' (float64) -> double, 'b' (boolean)
+// -> bool, 'u' / 'U' ((large) utf8) -> std::string
+enum column_type { col_int, col_double, col_bool, col_string };
+
+column_type format_type(const ArrowSchema* schema, const char* what)
+{
+    if (!schema || !schema->release || !schema->format) {
+        Rcpp::stop("Invalid (released) Arrow schema for %s", what);
+    }
+
+    const char* f = schema->format;
+    if (f[0] && !f[1]) {
+        switch (f[0]) {
+            case 'i': return col_int;
+            case 'g': return col_double;
+            case 'b': return col_bool;
+            case 'u': case 'U': return col_string;
+        }
+    }
+
+    Rcpp::stop("Unsupported Arrow format '%s' for %s", f, what);
+    return col_int;
+}
+
+template <typename K, typename V>
+engine_ptr read_arrow(const ArrowSchema* ks, const ArrowArray* ka,
+                      const ArrowSchema* vs, const ArrowArray* va)
+{
+    typedef HashTemplate<K, V> hash_t;
+    typedef arrow::column_iterator<K> key_iter;
+    typedef arrow::column_iterator<V> value_iter;
+
+    arrow::column<K> kcol(ks, ka);
+    arrow::column<V> vcol(vs, va);
+
+    int64_t n = kcol.size();
+    if (n != vcol.size()) {
+        Rcpp::warning("length(keys) != length(values)!");
+        if (vcol.size() < n) n = vcol.size();
+    }
+
+    boost::shared_ptr<hash_t> res = boost::make_shared<hash_t>();
+    res->reserve((typename hash_t::size_type)(n * 1.05));
+    res->insert_range(key_iter(kcol, 0), key_iter(kcol, n),
+                      value_iter(vcol, 0));
+
+    return make_engine(res);
+}
+
+template <typename K>
+engine_ptr read_arrow_values(const ArrowSchema* ks, const ArrowArray* ka,
+                             const ArrowSchema* vs, const ArrowArray* va)
+{
+    switch (format_type(vs, "values")) {
+        case col_int: return read_arrow<K, int>(ks, ka, vs, va);
+        case col_double: return read_arrow<K, double>(ks, ka, vs, va);
+        case col_bool: return read_arrow<K, bool>(ks, ka, vs, va);
+        case col_string: return read_arrow<K, std::string>(ks, ka, vs, va);
+    }
+
+    return engine_ptr();
+}
+
+struct export_state {
+    arrow::column_builder keys;
+    arrow::column_builder values;
+
+    export_state(int key_type, int value_type, R_xlen_t n)
+        : keys(key_type, n), values(value_type, n)
+    {}
+};
+
+int export_entry(const void* key, const void* value, void* data)
+{
+    export_state* state = static_cast<export_state*>(data);
+    state->keys.push(key);
+    state->values.push(value);
+    return 1;
+}
+
+// Arrow producers and consumers exchange the addresses of these
+// structures as external pointers (nanoarrow, recent versions of
+// arrow), or as doubles or strings (older versions of arrow).
+void* arrow_address(SEXP x, const char* what)
+{
+    void* res = 0;
+
+    switch (TYPEOF(x)) {
+        case EXTPTRSXP:
+            res = R_ExternalPtrAddr(x);
+            break;
+        case REALSXP:
+            if (Rf_length(x) == 1) {
+                res = reinterpret_cast<void*>((uintptr_t)REAL(x)[0]);
+            }
+            break;
+        case STRSXP:
+            if (Rf_length(x) == 1) {
+                uintptr_t addr = 0;
+                const char* p = CHAR(STRING_ELT(x, 0));
+                for (; *p >= '0' && *p <= '9'; ++p) {
+                    addr = addr * 10 + (*p - '0');
+                }
+                res = reinterpret_cast<void*>(addr);
+            }
+            break;
+    }
+
+    if (!res) Rcpp::stop("'%s' is not a valid Arrow pointer", what);
+    return res;
+}
+
+} // anonymous
+
+HashMap* HashMap::from_arrow(const ArrowSchema* key_schema,
+                             const ArrowArray* keys,
+                             const ArrowSchema* value_schema,
+                             const ArrowArray* values)
+{
+    switch (format_type(key_schema, "keys")) {
+        case col_int:
+            return new HashMap(read_arrow_values<int>(
+                key_schema, keys, value_schema, values
+            ));
+        case col_double:
+            return new HashMap(read_arrow_values<double>(
+                key_schema, keys, value_schema, values
+            ));
+        case col_string:
+            return new HashMap(read_arrow_values<std::string>(
+                key_schema, keys, value_schema, values
+            ));
+        case col_bool:
+            break;
+    }
+
+    Rcpp::stop("Arrow boolean arrays cannot be used as keys");
+    return 0;
+}
+
+void HashMap::to_arrow(ArrowArray* keys, ArrowSchema* key_schema,
+                       ArrowArray* values, ArrowSchema* value_schema) const
+{
+    // (encoded values are visited as strings, like plain ones, but
+    // factors would only be exported as their codes)
+    if (key_class_name() == "factor" || value_class_name() == "factor") {
+        Rcpp::stop("Factor keys and values cannot be exported to Arrow");
+    }
+
+    export_state state(key_sexptype(), value_sexptype(), size());
+    iterate_raw(export_entry, &state);
+
+    state.keys.finish(keys, key_schema, "keys");
+    state.values.finish(values, value_schema, "values");
+}
+
+} // hashmap
+
+RcppExport SEXP _hashmap_from_arrow(SEXP keys, SEXP key_schema,
+                                    SEXP values, SEXP value_schema)
+{
+BEGIN_RCPP
+    using hashmap::arrow_address;
+    return Rcpp::internal::make_new_object(
+        hashmap::HashMap::from_arrow(
+            static_cast<ArrowSchema*>(arrow_address(key_schema, "key_schema")),
+            static_cast<ArrowArray*>(arrow_address(keys, "keys")),
+            static_cast<ArrowSchema*>(
+                arrow_address(value_schema, "value_schema")
+            ),
+            static_cast<ArrowArray*>(arrow_address(values, "values"))
+        )
+    );
+END_RCPP
+}
+
+RcppExport SEXP _hashmap_to_arrow(SEXP x, SEXP keys, SEXP key_schema,
+                                  SEXP values, SEXP value_schema)
+{
+BEGIN_RCPP
+    using hashmap::arrow_address;
+    hashmap::hashmap_pointer(x)->to_arrow(
+        static_cast<ArrowArray*>(arrow_address(keys, "keys")),
+        static_cast<ArrowSchema*>(arrow_address(key_schema, "key_schema")),
+        static_cast<ArrowArray*>(arrow_address(values, "values")),
+        static_cast<ArrowSchema*>(arrow_address(value_schema, "value_schema"))
+    );
+    return x;
+END_RCPP
+}
@@ -0,0 +1,267 @@
+// [[Rcpp::depends(BH)]]
+#include "../inst/include/hashmap/HashTemplate.hpp"
+#include "../inst/include/hashmap/EngineTemplate.hpp"
+#include "../inst/include/hashmap/delim_reader.hpp"
+#include <boost/make_shared.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace hashmap {
+namespace {
+
+typedef delim_reader::span span;
+
+enum parse_status { parse_ok = 0, parse_na, parse_missing };
+
+// Field conversions; parse() returns false (and sets NA) if the
+// field cannot be converted. Empty fields and "NA" are NA, stored the
+// way hashmap() stores an NA of the same type: NA_character_ as "NA",
+// and NA (logical) as TRUE, since logical values are held as bool.
+// These run on several threads at once and must not use the R API.
+inline bool is_na_field(const std::string& x)
+{ return x.empty() || x == "NA"; }
+
+template <typename T>
+struct field_parser;
+
+template <>
+struct field_parser<std::string> {
+    static bool parse(const span& x, std::string& res)
+    {
+        res = delim_reader::unquote(x);
+        if (res.empty() && x.first == x.second) res = "NA";
+        return true;
+    }
+};
+
+template <>
+struct field_parser<double> {
+    static bool parse(const span& x, double& res)
+    {
+        std::string s = delim_reader::unquote(x);
+        res = NA_REAL;
+        if (is_na_field(s)) return true;
+
+        char* end;
+        double tmp = std::strtod(s.c_str(), &end);
+        if (*end) return false;
+
+        res = tmp;
+        return true;
+    }
+};
+
+template <>
+struct field_parser<int> {
+    static bool parse(const span& x, int& res)
+    {
+        std::string s = delim_reader::unquote(x);
+        res = NA_INTEGER;
+        if (is_na_field(s)) return true;
+
+        char* end;
+        errno = 0;
+        long tmp = std::strtol(s.c_str(), &end, 10);
+        if (*end || errno || tmp > INT_MAX || tmp <= INT_MIN) return false;
+
+        res = (int)tmp;
+        return true;
+    }
+};
+
+template <>
+struct field_parser<bool> {
+    static bool parse(const span& x, bool& res)
+    {
+        std::string s = delim_reader::unquote(x);
+        res = NA_LOGICAL;
+        if (is_na_field(s)) return true;
+
+        if (s == "TRUE" || s == "true" || s == "True" || s == "T") {
+            res = true;
+            return true;
+        }
+        if (s == "FALSE" || s == "false" || s == "False" || s == "F") {
+            res = false;
+            return true;
+        }
+
+        return false;
+    }
+};
+
+struct file_spec {
+    std::string path;
+    std::size_t key_col;
+    std::size_t value_col;
+    char sep;
+    bool header;
+};
+
+// buffer size for reading, and the number of lines in a chunk from
+// which fields are parsed in parallel
+enum { buffer_size = 1 << 22, parallel_threshold = 10000 };
+
+template <typename K, typename V>
+parse_status parse_line(const span& line, const file_spec& spec,
+                        K& k, V& v)
+{
+    span kf, vf;
+    if (!delim_reader::find_field(line.first, line.second,
+                                  spec.sep, spec.key_col, kf) ||
+        !delim_reader::find_field(line.first, line.second,
+                                  spec.sep, spec.value_col, vf)) {
+        return parse_missing;
+    }
+
+    bool ok = field_parser<K>::parse(kf, k);
+    ok = field_parser<V>::parse(vf, v) && ok;
+
+    return ok ? parse_ok : parse_na;
+}
+
+// Reads the file chunk by chunk: the fields of each chunk are parsed
+// into small key / value buffers (in parallel when OpenMP is
+// available), which are then inserted into the table, so that no
+// R vectors are created and memory use beyond the table is bounded
+// by the chunk size.
+template <typename K, typename V>
+engine_ptr read_table(const file_spec& spec)
+{
+    typedef HashTemplate<K, V> hash_t;
+    boost::shared_ptr<hash_t> res = boost::make_shared<hash_t>();
+
+    delim_reader reader(spec.path, buffer_size);
+    std::vector<span> lines;
+
+    boost::container::vector<K> ks;
+    boost::container::vector<V> vs;
+    std::vector<unsigned char> status;
+
+    bool skip = spec.header;
+    double nrecord = 0, nbad = 0;
+
+    while (reader.next_chunk(lines)) {
+        long i = 0, n = (long)lines.size();
+        if (skip) {
+            i = 1;
+            skip = false;
+        }
+        long first = i;
+
+        ks.resize(n);
+        vs.resize(n);
+        status.assign(n, parse_ok);
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) if (n >= parallel_threshold)
+#endif
+        for (i = first; i < n; i++) {
+            status[i] = parse_line(lines[i], spec, ks[i], vs[i]);
+        }
+
+        for (i = first; i < n; i++) {
+            if (status[i] == parse_missing) {
+                Rcpp::stop(
+                    "Record %.0f of '%s' has fewer than %d fields",
+                    nrecord + i + 1, spec.path.c_str(),
+                    (int)std::max(spec.key_col, spec.value_col) + 1
+                );
+            }
+            if (status[i] == parse_na) ++nbad;
+        }
+
+        res->insert_range(ks.begin() + first, ks.begin() + n,
+                          vs.begin() + first);
+        nrecord += n;
+    }
+
+    if (nbad) {
+        Rcpp::warning(
+            "%.0f records of '%s' had fields which could not be parsed; "
+            "these were stored as NA (\"NA\" for character, "
+            "TRUE for logical fields)",
+            nbad, spec.path.c_str()
+        );
+    }
+
+    return make_engine(res);
+}
+
+template <typename K>
+engine_ptr read_values(const file_spec& spec, const std::string& value_type)
+{
+    if (value_type == "character") return read_table<K, std::string>(spec);
+    if (value_type == "numeric") return read_table<K, double>(spec);
+    if (value_type == "integer") return read_table<K, int>(spec);
+    if (value_type == "logical") return read_table<K, bool>(spec);
+
+    Rcpp::stop("Invalid value type '%s'", value_type.c_str());
+    return engine_ptr();
+}
+
+} // anonymous
+
+HashMap* HashMap::from_file(const std::string& path,
+                            int key_col, int value_col, char sep,
+                            const std::string& key_type,
+                            const std::string& value_type,
+                            bool header)
+{
+    if (key_col < 1 || value_col < 1) {
+        Rcpp::stop("'key_col' and 'value_col' must be positive");
+    }
+
+    file_spec spec;
+    spec.path = path;
+    spec.key_col = key_col - 1;
+    spec.value_col = value_col - 1;
+    spec.sep = sep;
+    spec.header = header;
+
+    if (key_type == "character") {
+        return new HashMap(read_values<std::string>(spec, value_type));
+    }
+    if (key_type == "numeric") {
+        return new HashMap(read_values<double>(spec, value_type));
+    }
+    if (key_type == "integer") {
+        return new HashMap(read_values<int>(spec, value_type));
+    }
+
+    Rcpp::stop("Invalid key type '%s'", key_type.c_str());
+    return 0;
+}
+
+} // hashmap
+
+RcppExport SEXP _hashmap_from_file(SEXP path, SEXP key_col, SEXP value_col,
+                                   SEXP sep, SEXP types, SEXP header)
+{
+BEGIN_RCPP
+    Rcpp::CharacterVector tv(types);
+    std::string sv = Rcpp::as<std::string>(sep);
+
+    if (sv.size() != 1) {
+        Rcpp::stop("'sep' must be a single character");
+    }
+
+    return Rcpp::internal::make_new_object(
+        hashmap::HashMap::from_file(
+            Rcpp::as<std::string>(path),
+            Rcpp::as<int>(key_col),
+            Rcpp::as<int>(value_col),
+            sv[0],
+            Rcpp::as<std::string>(tv[0]),
+            Rcpp::as<std::string>(tv[1]),
+            Rcpp::as<bool>(header)
+        )
+    );
+END_RCPP
+}
@@ -1,12 +1,25 @@
 // [[Rcpp::depends(BH)]]
 #include "../inst/include/hashmap/HashMapClass.h"
+#include "../inst/include/hashmap/HashSetClass.h"
+#include "../inst/include/hashmap/HashIndexClass.h"
+#include "../inst/include/hashmap/HashCursorClass.h"
+#include "../inst/include/hashmap/SharedMapClass.h"
 
 using namespace Rcpp;
 
+// Hashset has two single-argument constructors; route external
+// pointers (from clone()) to the copy constructor
+static bool is_xptr(SEXP* args, int nargs)
+{ return nargs == 1 && TYPEOF(args[0]) == EXTPTRSXP; }
+
+static bool is_not_xptr(SEXP* args, int nargs)
+{ return nargs == 1 && TYPEOF(args[0]) != EXTPTRSXP; }
+
 RCPP_MODULE(Hashmap) {
     class_<hashmap::HashMap>("Hashmap")
 
     .constructor<SEXP, SEXP>()
+    .constructor<SEXP, SEXP, bool>()
     .constructor<Rcpp::XPtr<hashmap::HashMap> >()
 
     .method("size", &hashmap::HashMap::size)
@@ -19,16 +32,26 @@ RCPP_MODULE(Hashmap) {
     .method("hash_value", &hashmap::HashMap::hash_value)
 
     .method("insert", &hashmap::HashMap::insert)
-    .method("[[<-", &hashmap::HashMap::insert)
+    .method("update", &hashmap::HashMap::update)
+    .method("update", &hashmap::HashMap::update_policy)
+
+    .method("filter", &hashmap::HashMap::filter)
+    .method("transform", &hashmap::HashMap::transform)
 
     .method("erase", &hashmap::HashMap::erase)
+    .method("erase_if", &hashmap::HashMap::erase_if)
+    .method("na_omit", &hashmap::HashMap::na_omit)
 
     .method("find", &hashmap::HashMap::find)
-    .method("[[", &hashmap::HashMap::find)
 
     .method("has_key", &hashmap::HashMap::has_key)
     .method("has_keys", &hashmap::HashMap::has_keys)
 
+    .method("floor", &hashmap::HashMap::floor)
+    .method("ceiling", &hashmap::HashMap::ceiling)
+    .method("rank", &hashmap::HashMap::rank)
+    .method("range", &hashmap::HashMap::range)
+
     .method("keys", &hashmap::HashMap::keys)
     .method("values", &hashmap::HashMap::values)
     .method("data", &hashmap::HashMap::data)
@@ -41,11 +64,121 @@ RCPP_MODULE(Hashmap) {
     .method("cache_keys", &hashmap::HashMap::cache_keys)
     .method("cache_values", &hashmap::HashMap::cache_values)
 
+    .method("incremental", &hashmap::HashMap::incremental)
+    .method("set_incremental", &hashmap::HashMap::set_incremental)
+
+    .method("frozen", &hashmap::HashMap::frozen)
+    .method("freeze", &hashmap::HashMap::freeze)
+
+    .method("persistent", &hashmap::HashMap::persistent)
+    .method("set_persistent", &hashmap::HashMap::set_persistent)
+    .method("snapshot", &hashmap::HashMap::snapshot)
+
+    .method("bloom", &hashmap::HashMap::bloom)
+    .method("set_bloom", &hashmap::HashMap::set_bloom)
+    .method("set_bloom", &hashmap::HashMap::set_bloom_bits)
+    .method("set_journal", &hashmap::HashMap::set_journal)
+    .method("set_journal", &hashmap::HashMap::set_journal_sync)
+    .method("close_journal", &hashmap::HashMap::close_journal)
+    .method("checkpoint", &hashmap::HashMap::checkpoint)
+    .method("durable", &hashmap::HashMap::durable)
+    .method("journal_path", &hashmap::HashMap::journal_path)
+    .method("encoded", &hashmap::HashMap::encoded)
+    .method("set_encoded", &hashmap::HashMap::set_encoded)
+    .method("memory_stats", &hashmap::HashMap::memory_stats)
+
     .method("key_sexptype", &hashmap::HashMap::key_sexptype)
     .method("value_sexptype", &hashmap::HashMap::value_sexptype)
 
     .method("renew", &hashmap::HashMap::renew)
     .method("data.frame", &hashmap::HashMap::data_frame)
+    .method("cursor", &hashmap::HashMap::cursor)
+
+    ;
+
+    class_<hashmap::HashSet>("Hashset")
+
+    .constructor<Rcpp::XPtr<hashmap::HashSet> >(0, &is_xptr)
+    .constructor<SEXP>(0, &is_not_xptr)
+
+    .method("size", &hashmap::HashSet::size)
+    .method("empty", &hashmap::HashSet::empty)
+    .method("clear", &hashmap::HashSet::clear)
+    .method("bucket_count", &hashmap::HashSet::bucket_count)
+    .method("rehash", &hashmap::HashSet::rehash)
+    .method("reserve", &hashmap::HashSet::reserve)
+
+    .method("hash_value", &hashmap::HashSet::hash_value)
+
+    .method("insert", &hashmap::HashSet::insert)
+    .method("erase", &hashmap::HashSet::erase)
+    .method("contains", &hashmap::HashSet::contains)
+    .method("[[", &hashmap::HashSet::contains)
+
+    .method("keys", &hashmap::HashSet::keys)
+    .method("keys_n", &hashmap::HashSet::keys_n)
+
+    .method("union", &hashmap::HashSet::set_union)
+    .method("intersect", &hashmap::HashSet::set_intersect)
+    .method("setdiff", &hashmap::HashSet::set_diff)
+    .method("symdiff", &hashmap::HashSet::set_symdiff)
+
+    .method("key_sexptype", &hashmap::HashSet::key_sexptype)
+    .method("key_class_name", &hashmap::HashSet::key_class_name)
+
+    ;
+
+    class_<hashmap::HashIndex>("HashIndex")
+
+    .constructor<SEXP>()
+
+    .method("size", &hashmap::HashIndex::size)
+    .method("length", &hashmap::HashIndex::length)
+    .method("key_sexptype", &hashmap::HashIndex::key_sexptype)
+
+    .method("match", &hashmap::HashIndex::match)
+    .method("match", &hashmap::HashIndex::match_nomatch)
+    .method("contains", &hashmap::HashIndex::contains)
+    .method("%in%", &hashmap::HashIndex::contains)
+    .method("any_duplicated", &hashmap::HashIndex::any_duplicated)
+    .method("any_duplicated", &hashmap::HashIndex::any_duplicated_in)
+    .method("tabulate", &hashmap::HashIndex::tabulate)
+
+    ;
+
+    class_<hashmap::SharedMap>("SharedHashmap")
+
+    .constructor<std::string, SEXP, SEXP, bool>()
+
+    .method("size", &hashmap::SharedMap::size)
+    .method("empty", &hashmap::SharedMap::empty)
+    .method("clear", &hashmap::SharedMap::clear)
+    .method("reserve", &hashmap::SharedMap::reserve)
+    .method("name", &hashmap::SharedMap::name)
+    .method("writable", &hashmap::SharedMap::writable)
+    .method("unlink", &hashmap::SharedMap::unlink)
+
+    .method("insert", &hashmap::SharedMap::insert)
+    .method("erase", &hashmap::SharedMap::erase)
+    .method("find", &hashmap::SharedMap::find)
+    .method("has_key", &hashmap::SharedMap::has_key)
+    .method("has_keys", &hashmap::SharedMap::has_keys)
+
+    .method("keys", &hashmap::SharedMap::keys)
+    .method("values", &hashmap::SharedMap::values)
+    .method("data", &hashmap::SharedMap::data)
+
+    .method("key_sexptype", &hashmap::SharedMap::key_sexptype)
+    .method("value_sexptype", &hashmap::SharedMap::value_sexptype)
+
+    ;
+
+    class_<hashmap::HashCursor>("HashCursor")
+
+    .method("next_chunk", &hashmap::HashCursor::next_chunk)
+    .method("has_next", &hashmap::HashCursor::has_next)
+    .method("position", &hashmap::HashCursor::position)
+    .method("reset", &hashmap::HashCursor::reset)
 
     ;
 }
@@ -3,18 +3,40 @@
 #include <stdlib.h>
 #include <R_ext/Rdynload.h>
 
+extern SEXP _hashmap_from_arrow(SEXP, SEXP, SEXP, SEXP);
+extern SEXP _hashmap_from_file(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _hashmap_full_outer_join_impl(SEXP, SEXP);
 extern SEXP _hashmap_inner_join_impl(SEXP, SEXP);
 extern SEXP _hashmap_left_outer_join_impl(SEXP, SEXP);
+extern SEXP _hashmap_open_journal(SEXP, SEXP);
+extern SEXP _hashmap_profile_reset(void);
+extern SEXP _hashmap_profile_stats(void);
 extern SEXP _hashmap_right_outer_join_impl(SEXP, SEXP);
+extern SEXP _hashmap_scalar_del(SEXP, SEXP);
+extern SEXP _hashmap_scalar_get(SEXP, SEXP);
+extern SEXP _hashmap_scalar_has(SEXP, SEXP);
+extern SEXP _hashmap_scalar_set(SEXP, SEXP, SEXP);
+extern SEXP _hashmap_to_arrow(SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _rcpp_module_boot_Hashmap(void);
 
+extern void hashmap_register_api(void);
+
 static const R_CallMethodDef CallEntries[] =
 {
+    {"_hashmap_from_arrow",             (DL_FUNC)   &_hashmap_from_arrow,            4},
+    {"_hashmap_from_file",              (DL_FUNC)   &_hashmap_from_file,             6},
     {"_hashmap_full_outer_join_impl",   (DL_FUNC)   &_hashmap_full_outer_join_impl,  2},
     {"_hashmap_inner_join_impl",        (DL_FUNC)   &_hashmap_inner_join_impl,       2},
     {"_hashmap_left_outer_join_impl",   (DL_FUNC)   &_hashmap_left_outer_join_impl,  2},
+    {"_hashmap_open_journal",           (DL_FUNC)   &_hashmap_open_journal,          2},
+    {"_hashmap_profile_reset",          (DL_FUNC)   &_hashmap_profile_reset,         0},
+    {"_hashmap_profile_stats",          (DL_FUNC)   &_hashmap_profile_stats,         0},
     {"_hashmap_right_outer_join_impl",  (DL_FUNC)   &_hashmap_right_outer_join_impl, 2},
+    {"_hashmap_scalar_del",             (DL_FUNC)   &_hashmap_scalar_del,            2},
+    {"_hashmap_scalar_get",             (DL_FUNC)   &_hashmap_scalar_get,            2},
+    {"_hashmap_scalar_has",             (DL_FUNC)   &_hashmap_scalar_has,            2},
+    {"_hashmap_scalar_set",             (DL_FUNC)   &_hashmap_scalar_set,            3},
+    {"_hashmap_to_arrow",               (DL_FUNC)   &_hashmap_to_arrow,              5},
     {"_rcpp_module_boot_Hashmap",       (DL_FUNC)   &_rcpp_module_boot_Hashmap,      0},
     {NULL,                               NULL,                                       0}
 };
@@ -23,4 +45,5 @@ void R_init_hashmap(DllInfo* dll)
 {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    hashmap_register_api();
 }
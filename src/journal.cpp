@@ -0,0 +1,62 @@
+// [[Rcpp::depends(BH)]]
+#include "../inst/include/hashmap/HashTemplate.hpp"
+#include "../inst/include/hashmap/EngineTemplate.hpp"
+
+namespace hashmap {
+namespace {
+
+// a zero-length vector of the given type and class, from which the
+// table takes its key (or value) type and attributes
+SEXP prototype(int type, const std::string& cls, const std::string& tz)
+{
+    Rcpp::RObject res(Rf_allocVector(type, 0));
+
+    if (cls == "Date") {
+        res.attr("class") = "Date";
+    } else if (cls == "POSIXct") {
+        res.attr("class") = Rcpp::CharacterVector::create("POSIXct", "POSIXt");
+        if (!tz.empty()) res.attr("tzone") = tz;
+    }
+
+    return res;
+}
+
+} // anonymous
+
+HashMap* HashMap::open_journal(const std::string& path, bool sync)
+{
+    journal_schema schema = journal::read_schema(path);
+
+    Rcpp::RObject keys(
+        prototype(schema.key_type, schema.key_class, schema.key_tz)
+    );
+    Rcpp::RObject values(
+        prototype(schema.value_type, schema.value_class, schema.value_tz)
+    );
+    if (schema.flags & journal_schema::encoded) {
+        values = factor_dict::encode(values, true);
+    }
+
+    engine_ptr x = engine_registry::instance().create(
+        keys, values, (schema.flags & journal_schema::ordered) != 0
+    );
+
+    if (schema.flags & journal_schema::persistent) x->set_persistent(true);
+    x->open_journal(path, sync);
+
+    return new HashMap(x);
+}
+
+} // hashmap
+
+RcppExport SEXP _hashmap_open_journal(SEXP path, SEXP sync)
+{
+BEGIN_RCPP
+    return Rcpp::internal::make_new_object(
+        hashmap::HashMap::open_journal(
+            Rcpp::as<std::string>(path),
+            Rcpp::as<bool>(sync)
+        )
+    );
+END_RCPP
+}
@@ -0,0 +1,71 @@
+// [[Rcpp::depends(BH)]]
+#include "../inst/include/hashmap/profile.hpp"
+#include <Rcpp.h>
+
+// Read-out of the HASHMAP_PROFILE counters (profile.hpp); registered
+// in init.c. Without HASHMAP_PROFILE the counters are never updated,
+// and profile_stats() reports zeros with enabled = FALSE.
+
+RcppExport SEXP _hashmap_profile_stats()
+{
+BEGIN_RCPP
+    namespace prof = hashmap::profile;
+    const prof::state& s = prof::get();
+
+    int i = 0, n = prof::n_operations;
+    int ncol = 4 + prof::n_phases;
+
+    Rcpp::List ops(ncol);
+    Rcpp::CharacterVector names(ncol);
+    Rcpp::CharacterVector op(n);
+    Rcpp::NumericVector calls(n), elements(n), total(n);
+
+    for (; i < n; i++) {
+        op[i] = prof::operation_name(i);
+        calls[i] = s.ops[i].calls;
+        elements[i] = s.ops[i].elements;
+        total[i] = s.ops[i].total_ns;
+    }
+
+    ops[0] = op;
+    ops[1] = calls;
+    ops[2] = elements;
+    ops[3] = total;
+
+    names[0] = "op";
+    names[1] = "calls";
+    names[2] = "elements";
+    names[3] = "total_ns";
+
+    for (int p = 0; p < prof::n_phases; p++) {
+        Rcpp::NumericVector tmp(n);
+        for (i = 0; i < n; i++) {
+            tmp[i] = s.ops[i].phase_ns[p];
+        }
+        ops[4 + p] = tmp;
+        names[4 + p] = std::string(prof::phase_name(p)) + "_ns";
+    }
+
+    ops.attr("names") = names;
+    ops.attr("row.names") = Rcpp::IntegerVector::create(NA_INTEGER, -n);
+    ops.attr("class") = "data.frame";
+
+    return Rcpp::List::create(
+        Rcpp::Named("enabled") = prof::enabled(),
+        Rcpp::Named("operations") = ops,
+        Rcpp::Named("rehash") = Rcpp::NumericVector::create(
+            Rcpp::Named("events") = s.rehash.events,
+            Rcpp::Named("total_ns") = s.rehash.total_ns,
+            Rcpp::Named("max_ns") = s.rehash.max_ns
+        )
+    );
+END_RCPP
+}
+
+RcppExport SEXP _hashmap_profile_reset()
+{
+BEGIN_RCPP
+    hashmap::profile::get().reset();
+    return R_NilValue;
+END_RCPP
+}
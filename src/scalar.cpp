@@ -0,0 +1,58 @@
+// [[Rcpp::depends(BH)]]
+#include "../inst/include/hashmap/HashMapClass.h"
+
+// Single-key .Call entry points (registered in init.c). These bypass
+// the Rcpp Modules method lookup that `H$find(k)` and friends pay on
+// every call; x may be either a Hashmap object or its .pointer.
+
+namespace hashmap {
+
+HashMap* hashmap_pointer(SEXP x)
+{
+    static SEXP pointer_sym = NULL;
+
+    if (Rf_isS4(x) && Rf_inherits(x, "Rcpp_Hashmap")) {
+        // reference class objects keep their environment in .xData
+        SEXP env = TYPEOF(x) == ENVSXP ? x : R_getS4DataSlot(x, ENVSXP);
+        if (!pointer_sym) pointer_sym = Rf_install(".pointer");
+        x = TYPEOF(env) == ENVSXP ?
+            Rf_findVarInFrame(env, pointer_sym) : R_NilValue;
+    }
+
+    if (TYPEOF(x) != EXTPTRSXP || !R_ExternalPtrAddr(x)) {
+        Rcpp::stop("Invalid (NULL) Hashmap object pointer");
+    }
+
+    return static_cast<HashMap*>(R_ExternalPtrAddr(x));
+}
+
+} // hashmap
+
+RcppExport SEXP _hashmap_scalar_get(SEXP x, SEXP key)
+{
+BEGIN_RCPP
+    return hashmap::hashmap_pointer(x)->get_scalar(key);
+END_RCPP
+}
+
+RcppExport SEXP _hashmap_scalar_set(SEXP x, SEXP key, SEXP value)
+{
+BEGIN_RCPP
+    hashmap::hashmap_pointer(x)->set_scalar(key, value);
+    return R_NilValue;
+END_RCPP
+}
+
+RcppExport SEXP _hashmap_scalar_has(SEXP x, SEXP key)
+{
+BEGIN_RCPP
+    return Rf_ScalarLogical(hashmap::hashmap_pointer(x)->has_scalar(key));
+END_RCPP
+}
+
+RcppExport SEXP _hashmap_scalar_del(SEXP x, SEXP key)
+{
+BEGIN_RCPP
+    return Rf_ScalarLogical(hashmap::hashmap_pointer(x)->erase_scalar(key));
+END_RCPP
+}